@@ -0,0 +1,250 @@
+#include "CompileCache.h"
+#include <algorithm>
+#include <sstream>
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/SHA1.h"
+#include "llvm/Support/raw_ostream.h"
+
+extern std::vector<std::string> debugLogs;
+
+namespace {
+	void debugLog(size_t line) {
+		std::stringstream ss;
+		ss << __FILE__ << ":" << line;
+		debugLogs.push_back(ss.str());
+	}
+
+	const char* const kEntryExtension = ".entry";
+	const char* const kHitCounterName = "hits";
+	const char* const kMissCounterName = "misses";
+
+	// a counter is a zero padded decimal number of this many digits
+	const size_t kCounterWidth = 20;
+
+	uint64_t getFileSize(const std::string& path) {
+		uint64_t size = 0;
+		if (llvm::sys::fs::file_size(path, size)) {
+			return 0;
+		}
+		return size;
+	}
+
+	uint64_t parseCounter(llvm::StringRef digits) {
+		uint64_t result = 0;
+		if (digits.trim().getAsInteger(10, result)) {
+			return 0;
+		}
+		return result;
+	}
+
+	uint64_t readCounter(const std::string& path) {
+		auto buffer = llvm::MemoryBuffer::getFile(path);
+		if (!buffer) {
+			return 0;
+		}
+		return parseCounter((*buffer)->getBuffer());
+	}
+
+	// through the descriptor that holds the lock, because closing another descriptor of the file
+	// would release the lock, which is a POSIX record lock, see CompileCache::count()
+	uint64_t readCounter(int fd) {
+		char digits[kCounterWidth];
+		auto size = llvm::sys::fs::readNativeFileSlice(llvm::sys::fs::convertFDToNativeFile(fd), digits, 0);
+		if (!size) {
+			llvm::consumeError(size.takeError());
+			return 0;
+		}
+		return parseCounter(llvm::StringRef(digits, *size));
+	}
+
+	void addressOfExecutable() {}
+}
+
+bool CompileCache::getCompilerIdentity(std::string& result) {
+	std::string path = llvm::sys::fs::getMainExecutable(nullptr, reinterpret_cast<void*>(&addressOfExecutable));
+	llvm::sys::fs::file_status status;
+	if (path.empty() || llvm::sys::fs::status(path, status)) {
+		debugLog(__LINE__);
+		return true;
+	}
+
+	auto modified = std::chrono::duration_cast<std::chrono::nanoseconds>(status.getLastModificationTime().time_since_epoch());
+	result = path + ":" + std::to_string(status.getSize()) + ":" + std::to_string(modified.count());
+	return false;
+}
+
+bool CompileCache::init() {
+	if (llvm::sys::fs::create_directories(directory_)) {
+		debugLog(__LINE__);
+		return true;
+	}
+	return false;
+}
+
+bool CompileCache::computeKey(const std::string& sourcePath, const std::vector<std::string>& parameters, std::string& result) const {
+	auto source = llvm::MemoryBuffer::getFile(sourcePath);
+	if (!source) {
+		debugLog(__LINE__);
+		return true;
+	}
+
+	// length prefixes keep ("ab", "c") and ("a", "bc") apart
+	llvm::SHA1 hasher;
+	for (auto& parameter : parameters) {
+		hasher.update(std::to_string(parameter.size()) + ":");
+		hasher.update(parameter);
+	}
+	hasher.update(std::to_string((*source)->getBufferSize()) + ":");
+	hasher.update((*source)->getBuffer());
+
+	result = llvm::toHex(hasher.final(), true);
+	return false;
+}
+
+std::string CompileCache::getEntryPath(const std::string& key) const {
+	llvm::SmallString<256> path(directory_);
+	llvm::sys::path::append(path, key + kEntryExtension);
+	return path.str().str();
+}
+
+bool CompileCache::lookup(const std::string& key, const std::string& outputPath, bool& isHit) {
+	isHit = false;
+	std::string entryPath = getEntryPath(key);
+
+	// another process may evict the entry at any time, so a failed open or copy is just a miss
+	int fd;
+	if (!llvm::sys::fs::openFileForReadWrite(entryPath, fd, llvm::sys::fs::CD_OpenExisting, llvm::sys::fs::OF_None)) {
+		// the modification time is the LRU timestamp
+		llvm::sys::fs::setLastAccessAndModificationTime(fd, std::chrono::system_clock::now());
+		llvm::sys::fs::closeFile(fd);
+
+		if (!llvm::sys::fs::copy_file(entryPath, outputPath)) {
+			isHit = true;
+		}
+	}
+
+	count(isHit ? kHitCounterName : kMissCounterName);
+
+	return false;
+}
+
+bool CompileCache::store(const std::string& key, const std::string& outputPath) {
+	llvm::SmallString<256> model(directory_);
+	llvm::sys::path::append(model, key + "-%%%%%%%%.tmp");
+
+	int fd;
+	llvm::SmallString<256> temporaryPath;
+	if (llvm::sys::fs::createUniqueFile(model, fd, temporaryPath)) {
+		debugLog(__LINE__);
+		return true;
+	}
+
+	bool error = static_cast<bool>(llvm::sys::fs::copy_file(outputPath, fd));
+	llvm::sys::fs::closeFile(fd);
+	if (error || llvm::sys::fs::rename(temporaryPath, getEntryPath(key))) {
+		llvm::sys::fs::remove(temporaryPath);
+		debugLog(__LINE__);
+		return true;
+	}
+
+	return evict();
+}
+
+void CompileCache::count(const char* counterName) {
+	llvm::SmallString<256> path(directory_);
+	llvm::sys::path::append(path, counterName);
+
+	// the lock keeps concurrent compiler processes from losing an increment; a failure only loses one count
+	int fd;
+	if (llvm::sys::fs::openFileForReadWrite(path, fd, llvm::sys::fs::CD_OpenAlways, llvm::sys::fs::OF_None)) {
+		return;
+	}
+	if (!llvm::sys::fs::lockFile(fd)) {
+		uint64_t value = readCounter(fd) + 1;
+		std::string digits = std::to_string(value);
+		digits.insert(0, kCounterWidth - std::min(kCounterWidth, digits.size()), '0');
+
+		llvm::raw_fd_ostream ofs(fd, false);
+		ofs.seek(0);
+		ofs << digits;
+		ofs.flush();
+		llvm::sys::fs::unlockFile(fd);
+	}
+	llvm::sys::fs::closeFile(fd);
+}
+
+bool CompileCache::evict() {
+	struct Entry {
+		std::string path;
+		uint64_t size;
+		llvm::sys::TimePoint<> lastUsed;
+	};
+
+	std::vector<Entry> entries;
+	uint64_t totalSize = 0;
+
+	std::error_code errorCode;
+	for (llvm::sys::fs::directory_iterator i(directory_, errorCode), end; i != end && !errorCode; i.increment(errorCode)) {
+		if (!llvm::StringRef(i->path()).endswith(kEntryExtension)) {
+			continue;
+		}
+
+		llvm::sys::fs::file_status status;
+		if (llvm::sys::fs::status(i->path(), status)) {
+			continue;
+		}
+		entries.push_back(Entry({ i->path(), status.getSize(), status.getLastModificationTime() }));
+		totalSize += status.getSize();
+	}
+	if (errorCode) {
+		debugLog(__LINE__);
+		return true;
+	}
+
+	if (totalSize <= maxSize_) {
+		return false;
+	}
+
+	std::sort(entries.begin(), entries.end(), [](const Entry& lhs, const Entry& rhs) {
+		return lhs.lastUsed < rhs.lastUsed;
+	});
+	for (auto& entry : entries) {
+		if (totalSize <= maxSize_) {
+			break;
+		}
+		// a concurrent eviction may have removed it already
+		llvm::sys::fs::remove(entry.path);
+		totalSize -= entry.size;
+	}
+
+	return false;
+}
+
+bool CompileCache::getStatistics(Statistics& result) const {
+	llvm::SmallString<256> hitsPath(directory_);
+	llvm::sys::path::append(hitsPath, kHitCounterName);
+	llvm::SmallString<256> missesPath(directory_);
+	llvm::sys::path::append(missesPath, kMissCounterName);
+
+	result.hits = readCounter(hitsPath.str().str());
+	result.misses = readCounter(missesPath.str().str());
+	result.entries = 0;
+	result.size = 0;
+
+	std::error_code errorCode;
+	for (llvm::sys::fs::directory_iterator i(directory_, errorCode), end; i != end && !errorCode; i.increment(errorCode)) {
+		if (llvm::StringRef(i->path()).endswith(kEntryExtension)) {
+			result.entries++;
+			result.size += getFileSize(i->path());
+		}
+	}
+	if (errorCode) {
+		debugLog(__LINE__);
+		return true;
+	}
+
+	return false;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Content-addressed cache of compiler outputs.
+// An entry is keyed by the hash of the source bytes and every parameter that affects the output.
+// Entries are published with rename() so that concurrent compiler processes never see a partial file,
+// and the least recently used entries are removed when the directory grows over maxSize.
+// The hit and miss counters are fixed size files updated under a lock, so they never grow.
+class CompileCache
+{
+public:
+	CompileCache(const std::string& directory, uint64_t maxSize) : directory_(directory), maxSize_(maxSize) {}
+	~CompileCache() = default;
+
+	struct Statistics {
+		uint64_t hits;
+		uint64_t misses;
+		uint64_t entries;
+		uint64_t size;
+	};
+
+	// the path, size and modification time of the compiler executable, as ccache identifies a compiler by default
+	static bool getCompilerIdentity(std::string& result);
+
+	bool init();
+	bool computeKey(const std::string& sourcePath, const std::vector<std::string>& parameters, std::string& result) const;
+	bool lookup(const std::string& key, const std::string& outputPath, bool& isHit);
+	bool store(const std::string& key, const std::string& outputPath);
+	bool getStatistics(Statistics& result) const;
+
+private:
+	std::string directory_;
+	uint64_t maxSize_;
+
+	std::string getEntryPath(const std::string& key) const;
+	void count(const char* counterName);
+	bool evict();
+};
@@ -188,6 +188,22 @@ public:
 	}
 };
 
+class DivisionByZeroError : public CompileError {
+public:
+	DivisionByZeroError(const Token& operatorToken) : CompileError(operatorToken) {}
+	const char* getErrorName() const {
+		return "DivisionByZero";
+	}
+};
+
+class NotAllowedInConstFunctionError : public CompileError {
+public:
+	NotAllowedInConstFunctionError(const Token& token) : CompileError(token) {}
+	const char* getErrorName() const {
+		return "NotAllowedInConstFunction";
+	}
+};
+
 class InvalidCallArgumentLength : public CompileError {
 public:
 	InvalidCallArgumentLength(const Token& callToken, const Token& functionNameToken) : CompileError(callToken), functionName_(functionNameToken) {}
@@ -200,6 +216,15 @@ private:
 	Token functionName_;
 };
 
+class NotAssignableError : public CompileError {
+public:
+	NotAssignableError(const Token& token) : CompileError(token) {}
+
+	const char* getErrorName() const {
+		return "NotAssignable";
+	}
+};
+
 class CanNotOverwriteArgumentError : public CompileError {
 public:
 	CanNotOverwriteArgumentError(const Token& token) : CompileError(token) {}
@@ -236,6 +261,53 @@ public:
 	}
 };
 
+class UnknownAttributeError : public CompileError {
+public:
+	UnknownAttributeError(const Token& token) : CompileError(token) {}
+
+	const char* getErrorName() const {
+		return "UnknownAttribute";
+	}
+};
+
+class ConflictingAttributeError : public CompileError {
+public:
+	ConflictingAttributeError(const Token& token) : CompileError(token) {}
+
+	const char* getErrorName() const {
+		return "ConflictingAttribute";
+	}
+};
+
+class ReferenceMustBeInitializedError : public CompileError {
+public:
+	ReferenceMustBeInitializedError(const Token& token) : CompileError(token) {}
+
+	const char* getErrorName() const {
+		return "ReferenceMustBeInitialized";
+	}
+};
+
+// an object allocated in a region would be used after the region frees it
+class RegionObjectEscapesError : public CompileError {
+public:
+	RegionObjectEscapesError(const Token& token) : CompileError(token) {}
+
+	const char* getErrorName() const {
+		return "RegionObjectEscapes";
+	}
+};
+
+// a slice of an array of the function would be used after the function returns
+class LocalArraySliceEscapesError : public CompileError {
+public:
+	LocalArraySliceEscapesError(const Token& token) : CompileError(token) {}
+
+	const char* getErrorName() const {
+		return "LocalArraySliceEscapes";
+	}
+};
+
 class InvalidExternTypeError : public CompileError {
 public:
 	InvalidExternTypeError(const Token& token) : CompileError(token) {}
@@ -272,6 +344,52 @@ public:
 	}
 };
 
+class NotArrayTypeError : public CompileError {
+public:
+	NotArrayTypeError(const Token& token) : CompileError(token) {}
+
+	const char* getErrorName() const {
+		return "NotArrayType";
+	}
+};
+
+class IndexOutOfBoundsError : public CompileError {
+public:
+	IndexOutOfBoundsError(const Token& token) : CompileError(token) {}
+
+	const char* getErrorName() const {
+		return "IndexOutOfBounds";
+	}
+};
+
+class NotStructTypeError : public CompileError {
+public:
+	NotStructTypeError(const Token& token) : CompileError(token) {}
+
+	const char* getErrorName() const {
+		return "NotStructType";
+	}
+};
+
+class UndefinedMemberError : public CompileError {
+public:
+	UndefinedMemberError(const Token& token) : CompileError(token) {}
+
+	const char* getErrorName() const {
+		return "UndefinedMember";
+	}
+};
+
+// an element of a struct-of-arrays has no storage of its own, only its members do
+class SoaElementMustBeAccessedByMemberError : public CompileError {
+public:
+	SoaElementMustBeAccessedByMemberError(const Token& token) : CompileError(token) {}
+
+	const char* getErrorName() const {
+		return "SoaElementMustBeAccessedByMember";
+	}
+};
+
 class EachElementMustHaveIdenticallyTypeError : public CompileError {
 public:
 	EachElementMustHaveIdenticallyTypeError(const Token& token) : CompileError(token) {}
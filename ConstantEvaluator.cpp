@@ -0,0 +1,264 @@
+#include "ConstantEvaluator.h"
+#include <cmath>
+#include "llvm/ADT/APInt.h"
+
+namespace {
+	ConstantEvaluator::Status evaluateInteger(Token::Type operatorType, int64_t lhs, int64_t rhs, ConstantValue& result) {
+		llvm::APInt l(64, static_cast<uint64_t>(lhs), true);
+		llvm::APInt r(64, static_cast<uint64_t>(rhs), true);
+		bool isOverflow = false;
+		llvm::APInt value;
+
+		switch (operatorType) {
+		case Token::Type::PLUS:
+			value = l.sadd_ov(r, isOverflow);
+			break;
+		case Token::Type::MINUS:
+			value = l.ssub_ov(r, isOverflow);
+			break;
+		case Token::Type::ASTERISK:
+			value = l.smul_ov(r, isOverflow);
+			break;
+		case Token::Type::SLASH:
+			if (r.isNullValue()) {
+				return ConstantEvaluator::Status::DIVISION_BY_ZERO;
+			}
+			value = l.sdiv_ov(r, isOverflow);
+			break;
+		case Token::Type::PERCENT:
+			if (r.isNullValue()) {
+				return ConstantEvaluator::Status::DIVISION_BY_ZERO;
+			}
+			// the remainder of INT64_MIN / -1 is 0 even though the quotient overflows
+			value = l.srem(r);
+			break;
+		case Token::Type::COMPARE_LESSER_THAN:
+			result.type = Token::Type::CONSTANT_BOOL;
+			result.b = l.slt(r);
+			return ConstantEvaluator::Status::OK;
+		case Token::Type::COMPARE_LESSER_EQUAL:
+			result.type = Token::Type::CONSTANT_BOOL;
+			result.b = l.sle(r);
+			return ConstantEvaluator::Status::OK;
+		case Token::Type::COMPARE_GREATER_THAN:
+			result.type = Token::Type::CONSTANT_BOOL;
+			result.b = l.sgt(r);
+			return ConstantEvaluator::Status::OK;
+		case Token::Type::COMPARE_GREATER_EQUAL:
+			result.type = Token::Type::CONSTANT_BOOL;
+			result.b = l.sge(r);
+			return ConstantEvaluator::Status::OK;
+		case Token::Type::COMPARE_EQUAL:
+			result.type = Token::Type::CONSTANT_BOOL;
+			result.b = (l == r);
+			return ConstantEvaluator::Status::OK;
+		case Token::Type::COMPARE_NOT_EQUAL:
+			result.type = Token::Type::CONSTANT_BOOL;
+			result.b = (l != r);
+			return ConstantEvaluator::Status::OK;
+		default:
+			return ConstantEvaluator::Status::INVALID_OPERATION;
+		}
+
+		if (isOverflow) {
+			return ConstantEvaluator::Status::INTEGER_OVERFLOW;
+		}
+		result.type = Token::Type::CONSTANT_INTEGER;
+		result.i = value.getSExtValue();
+		return ConstantEvaluator::Status::OK;
+	}
+
+	ConstantEvaluator::Status evaluateFloat(Token::Type operatorType, double lhs, double rhs, ConstantValue& result) {
+		double value;
+
+		switch (operatorType) {
+		case Token::Type::PLUS:
+			value = lhs + rhs;
+			break;
+		case Token::Type::MINUS:
+			value = lhs - rhs;
+			break;
+		case Token::Type::ASTERISK:
+			value = lhs * rhs;
+			break;
+		case Token::Type::SLASH:
+			if (rhs == 0.0) {
+				return ConstantEvaluator::Status::DIVISION_BY_ZERO;
+			}
+			value = lhs / rhs;
+			break;
+		case Token::Type::PERCENT:
+			if (rhs == 0.0) {
+				return ConstantEvaluator::Status::DIVISION_BY_ZERO;
+			}
+			// same as frem, which the generator emits for the non-constant case
+			value = std::fmod(lhs, rhs);
+			break;
+		case Token::Type::COMPARE_LESSER_THAN:
+			result.type = Token::Type::CONSTANT_BOOL;
+			result.b = lhs < rhs;
+			return ConstantEvaluator::Status::OK;
+		case Token::Type::COMPARE_LESSER_EQUAL:
+			result.type = Token::Type::CONSTANT_BOOL;
+			result.b = lhs <= rhs;
+			return ConstantEvaluator::Status::OK;
+		case Token::Type::COMPARE_GREATER_THAN:
+			result.type = Token::Type::CONSTANT_BOOL;
+			result.b = lhs > rhs;
+			return ConstantEvaluator::Status::OK;
+		case Token::Type::COMPARE_GREATER_EQUAL:
+			result.type = Token::Type::CONSTANT_BOOL;
+			result.b = lhs >= rhs;
+			return ConstantEvaluator::Status::OK;
+		case Token::Type::COMPARE_EQUAL:
+			result.type = Token::Type::CONSTANT_BOOL;
+			result.b = lhs == rhs;
+			return ConstantEvaluator::Status::OK;
+		case Token::Type::COMPARE_NOT_EQUAL:
+			result.type = Token::Type::CONSTANT_BOOL;
+			result.b = lhs != rhs;
+			return ConstantEvaluator::Status::OK;
+		default:
+			return ConstantEvaluator::Status::INVALID_OPERATION;
+		}
+
+		// finite operands can only become infinite by exceeding the range of double
+		if (std::isinf(value) && std::isfinite(lhs) && std::isfinite(rhs)) {
+			return ConstantEvaluator::Status::INTEGER_OVERFLOW;
+		}
+		result.type = Token::Type::CONSTANT_FLOAT;
+		result.d = value;
+		return ConstantEvaluator::Status::OK;
+	}
+
+	ConstantEvaluator::Status evaluateBool(Token::Type operatorType, bool lhs, bool rhs, ConstantValue& result) {
+		result.type = Token::Type::CONSTANT_BOOL;
+		switch (operatorType) {
+		case Token::Type::COMPARE_EQUAL:
+			result.b = (lhs == rhs);
+			return ConstantEvaluator::Status::OK;
+		case Token::Type::COMPARE_NOT_EQUAL:
+			result.b = (lhs != rhs);
+			return ConstantEvaluator::Status::OK;
+		case Token::Type::LOGICAL_OR:
+			result.b = lhs || rhs;
+			return ConstantEvaluator::Status::OK;
+		case Token::Type::LOGICAL_AND:
+			result.b = lhs && rhs;
+			return ConstantEvaluator::Status::OK;
+		default:
+			return ConstantEvaluator::Status::INVALID_OPERATION;
+		}
+	}
+}
+
+ConstantEvaluator::Status ConstantEvaluator::evaluateBinaryOperation(Token::Type operatorType, const ConstantValue& lhs, const ConstantValue& rhs, ConstantValue& result) {
+	if (lhs.type != rhs.type) {
+		return Status::INVALID_OPERATION;
+	}
+
+	switch (lhs.type) {
+	case Token::Type::CONSTANT_BOOL:
+		return evaluateBool(operatorType, lhs.b, rhs.b, result);
+	case Token::Type::CONSTANT_INTEGER:
+		return evaluateInteger(operatorType, lhs.i, rhs.i, result);
+	case Token::Type::CONSTANT_FLOAT:
+		return evaluateFloat(operatorType, lhs.d, rhs.d, result);
+	default:
+		return Status::INVALID_OPERATION;
+	}
+}
+
+ConstantEvaluator::Status ConstantEvaluator::evaluateUnaryOperation(Token::Type operatorType, const ConstantValue& value, ConstantValue& result) {
+	if (operatorType != Token::Type::MINUS) {
+		return Status::INVALID_OPERATION;
+	}
+
+	switch (value.type) {
+	case Token::Type::CONSTANT_INTEGER:
+		return evaluateInteger(Token::Type::MINUS, 0, value.i, result);
+	case Token::Type::CONSTANT_FLOAT:
+		result.type = Token::Type::CONSTANT_FLOAT;
+		result.d = -value.d;
+		return Status::OK;
+	default:
+		return Status::INVALID_OPERATION;
+	}
+}
+
+ConstantEvaluator::Status ConstantEvaluator::evaluateCast(const ConstantValue& value, Token::Type destType, ConstantValue& result) {
+	if (Token::isIntegerType(destType)) {
+		int64_t i;
+		if (value.type == Token::Type::CONSTANT_INTEGER) {
+			i = value.i;
+		}
+		else if (value.type == Token::Type::CONSTANT_FLOAT) {
+			// rounded toward zero as fptosi and fptoui do, which are poison out of range
+			double truncated = std::trunc(value.d);
+			if (!std::isfinite(truncated) || (truncated < -0x1p63) || (0x1p63 <= truncated)) {
+				return Status::INTEGER_OVERFLOW;
+			}
+			i = static_cast<int64_t>(truncated);
+		}
+		else {
+			return Status::INVALID_OPERATION;
+		}
+
+		if (!isRepresentable(i, destType)) {
+			return Status::INTEGER_OVERFLOW;
+		}
+		result.type = Token::Type::CONSTANT_INTEGER;
+		result.i = i;
+		return Status::OK;
+	}
+
+	if (Token::isFloatingPointType(destType)) {
+		double d;
+		if (value.type == Token::Type::CONSTANT_INTEGER) {
+			d = static_cast<double>(value.i);
+		}
+		else if (value.type == Token::Type::CONSTANT_FLOAT) {
+			d = value.d;
+		}
+		else {
+			return Status::INVALID_OPERATION;
+		}
+
+		if (destType == Token::Type::TYPE_F32) {
+			// an integer is rounded to f32 once, not through double
+			float f = (value.type == Token::Type::CONSTANT_INTEGER) ? static_cast<float>(value.i) : static_cast<float>(d);
+			if (std::isinf(f) && !std::isinf(d)) {
+				return Status::INTEGER_OVERFLOW;
+			}
+			d = f;
+		}
+		result.type = Token::Type::CONSTANT_FLOAT;
+		result.d = d;
+		return Status::OK;
+	}
+
+	return Status::INVALID_OPERATION;
+}
+
+bool ConstantEvaluator::isRepresentable(int64_t value, Token::Type integerType) {
+	switch (integerType) {
+	case Token::Type::TYPE_I8:
+		return (INT8_MIN <= value) && (value <= INT8_MAX);
+	case Token::Type::TYPE_I16:
+		return (INT16_MIN <= value) && (value <= INT16_MAX);
+	case Token::Type::TYPE_I32:
+		return (INT32_MIN <= value) && (value <= INT32_MAX);
+	case Token::Type::TYPE_I64:
+		return true;
+	case Token::Type::TYPE_U8:
+		return (0 <= value) && (value <= UINT8_MAX);
+	case Token::Type::TYPE_U16:
+		return (0 <= value) && (value <= UINT16_MAX);
+	case Token::Type::TYPE_U32:
+		return (0 <= value) && (value <= UINT32_MAX);
+	case Token::Type::TYPE_U64:
+		return 0 <= value;
+	default:
+		return false;
+	}
+}
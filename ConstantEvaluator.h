@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdint.h>
+#include "Token.h"
+
+// The value of a constant expression.
+// type is CONSTANT_BOOL, CONSTANT_INTEGER or CONSTANT_FLOAT, and selects the member that holds the value.
+struct ConstantValue {
+	Token::Type type;
+	bool b;
+	int64_t i;
+	double d;
+
+	ConstantValue() : type(Token::Type::UNDEFINED), b(false), i(0), d(0.0) {}
+};
+
+// Exact evaluation of constant expressions.
+// Integer constants are 64-bit signed and floating point constants are double, as ConstantNode parses them;
+// a result that does not fit is reported instead of wrapping around, and division by zero is reported
+// instead of being left to the program.
+class ConstantEvaluator
+{
+public:
+	enum class Status {
+		OK,
+		INTEGER_OVERFLOW,
+		DIVISION_BY_ZERO,
+		INVALID_OPERATION,
+	};
+
+	static Status evaluateBinaryOperation(Token::Type operatorType, const ConstantValue& lhs, const ConstantValue& rhs, ConstantValue& result);
+	static Status evaluateUnaryOperation(Token::Type operatorType, const ConstantValue& value, ConstantValue& result);
+
+	// the value converted to destType; the result is still untyped, and is reported as overflow unless destType holds it
+	static Status evaluateCast(const ConstantValue& value, Token::Type destType, ConstantValue& result);
+	static bool isRepresentable(int64_t value, Token::Type integerType);
+};
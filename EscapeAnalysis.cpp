@@ -0,0 +1,181 @@
+#include "EscapeAnalysis.h"
+#include <algorithm>
+#include "Node.h"
+
+EscapeAnalysis::EscapeAnalysis(Context& ctx) : ctx_(ctx), loopDepth_(0), regionDepth_(0) {}
+
+void EscapeAnalysis::addScope() {
+	scopes_.emplace_back();
+}
+
+void EscapeAnalysis::removeScope() {
+	scopes_.pop_back();
+}
+
+void EscapeAnalysis::enterLoop() {
+	loopDepth_++;
+}
+
+void EscapeAnalysis::exitLoop() {
+	loopDepth_--;
+}
+
+void EscapeAnalysis::enterRegion() {
+	regionDepth_++;
+}
+
+void EscapeAnalysis::exitRegion() {
+	regionDepth_--;
+}
+
+size_t EscapeAnalysis::addVariable(const std::string& name) {
+	size_t variable = variables_.size();
+	variables_.push_back(Variable({ name, loopDepth_, regionDepth_, {}, false, false, false }));
+	scopes_.back().push_back(variable);
+	return variable;
+}
+
+bool EscapeAnalysis::getVariable(const std::string& name, size_t& result) const {
+	for (auto scope = scopes_.rbegin(); scope != scopes_.rend(); ++scope) {
+		for (auto variable = scope->rbegin(); variable != scope->rend(); ++variable) {
+			if (variables_[*variable].name == name) {
+				result = *variable;
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+void EscapeAnalysis::addObject(size_t variable, const LetNode* let) {
+	objects_.push_back(Object({ variable, let }));
+}
+
+void EscapeAnalysis::addRegionObject(size_t variable, const Token& token, const LetNode* let) {
+	regionObjects_.push_back(RegionObject({ variable, token, let }));
+}
+
+size_t EscapeAnalysis::addView(const VariableValueNode* node) {
+	// only leaving the function frees the viewed variable, whose stack slot is not reused by the loops and regions
+	size_t variable = variables_.size();
+	variables_.push_back(Variable({ "", 0, 0, {}, false, false, false }));
+	views_.push_back(View({ variable, node }));
+	return variable;
+}
+
+void EscapeAnalysis::addReturn(const std::vector<size_t>& sources) {
+	returns_.push_back(sources);
+}
+
+void EscapeAnalysis::addFlow(const std::vector<size_t>& sources, size_t dest) {
+	for (auto source : sources) {
+		variables_[source].flows.push_back(dest);
+	}
+}
+
+void EscapeAnalysis::addEscape(const std::vector<size_t>& sources) {
+	for (auto source : sources) {
+		variables_[source].isEscaping = true;
+	}
+}
+
+void EscapeAnalysis::addWrite(size_t variable) {
+	variables_[variable].isWritten = true;
+}
+
+void EscapeAnalysis::setNumberSlice(size_t variable) {
+	variables_[variable].isNumberSlice = true;
+}
+
+bool EscapeAnalysis::isNumberSlice(size_t variable) const {
+	return variables_[variable].isNumberSlice;
+}
+
+void EscapeAnalysis::addReadOnlyObject(size_t variable, const LetNode* let) {
+	readOnlyObjects_.push_back(Object({ variable, let }));
+}
+
+bool EscapeAnalysis::isEscaping(size_t variable) const {
+	return isEscaping(variable, false);
+}
+
+// whether the variable flows out of the function, or into a variable outside the loop (or the region) it is declared in
+bool EscapeAnalysis::isEscaping(size_t variable, bool isRegion) const {
+	size_t depth = isRegion ? variables_[variable].regionDepth : variables_[variable].loopDepth;
+
+	std::vector<bool> isVisited(variables_.size(), false);
+	std::vector<size_t> worklist = { variable };
+	isVisited[variable] = true;
+	while (!worklist.empty()) {
+		auto& v = variables_[worklist.back()];
+		worklist.pop_back();
+
+		if (v.isEscaping || ((isRegion ? v.regionDepth : v.loopDepth) < depth)) {
+			return true;
+		}
+		for (auto dest : v.flows) {
+			if (!isVisited[dest]) {
+				isVisited[dest] = true;
+				worklist.push_back(dest);
+			}
+		}
+	}
+
+	return false;
+}
+
+void EscapeAnalysis::getStackObjects(std::set<const LetNode*>& result) const {
+	result.clear();
+	for (auto& object : objects_) {
+		if ((object.let != nullptr) && !isEscaping(object.variable)) {
+			result.insert(object.let);
+		}
+	}
+}
+
+void EscapeAnalysis::getEscapingRegionObjects(std::vector<Token>& result) const {
+	result.clear();
+	for (auto& object : regionObjects_) {
+		// a new that does not escape the function is on the stack, wherever it is used
+		if ((object.let != nullptr) && !isEscaping(object.variable)) {
+			continue;
+		}
+		if (isEscaping(object.variable, true)) {
+			result.push_back(object.token);
+		}
+	}
+}
+
+void EscapeAnalysis::getReadOnlyObjects(std::set<const LetNode*>& result) const {
+	result.clear();
+	for (auto& object : readOnlyObjects_) {
+		if (!variables_[object.variable].isWritten) {
+			result.insert(object.let);
+		}
+	}
+}
+
+void EscapeAnalysis::getEscapingViews(std::set<const VariableValueNode*>& result) const {
+	result.clear();
+	for (auto& view : views_) {
+		if (isEscaping(view.variable)) {
+			result.insert(view.node);
+		}
+	}
+}
+
+bool EscapeAnalysis::isReturningNewObject() const {
+	if (returns_.empty()) {
+		return false;
+	}
+	for (auto& sources : returns_) {
+		if ((sources.size() != 1) || variables_[sources[0]].isWritten) {
+			return false;
+		}
+		auto object = std::find_if(objects_.begin(), objects_.end(), [&sources](const Object& o) { return o.variable == sources[0]; });
+		if (object == objects_.end()) {
+			return false;
+		}
+	}
+	return true;
+}
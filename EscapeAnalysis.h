@@ -0,0 +1,116 @@
+#pragma once
+
+#include <set>
+#include <string>
+#include <vector>
+#include "Token.h"
+
+class Context;
+class LetNode;
+class VariableValueNode;
+
+// Finds the objects created with new that never outlive the function, so that they can be allocated on the stack.
+// The analysis is flow-insensitive: a variable may hold every object that is ever assigned to it.
+// An object escapes when a variable that may hold it is returned, stored into a heap object,
+// or passed to a function that captures the argument (see FunctionNode::getCapturedArguments()).
+// It also escapes when such a variable is declared outside the innermost loop of the new,
+// because the stack slot is reused by every iteration.
+// The same flows tell whether an object allocated in a region (see RegionNode) outlives the region.
+// The variables that are never written after their definition are found on the way, see getReadOnlyObjects().
+// A slice range of a variable is a view of it, which must not flow out of the function when the variable is an array.
+class EscapeAnalysis
+{
+public:
+	EscapeAnalysis(Context& ctx);
+	~EscapeAnalysis() = default;
+
+	Context& getContext() {
+		return ctx_;
+	}
+
+	void addScope();
+	void removeScope();
+	void enterLoop();
+	void exitLoop();
+	void enterRegion();
+	void exitRegion();
+
+	bool isInRegion() const {
+		return regionDepth_ != 0;
+	}
+
+	size_t addVariable(const std::string& name);
+	bool getVariable(const std::string& name, size_t& result) const;
+	void addObject(size_t variable, const LetNode* let);
+	void addFlow(const std::vector<size_t>& sources, size_t dest);
+	void addEscape(const std::vector<size_t>& sources);
+
+	// assigned, or viewed by a slice through which it may be written
+	void addWrite(size_t variable);
+
+	// a slice of numbers, whose elements and length are neither objects nor views
+	void setNumberSlice(size_t variable);
+	bool isNumberSlice(size_t variable) const;
+
+	// a variable defined with a value that is read only if the variable is never written
+	void addReadOnlyObject(size_t variable, const LetNode* let);
+
+	// let is null for an object returned by a call, which is allocated from the region of the caller
+	void addRegionObject(size_t variable, const Token& token, const LetNode* let);
+
+	// the slice made by the slice range of node, which views a variable of the function
+	size_t addView(const VariableValueNode* node);
+
+	// the variables a return statement may return
+	void addReturn(const std::vector<size_t>& sources);
+
+	// whether the value the variable is defined with escapes
+	bool isEscaping(size_t variable) const;
+	void getStackObjects(std::set<const LetNode*>& result) const;
+	void getEscapingRegionObjects(std::vector<Token>& result) const;
+	void getReadOnlyObjects(std::set<const LetNode*>& result) const;
+	void getEscapingViews(std::set<const VariableValueNode*>& result) const;
+
+	// whether every return statement returns an object created with new by a variable that is never written
+	bool isReturningNewObject() const;
+
+private:
+	struct Variable {
+		std::string name;
+		size_t loopDepth;
+		size_t regionDepth;
+		std::vector<size_t> flows;
+		bool isEscaping;
+		bool isWritten;
+		bool isNumberSlice;
+	};
+
+	struct Object {
+		size_t variable;
+		const LetNode* let;
+	};
+
+	struct RegionObject {
+		size_t variable;
+		Token token;
+		const LetNode* let;
+	};
+
+	struct View {
+		size_t variable;
+		const VariableValueNode* node;
+	};
+
+	Context& ctx_;
+	std::vector<Variable> variables_;
+	std::vector<std::vector<size_t>> scopes_;
+	std::vector<Object> objects_;
+	std::vector<RegionObject> regionObjects_;
+	std::vector<Object> readOnlyObjects_;
+	std::vector<View> views_;
+	std::vector<std::vector<size_t>> returns_;
+	size_t loopDepth_;
+	size_t regionDepth_;
+
+	bool isEscaping(size_t variable, bool isRegion) const;
+};
@@ -1,6 +1,24 @@
 #include "Generator.h"
 #include <sstream>
 #include <iostream>
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/IR/ValueHandle.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/Transforms/IPO.h"
+#include "llvm/Transforms/IPO/AlwaysInliner.h"
+#include "llvm/Transforms/IPO/PassManagerBuilder.h"
+#include "llvm/MC/SubtargetFeature.h"
+#include "llvm/ProfileData/InstrProfReader.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Linker/Linker.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
 
 extern std::vector<std::string> debugLogs;
 
@@ -21,7 +39,7 @@ void Generator::llvmExample() {
 	llvm::Value* v1 = builder_.CreateAlloca(llvm::Type::getInt32Ty(context_));
 	llvm::Constant* con = llvm::ConstantInt::get(llvm::Type::getInt32Ty(context_), 123);
 	builder_.CreateStore(con, v1);
-	llvm::Value* v2 = builder_.CreateLoad(v1);
+	llvm::Value* v2 = builder_.CreateLoad(llvm::Type::getInt32Ty(context_), v1);
 	llvm::Value* value = con;
 
 	llvm::APInt ap = con->getUniqueInteger();
@@ -30,7 +48,7 @@ void Generator::llvmExample() {
 }
 
 bool Generator::init() {
-	std::string targetTriple = llvm::sys::getDefaultTargetTriple();
+	std::string targetTriple = getDefaultTargetTriple();
 
 	llvm::InitializeNativeTarget();
 	std::string errorMessage;
@@ -41,7 +59,7 @@ bool Generator::init() {
 	}
 
 	llvm::TargetOptions targetOptions;
-	targetMachine_ = target->createTargetMachine(targetTriple, "generic", "", targetOptions, llvm::Optional<llvm::Reloc::Model>());
+	targetMachine_ = target->createTargetMachine(targetTriple, targetCpu_, targetFeatures_, targetOptions, llvm::Optional<llvm::Reloc::Model>());
 	if (!targetMachine_) {
 		debugLog(__LINE__);
 		return true;
@@ -50,6 +68,13 @@ bool Generator::init() {
 	module_.setTargetTriple(targetTriple);
 	module_.setDataLayout(targetMachine_->createDataLayout());
 
+	if (debugEmissionKind_ != llvm::DICompileUnit::NoDebug) {
+		if (createDebugCompileUnit()) {
+			debugLog(__LINE__);
+			return true;
+		}
+	}
+
 	if (createBuiltInCode()) {
 		debugLog(__LINE__);
 		return true;
@@ -58,8 +83,32 @@ bool Generator::init() {
 	return false;
 }
 
+std::string Generator::getDefaultTargetTriple() {
+	return llvm::sys::getDefaultTargetTriple();
+}
+
+std::string Generator::getHostCpuName() {
+	return llvm::sys::getHostCPUName().str();
+}
+
+std::string Generator::getHostCpuFeatures() {
+	llvm::StringMap<bool> hostFeatures;
+	if (!llvm::sys::getHostCPUFeatures(hostFeatures)) {
+		return "";
+	}
+
+	llvm::SubtargetFeatures features;
+	for (auto& feature : hostFeatures) {
+		features.AddFeature(feature.first(), feature.second);
+	}
+	return features.getString();
+}
+
 bool Generator::createBuiltInCode() {
 	if (createMallocDeclare() ||
+		createAllocatorFunctions() ||
+		createRegionFunctions() ||
+		createReferenceCountingFunctions() ||
 		builtInObjectTypes_.init(*this))
 	{
 		debugLog(__LINE__);
@@ -76,6 +125,107 @@ bool Generator::createMallocDeclare() {
 		debugLog(__LINE__);
 		return true;
 	}
+	fMalloc_->setReturnDoesNotAlias();
+	fMalloc_->setDoesNotThrow();
+	return false;
+}
+
+// The runtime is emitted into every module, as linkonce_odr so that the linker keeps one copy of it
+// and the modules of a program (ThinLTO, the incremental database, tier 1 of the JIT) share its state.
+bool Generator::createRuntimeFunction(FunctionType functionType, const std::string& name, Function& result) {
+	result = llvm::Function::Create(functionType, llvm::Function::LinkOnceODRLinkage, name, module_);
+	if (result == nullptr) {
+		debugLog(__LINE__);
+		return true;
+	}
+
+	result->setDoesNotThrow();
+	result->addFnAttr("target-cpu", targetCpu_);
+	if (!targetFeatures_.empty()) {
+		result->addFnAttr("target-features", targetFeatures_);
+	}
+
+	return false;
+}
+
+llvm::GlobalVariable* Generator::createRuntimeVariable(Type type, const std::string& name) {
+	auto result = new llvm::GlobalVariable(module_, type, false, llvm::GlobalValue::LinkOnceODRLinkage, llvm::Constant::getNullValue(type), name);
+
+	// per thread, so the allocator takes no lock
+	result->setThreadLocal(true);
+
+	return result;
+}
+
+bool Generator::createReferenceCountingFunctions() {
+	// the reference count is the first member of every object (see kReferenceCountMemberIndex),
+	// and the size of the object is given to .release to return it to its size class
+	std::vector<Type> retainArgs = { llvm::Type::getInt8PtrTy(context_) };
+	std::vector<Type> releaseArgs = { llvm::Type::getInt8PtrTy(context_), getSizeType() };
+	if (createRuntimeFunction(llvm::FunctionType::get(llvm::Type::getVoidTy(context_), retainArgs, false), ".retain", fRetain_) ||
+		createRuntimeFunction(llvm::FunctionType::get(llvm::Type::getVoidTy(context_), releaseArgs, false), ".release", fRelease_))
+	{
+		debugLog(__LINE__);
+		return true;
+	}
+
+	// a reference held in a struct or an array is null until it is assigned
+	{
+		auto entryBlock = llvm::BasicBlock::Create(context_, "", fRetain_);
+		auto retainBlock = llvm::BasicBlock::Create(context_, "", fRetain_);
+		auto returnBlock = llvm::BasicBlock::Create(context_, "", fRetain_);
+
+		llvm::IRBuilder<> builder(entryBlock);
+		builder.CreateCondBr(builder.CreateIsNull(fRetain_->getArg(0)), returnBlock, retainBlock);
+
+		builder.SetInsertPoint(retainBlock);
+		auto referenceCount = builder.CreateBitCast(fRetain_->getArg(0), llvm::PointerType::get(getReferenceCountType(), 0));
+		auto count = builder.CreateLoad(getReferenceCountType(), referenceCount);
+		builder.CreateStore(builder.CreateAdd(count, llvm::ConstantInt::get(getReferenceCountType(), 1)), referenceCount);
+		builder.CreateRetVoid();
+
+		builder.SetInsertPoint(returnBlock);
+		builder.CreateRetVoid();
+	}
+
+	return createReleaseFunctionBody(fRelease_, nullptr);
+}
+
+// Decrements the reference count of the object given as the first argument, if it is not null,
+// and frees the object when it is the last reference. The references held by the members of the object
+// are released before it is freed, by membersFunction.
+bool Generator::createReleaseFunctionBody(Function function, Function membersFunction) {
+	auto entryBlock = llvm::BasicBlock::Create(context_, "", function);
+	auto releaseBlock = llvm::BasicBlock::Create(context_, "", function);
+	auto freeBlock = llvm::BasicBlock::Create(context_, "", function);
+	auto returnBlock = llvm::BasicBlock::Create(context_, "", function);
+
+	llvm::IRBuilder<> builder(entryBlock);
+	auto object = function->getArg(0);
+	builder.CreateCondBr(builder.CreateIsNull(object), returnBlock, releaseBlock);
+
+	builder.SetInsertPoint(releaseBlock);
+	auto referenceCount = builder.CreateBitCast(object, llvm::PointerType::get(getReferenceCountType(), 0));
+	auto count = builder.CreateSub(builder.CreateLoad(getReferenceCountType(), referenceCount), llvm::ConstantInt::get(getReferenceCountType(), 1));
+	builder.CreateStore(count, referenceCount);
+	builder.CreateCondBr(builder.CreateICmpEQ(count, llvm::ConstantInt::get(getReferenceCountType(), 0)), freeBlock, returnBlock);
+
+	builder.SetInsertPoint(freeBlock);
+	Value size;
+	if (membersFunction != nullptr) {
+		auto objectType = membersFunction->getArg(0)->getType();
+		builder.CreateCall(membersFunction, { builder.CreateBitCast(object, objectType) });
+		size = llvm::ConstantInt::get(getSizeType(), getReferencedObjectSize(objectType));
+	}
+	else {
+		size = function->getArg(1);
+	}
+	builder.CreateCall(fDeallocate_, { object, size });
+	builder.CreateRetVoid();
+
+	builder.SetInsertPoint(returnBlock);
+	builder.CreateRetVoid();
+
 	return false;
 }
 
@@ -113,6 +263,131 @@ bool Generator::writeObjectFile(const std::string& outputPath) {
 	return false;
 }
 
+bool Generator::writeBitcode(llvm::SmallVectorImpl<char>& buffer) const {
+	llvm::raw_svector_ostream stream(buffer);
+	llvm::WriteBitcodeToFile(module_, stream);
+
+	return false;
+}
+
+bool Generator::writeBitcodeFile(const std::string& outputPath, bool withSummary) {
+	std::error_code errorCode;
+	llvm::raw_fd_ostream stream(outputPath, errorCode);
+	if (errorCode) {
+		debugLog(__LINE__);
+		return true;
+	}
+
+	if (withSummary) {
+		// the summary index is what the ThinLTO link step uses to decide imports
+		llvm::legacy::PassManager passManager;
+		passManager.add(llvm::createWriteThinLTOBitcodePass(stream));
+		passManager.run(module_);
+	}
+	else {
+		llvm::WriteBitcodeToFile(module_, stream);
+	}
+	stream.flush();
+
+	return false;
+}
+
+bool Generator::writeFunctionBitcode(const std::string& name, llvm::SmallVectorImpl<char>& buffer) const {
+	auto f = module_.getFunction(name);
+	if (!f || f->isDeclaration()) {
+		debugLog(__LINE__);
+		return true;
+	}
+
+	// everything else becomes a declaration, except globals that cannot be referred to from another module,
+	// and the runtime, which may have been inlined into the function and dropped from the module it is linked to
+	llvm::ValueToValueMapTy valueMap;
+	auto module = llvm::CloneModule(module_, valueMap, [f](const llvm::GlobalValue* value) {
+		if ((value == f) || isRuntime(*value)) {
+			return true;
+		}
+		auto variable = llvm::dyn_cast<llvm::GlobalVariable>(value);
+		return variable && (variable->hasLocalLinkage() || variable->hasCommonLinkage() || !variable->hasName());
+	});
+
+	llvm::legacy::PassManager passManager;
+	passManager.add(llvm::createGlobalDCEPass());
+	passManager.run(*module);
+
+	llvm::raw_svector_ostream stream(buffer);
+	llvm::WriteBitcodeToFile(*module, stream);
+
+	return false;
+}
+
+bool Generator::linkBitcodeFile(const std::string& bitcodePath) {
+	llvm::SMDiagnostic diagnostic;
+	auto module = llvm::parseIRFile(bitcodePath, diagnostic, context_);
+	if (!module) {
+		debugLog(__LINE__);
+		return true;
+	}
+
+	if (llvm::Linker::linkModules(module_, std::move(module))) {
+		debugLog(__LINE__);
+		return true;
+	}
+
+	return false;
+}
+
+bool Generator::optimize(unsigned int optimizationLevel, bool prepareForThinLto) {
+	return optimizeModule(module_, targetMachine_, optimizationLevel, prepareForThinLto, profileGeneratePath_, profileUsePath_);
+}
+
+bool Generator::optimizeModule(llvm::Module& module, llvm::TargetMachine* targetMachine, unsigned int optimizationLevel, bool prepareForThinLto,
+	const std::string& profileGeneratePath, const std::string& profileUsePath)
+{
+	// the PGO pass reports an unreadable profile through the LLVMContext, which terminates the process
+	if (!profileUsePath.empty()) {
+		auto reader = llvm::IndexedInstrProfReader::create(profileUsePath);
+		if (!reader) {
+			llvm::consumeError(reader.takeError());
+			debugLog(__LINE__);
+			return true;
+		}
+	}
+
+	llvm::PassManagerBuilder builder;
+	builder.OptLevel = optimizationLevel;
+	builder.PrepareForThinLTO = prepareForThinLto;
+	// counters are placed on the CFG before inlining, so the profile is keyed by the unoptimized function
+	builder.EnablePGOInstrGen = !profileGeneratePath.empty();
+	builder.PGOInstrGen = profileGeneratePath;
+	builder.PGOInstrUse = profileUsePath;
+	builder.SizeLevel = 0;
+	// -O0 still inlines alwaysinline functions and call sites, as clang does
+	builder.Inliner = (optimizationLevel == 0) ? llvm::createAlwaysInlinerLegacyPass() : llvm::createFunctionInliningPass(optimizationLevel, 0, false);
+	builder.LoopVectorize = optimizationLevel > 1;
+	builder.SLPVectorize = optimizationLevel > 1;
+	if (targetMachine) {
+		targetMachine->adjustPassManager(builder);
+	}
+
+	llvm::legacy::FunctionPassManager functionPassManager(&module);
+	llvm::legacy::PassManager modulePassManager;
+	if (targetMachine) {
+		functionPassManager.add(llvm::createTargetTransformInfoWrapperPass(targetMachine->getTargetIRAnalysis()));
+		modulePassManager.add(llvm::createTargetTransformInfoWrapperPass(targetMachine->getTargetIRAnalysis()));
+	}
+	builder.populateFunctionPassManager(functionPassManager);
+	builder.populateModulePassManager(modulePassManager);
+
+	functionPassManager.doInitialization();
+	for (auto& function : module) {
+		functionPassManager.run(function);
+	}
+	functionPassManager.doFinalization();
+	modulePassManager.run(module);
+
+	return false;
+}
+
 Generator::Type Generator::getSizeType() {
 	if (sizeof(size_t) == 4) {
 		return llvm::Type::getInt32Ty(context_);
@@ -121,9 +396,23 @@ Generator::Type Generator::getSizeType() {
 }
 
 Generator::Type Generator::getTypeIdType() {
+	if (isCompactObjects_) {
+		return llvm::Type::getInt16Ty(context_);
+	}
 	return llvm::Type::getInt32Ty(context_);
 }
 
+Generator::Type Generator::getReferenceCountType() {
+	if (isCompactObjects_) {
+		return llvm::Type::getInt32Ty(context_);
+	}
+	return getSizeType();
+}
+
+Generator::Constant Generator::getPinnedReferenceCount() {
+	return llvm::ConstantInt::get(getReferenceCountType(), isCompactObjects_ ? kCompactPinnedReferenceCount : kPinnedReferenceCount);
+}
+
 Generator::Value Generator::getArgument(size_t index) {
 	auto block = builder_.GetInsertBlock();
 	if (block == nullptr) {
@@ -180,6 +469,54 @@ bool Generator::createType(const ValueType& type, Type& result) {
 	return false;
 }
 
+// a struct, or pointers to or arrays of it; a reference to a struct refers to an object with the layout of the struct
+bool Generator::createStructValueType(StructType structType, const ValueType& type, Type& result) {
+	result = structType;
+	if (type.isReference) {
+		result = llvm::PointerType::get(result, 0);
+	}
+	for (size_t i = 0; i < type.pointerCount; ++i) {
+		result = llvm::PointerType::get(result, 0);
+	}
+	for (auto& arraySize : type.arraySizes) {
+		if (arraySize == 0) {
+			debugLog(__LINE__);
+			return true;
+		}
+		result = llvm::ArrayType::get(result, arraySize);
+	}
+	return false;
+}
+
+// the innermost array of structs as a struct of arrays, one column per member
+bool Generator::createSoaType(const std::vector<Type>& memberTypes, const ValueType& type, Type& result) {
+	if (type.arraySizes.empty() || (type.arraySizes[0] == 0)) {
+		debugLog(__LINE__);
+		return true;
+	}
+
+	std::vector<llvm::Type*> columns;
+	for (auto memberType : memberTypes) {
+		columns.push_back(llvm::ArrayType::get(memberType, type.arraySizes[0]));
+	}
+	result = llvm::StructType::get(context_, columns);
+
+	for (size_t i = 1; i < type.arraySizes.size(); ++i) {
+		if (type.arraySizes[i] == 0) {
+			debugLog(__LINE__);
+			return true;
+		}
+		result = llvm::ArrayType::get(result, type.arraySizes[i]);
+	}
+	return false;
+}
+
+// the pointer to the first element and the number of elements, passed in two registers
+bool Generator::createSliceType(Type elementType, Type& result) {
+	result = llvm::StructType::get(context_, { llvm::PointerType::get(elementType, 0), llvm::Type::getInt64Ty(context_) });
+	return result == nullptr;
+}
+
 bool Generator::getType(Token::Type type, Generator::Type& result) {
 	switch (type) {
 	case Token::Type::TYPE_VOID:
@@ -235,29 +572,88 @@ bool Generator::createStructType(const std::string& name, StructType& result) {
 	return result == nullptr;
 }
 
-bool Generator::createStructMember(const std::vector<Type>& typeList, StructType dest) {
-	std::vector<llvm::Type*> members;
+bool Generator::createFunctionType(Type returnType, const std::vector<Type>& argumentTypes, bool hasVariableArguments, FunctionType& result) {
+	result = llvm::FunctionType::get(returnType, argumentTypes, hasVariableArguments);
+	return result == nullptr;
+}
+
+bool Generator::createFunctionDeclare(Generator::FunctionType functionType, const std::string& name, Generator::Function& result) {
+	result = llvm::Function::Create(functionType, llvm::Function::ExternalLinkage, name, module_);
+	if (result == nullptr) {
+		debugLog(__LINE__);
+		return true;
+	}
+
+	result->addFnAttr("target-cpu", targetCpu_);
+	if (!targetFeatures_.empty()) {
+		result->addFnAttr("target-features", targetFeatures_);
+	}
+
+	return false;
+}
+
+bool Generator::setInlining(Function function, Inlining inlining) {
+	switch (inlining) {
+	case Inlining::HINT:
+		function->addFnAttr(llvm::Attribute::InlineHint);
+		break;
+	case Inlining::ALWAYS:
+		function->addFnAttr(llvm::Attribute::AlwaysInline);
+		break;
+	case Inlining::NEVER:
+		function->addFnAttr(llvm::Attribute::NoInline);
+		break;
+	default:
+		break;
+	}
 
-	members.push_back(getSizeType());
-	members.push_back(getTypeIdType());
+	return false;
+}
 
-	for (auto type : typeList) {
-		members.push_back(type);
+bool Generator::setMemoryEffect(Function function, MemoryEffect memoryEffect) {
+	switch (memoryEffect) {
+	case MemoryEffect::READ_ONLY:
+		function->setOnlyReadsMemory();
+		break;
+	case MemoryEffect::NONE:
+		function->setDoesNotAccessMemory();
+		break;
+	default:
+		break;
 	}
 
-	dest->setBody(members, false);
+	return false;
+}
 
+bool Generator::setNoUnwind(Function function) {
+	function->setDoesNotThrow();
 	return false;
 }
 
-bool Generator::createFunctionType(Type returnType, const std::vector<Type>& argumentTypes, bool hasVariableArguments, FunctionType& result) {
-	result = llvm::FunctionType::get(returnType, argumentTypes, hasVariableArguments);
-	return result == nullptr;
+bool Generator::setReferenceArgument(Function function, unsigned int index) {
+	auto type = function->getFunctionType()->getParamType(index);
+	function->addParamAttr(index, llvm::Attribute::NonNull);
+	if (!isUnboxedReference(type)) {
+		function->addDereferenceableParamAttr(index, getReferencedObjectSize(type));
+	}
+	return false;
 }
 
-bool Generator::createFunctionDeclare(Generator::FunctionType functionType, const std::string& name, Generator::Function& result) {
-	result = llvm::Function::Create(functionType, llvm::Function::ExternalLinkage, name, module_);
-	return result == nullptr;
+bool Generator::setReferenceReturn(Function function) {
+	auto type = function->getReturnType();
+	function->addRetAttr(llvm::Attribute::NonNull);
+	if (!isUnboxedReference(type)) {
+		function->addRetAttr(llvm::Attribute::getWithDereferenceableBytes(context_, getReferencedObjectSize(type)));
+	}
+	return false;
+}
+
+uint64_t Generator::getAlignment(Type type) {
+	return module_.getDataLayout().getABITypeAlign(type).value();
+}
+
+uint64_t Generator::getReferencedObjectSize(Type type) {
+	return module_.getDataLayout().getTypeAllocSize(type->getPointerElementType());
 }
 
 bool Generator::createBasicBlock(const Function& function, const BasicBlock& insertBefore, BasicBlock& result) {
@@ -278,6 +674,10 @@ bool Generator::createGoto(const BasicBlock& dest) {
 	return builder_.CreateBr(dest) == nullptr;
 }
 
+bool Generator::createUnreachable() {
+	return builder_.CreateUnreachable() == nullptr;
+}
+
 bool Generator::createReturnVoid() {
 	return (builder_.CreateRetVoid()) == nullptr;
 }
@@ -429,16 +829,30 @@ bool Generator::createCommpareNotEqual(Token::Type valueType, Value lhs, Value r
 	return result == nullptr;
 }
 
-bool Generator::createLogicalOr(Token::Type valueType, Value lhs, Value rhs, Value& result) {
-	// TODO
-	debugLog(__LINE__);
-	return true;;
+// both operands are evaluated; short-circuit evaluation is lowered by the caller with createIf() and createPhi()
+bool Generator::createLogicalOr(Value lhs, Value rhs, Value& result) {
+	result = builder_.CreateOr(lhs, rhs);
+	return result == nullptr;
+}
+
+bool Generator::createLogicalAnd(Value lhs, Value rhs, Value& result) {
+	result = builder_.CreateAnd(lhs, rhs);
+	return result == nullptr;
 }
 
-bool Generator::createLogicalAnd(Token::Type valueType, Value lhs, Value rhs, Value& result) {
-	// TODO
-	debugLog(__LINE__);
-	return true;;
+bool Generator::createPhi(const std::vector<std::pair<Value, BasicBlock>>& incomings, Value& result) {
+	if (incomings.empty()) {
+		debugLog(__LINE__);
+		return true;
+	}
+
+	auto phi = builder_.CreatePHI(incomings.front().first->getType(), static_cast<unsigned int>(incomings.size()));
+	for (auto& incoming : incomings) {
+		phi->addIncoming(incoming.first, incoming.second);
+	}
+	result = phi;
+
+	return false;
 }
 
 bool Generator::createBooleanConstant(bool b, Constant& result) {
@@ -507,7 +921,14 @@ bool Generator::createDoubleConstant(double value, Constant& result) {
 }
 
 bool Generator::createStringConstant(const std::string& str, Constant& result) {
-	result = builder_.CreateGlobalStringPtr(str);
+	Value global;
+	if (createGlobalConstant(llvm::ConstantDataArray::getString(context_, str), global)) {
+		debugLog(__LINE__);
+		return true;
+	}
+	auto zero = llvm::ConstantInt::get(llvm::Type::getInt32Ty(context_), 0);
+	Constant indices[] = { zero, zero };
+	result = llvm::ConstantExpr::getInBoundsGetElementPtr(global->getType()->getPointerElementType(), llvm::cast<llvm::Constant>(global), indices);
 	return result == nullptr;
 }
 
@@ -604,19 +1025,54 @@ bool Generator::createTruncOrExt(Value& srcValue, Type destType, Value& result)
 }
 
 bool Generator::createCall(Function f, const std::vector<Value>& values, Value& result) {
-	result = builder_.CreateCall(f, values);
-	return result == nullptr;
+	auto stub = tierStubs_.find(f);
+	if (stub != tierStubs_.end()) {
+		// the JIT swaps the stub to the optimized code concurrently
+		auto load = builder_.CreateLoad(stub->second->getValueType(), stub->second);
+		if (load == nullptr) {
+			debugLog(__LINE__);
+			return true;
+		}
+		load->setAtomic(llvm::AtomicOrdering::Monotonic);
+
+		result = builder_.CreateCall(f->getFunctionType(), load, values);
+		return result == nullptr;
+	}
+
+	auto call = builder_.CreateCall(f, values);
+	if (call == nullptr) {
+		debugLog(__LINE__);
+		return true;
+	}
+	if (isFlatten_ && !f->hasFnAttribute(llvm::Attribute::NoInline)) {
+		call->addFnAttr(llvm::Attribute::AlwaysInline);
+	}
+
+	result = call;
+	return false;
 }
 
 bool Generator::createCallMalloc(Type type, Value& result) {
+	// type is the reference type, and the object it refers to is allocated
 	Value size;
-	if (createSizeOf(type, size)) {
+	if (createSizeOf(type->getPointerElementType(), size)) {
 		debugLog(__LINE__);
 		return true;
 	}
 
+	// an object holding references releases them when its count drops to zero, which a pinned count in a region never does
+	if (containsReference(type->getPointerElementType(), false)) {
+		std::vector<Value> values = { size };
+		if (createCall(fAllocate_, values, result)) {
+			debugLog(__LINE__);
+			return true;
+		}
+		auto referenceCount = builder_.CreateBitCast(result, llvm::PointerType::get(getReferenceCountType(), 0));
+		return builder_.CreateStore(llvm::ConstantInt::get(getReferenceCountType(), 1), referenceCount) == nullptr;
+	}
+
 	std::vector<Value> values = { size };
-	if (createCall(fMalloc_, values, result)) {
+	if (createCall(fNew_, values, result)) {
 		debugLog(__LINE__);
 		return true;
 	}
@@ -624,59 +1080,835 @@ bool Generator::createCallMalloc(Type type, Value& result) {
 	return false;
 }
 
-bool Generator::createAlloc(Type type, Value& result) {
-	auto f = builder_.GetInsertBlock()->getParent();
-	auto& entryBlock = f->getEntryBlock();
-	llvm::IRBuilder<> tempBuilder(&entryBlock, entryBlock.begin());
-	result = tempBuilder.CreateAlloca(type);
-	return result == nullptr;
-}
-
-bool Generator::createStore(Value value, Value destPtr) {
-	if (value == nullptr) {
-		value = llvm::Constant::getNullValue(destPtr->getType()->getPointerElementType());
-	}
-	return builder_.CreateStore(value, destPtr) == nullptr;
-}
-
-bool Generator::createLoad(Value srcPtr, Value& resultValue) {
-	resultValue = builder_.CreateLoad(srcPtr);
-	return resultValue == nullptr;
-}
-
-bool Generator::createInitializeObject(Value object, Value initializer) {
-	static const std::vector<Value> referenceCountIndex = {
-		llvm::ConstantInt::get(llvm::Type::getInt32Ty(context_), 0),
-		llvm::ConstantInt::get(llvm::Type::getInt32Ty(context_), kReferenceCountMemberIndex),
-	};
-
-	auto referenceCount = builder_.CreateGEP(object, referenceCountIndex);
-	if (referenceCount == nullptr) {
+bool Generator::createAllocatorFunctions() {
+	auto i8PtrType = llvm::Type::getInt8PtrTy(context_);
+	if (createFunctionDeclare(llvm::FunctionType::get(llvm::Type::getVoidTy(context_), { i8PtrType }, false), "free", fFree_)) {
 		debugLog(__LINE__);
 		return true;
 	}
+	fFree_->setDoesNotThrow();
 
-	if (builder_.CreateStore(llvm::ConstantInt::get(getSizeType(), 1), referenceCount) == nullptr) {
+	if (createRuntimeFunction(llvm::FunctionType::get(i8PtrType, { getSizeType() }, false), ".allocate", fAllocate_) ||
+		createRuntimeFunction(llvm::FunctionType::get(llvm::Type::getVoidTy(context_), { i8PtrType, getSizeType() }, false), ".deallocate", fDeallocate_))
+	{
 		debugLog(__LINE__);
 		return true;
 	}
+	fAllocate_->setReturnDoesNotAlias();
 
-	static const std::vector<Value> entityIndex = {
-		llvm::ConstantInt::get(llvm::Type::getInt32Ty(context_), 0),
-		llvm::ConstantInt::get(llvm::Type::getInt32Ty(context_), kStructEntityMemberIndex),
-	};
-
-	auto entity = builder_.CreateGEP(object, entityIndex);
-	if (entity == nullptr) {
-		debugLog(__LINE__);
+	llvm::GlobalVariable* allocations = nullptr;
+	llvm::GlobalVariable* deallocations = nullptr;
+	llvm::GlobalVariable* slabs = nullptr;
+	if (isHeapStatistics_) {
+		if (createHeapStatistics(allocations, deallocations, slabs)) {
+			debugLog(__LINE__);
+			return true;
+		}
+	}
+	auto increment = [this](llvm::IRBuilder<>& builder, llvm::GlobalVariable* counter) {
+		if (counter != nullptr) {
+			auto count = builder.CreateLoad(getSizeType(), counter);
+			builder.CreateStore(builder.CreateAdd(count, llvm::ConstantInt::get(getSizeType(), 1)), counter);
+		}
+	};
+
+	if (allocator_ == Allocator::MALLOC) {
+		llvm::IRBuilder<> allocateBuilder(llvm::BasicBlock::Create(context_, "", fAllocate_));
+		increment(allocateBuilder, allocations);
+		allocateBuilder.CreateRet(allocateBuilder.CreateCall(fMalloc_, { fAllocate_->getArg(0) }));
+
+		llvm::IRBuilder<> deallocateBuilder(llvm::BasicBlock::Create(context_, "", fDeallocate_));
+		increment(deallocateBuilder, deallocations);
+		deallocateBuilder.CreateCall(fFree_, { fDeallocate_->getArg(0) });
+		deallocateBuilder.CreateRetVoid();
+		return false;
+	}
+
+	// the head of the free list, the unused part of the current slab and its end, per size class;
+	// a free block holds the next block of the list in its first bytes
+	auto sizeClassCount = kMaxPooledObjectSize / kSizeClassGranularity + 1;
+	auto freeLists = createRuntimeVariable(llvm::ArrayType::get(i8PtrType, sizeClassCount), ".heap.freelists");
+	auto slabCursors = createRuntimeVariable(llvm::ArrayType::get(i8PtrType, sizeClassCount), ".heap.slabcursors");
+	auto slabEnds = createRuntimeVariable(llvm::ArrayType::get(i8PtrType, sizeClassCount), ".heap.slabends");
+
+	auto getSizeClass = [this](llvm::IRBuilder<>& builder, Value size) {
+		auto granularity = llvm::ConstantInt::get(getSizeType(), kSizeClassGranularity);
+		return builder.CreateUDiv(builder.CreateAdd(size, llvm::ConstantInt::get(getSizeType(), kSizeClassGranularity - 1)), granularity);
+	};
+	auto getElement = [this](llvm::IRBuilder<>& builder, llvm::GlobalVariable* array, Value index) {
+		return builder.CreateInBoundsGEP(array->getValueType(), array, { llvm::ConstantInt::get(getSizeType(), 0), index });
+	};
+	auto getNextBlock = [this, i8PtrType](llvm::IRBuilder<>& builder, Value block) {
+		return builder.CreateBitCast(block, llvm::PointerType::get(i8PtrType, 0));
+	};
+
+	{
+		auto size = fAllocate_->getArg(0);
+		auto entryBlock = llvm::BasicBlock::Create(context_, "", fAllocate_);
+		auto largeBlock = llvm::BasicBlock::Create(context_, "", fAllocate_);
+		auto smallBlock = llvm::BasicBlock::Create(context_, "", fAllocate_);
+		auto popBlock = llvm::BasicBlock::Create(context_, "", fAllocate_);
+		auto refillBlock = llvm::BasicBlock::Create(context_, "", fAllocate_);
+		auto bumpBlock = llvm::BasicBlock::Create(context_, "", fAllocate_);
+		auto slabBlock = llvm::BasicBlock::Create(context_, "", fAllocate_);
+
+		llvm::IRBuilder<> builder(entryBlock);
+		increment(builder, allocations);
+		builder.CreateCondBr(builder.CreateICmpULE(size, llvm::ConstantInt::get(getSizeType(), kMaxPooledObjectSize)), smallBlock, largeBlock);
+
+		builder.SetInsertPoint(largeBlock);
+		builder.CreateRet(builder.CreateCall(fMalloc_, { size }));
+
+		builder.SetInsertPoint(smallBlock);
+		auto sizeClass = getSizeClass(builder, size);
+		auto freeList = getElement(builder, freeLists, sizeClass);
+		auto head = builder.CreateLoad(i8PtrType, freeList);
+		builder.CreateCondBr(builder.CreateIsNull(head), refillBlock, popBlock);
+
+		builder.SetInsertPoint(popBlock);
+		builder.CreateStore(builder.CreateLoad(i8PtrType, getNextBlock(builder, head)), freeList);
+		builder.CreateRet(head);
+
+		// blocks are cut from the slab one at a time, so a new slab costs a single malloc
+		builder.SetInsertPoint(refillBlock);
+		auto blockSize = builder.CreateMul(sizeClass, llvm::ConstantInt::get(getSizeType(), kSizeClassGranularity));
+		auto slabCursor = getElement(builder, slabCursors, sizeClass);
+		auto slabEnd = getElement(builder, slabEnds, sizeClass);
+		auto cursor = builder.CreateLoad(i8PtrType, slabCursor);
+		auto remaining = builder.CreateSub(builder.CreatePtrToInt(builder.CreateLoad(i8PtrType, slabEnd), getSizeType()), builder.CreatePtrToInt(cursor, getSizeType()));
+		builder.CreateCondBr(builder.CreateICmpULE(blockSize, remaining), bumpBlock, slabBlock);
+
+		builder.SetInsertPoint(bumpBlock);
+		builder.CreateStore(builder.CreateGEP(builder.getInt8Ty(), cursor, blockSize), slabCursor);
+		builder.CreateRet(cursor);
+
+		// the rest of the previous slab is left unused
+		builder.SetInsertPoint(slabBlock);
+		increment(builder, slabs);
+		auto slab = builder.CreateCall(fMalloc_, { llvm::ConstantInt::get(getSizeType(), kSlabSize) });
+		builder.CreateStore(builder.CreateGEP(builder.getInt8Ty(), slab, blockSize), slabCursor);
+		builder.CreateStore(builder.CreateGEP(builder.getInt8Ty(), slab, llvm::ConstantInt::get(getSizeType(), kSlabSize)), slabEnd);
+		builder.CreateRet(slab);
+	}
+
+	{
+		auto block = fDeallocate_->getArg(0);
+		auto size = fDeallocate_->getArg(1);
+		auto entryBlock = llvm::BasicBlock::Create(context_, "", fDeallocate_);
+		auto largeBlock = llvm::BasicBlock::Create(context_, "", fDeallocate_);
+		auto smallBlock = llvm::BasicBlock::Create(context_, "", fDeallocate_);
+
+		llvm::IRBuilder<> builder(entryBlock);
+		increment(builder, deallocations);
+		builder.CreateCondBr(builder.CreateICmpULE(size, llvm::ConstantInt::get(getSizeType(), kMaxPooledObjectSize)), smallBlock, largeBlock);
+
+		builder.SetInsertPoint(largeBlock);
+		builder.CreateCall(fFree_, { block });
+		builder.CreateRetVoid();
+
+		// slabs are never given back to malloc
+		builder.SetInsertPoint(smallBlock);
+		auto freeList = getElement(builder, freeLists, getSizeClass(builder, size));
+		builder.CreateStore(builder.CreateLoad(i8PtrType, freeList), getNextBlock(builder, block));
+		builder.CreateStore(block, freeList);
+		builder.CreateRetVoid();
+	}
+
+	return false;
+}
+
+bool Generator::createRegionFunctions() {
+	// the unused part of the current chunk, the chunks linked through their first bytes, and the region entered before
+	auto i8PtrType = llvm::Type::getInt8PtrTy(context_);
+	regionType_ = llvm::StructType::create(context_, { i8PtrType, i8PtrType, i8PtrType, i8PtrType }, ".region");
+	auto regionPtrType = llvm::PointerType::get(regionType_, 0);
+	const unsigned int cursorIndex = 0;
+	const unsigned int endIndex = 1;
+	const unsigned int chunksIndex = 2;
+	const unsigned int previousIndex = 3;
+
+	// the innermost region of the thread, which new allocates from even in the functions called in the region
+	auto currentRegion = createRuntimeVariable(regionPtrType, ".region.current");
+
+	if (createRuntimeFunction(llvm::FunctionType::get(i8PtrType, { regionPtrType, getSizeType() }, false), ".region.allocate", fAllocateInRegion_) ||
+		createRuntimeFunction(llvm::FunctionType::get(llvm::Type::getVoidTy(context_), { regionPtrType }, false), ".region.enter", fEnterRegion_) ||
+		createRuntimeFunction(llvm::FunctionType::get(llvm::Type::getVoidTy(context_), { regionPtrType }, false), ".region.exit", fExitRegion_) ||
+		createRuntimeFunction(llvm::FunctionType::get(i8PtrType, { getSizeType() }, false), ".new", fNew_))
+	{
+		debugLog(__LINE__);
+		return true;
+	}
+	fAllocateInRegion_->setReturnDoesNotAlias();
+	fNew_->setReturnDoesNotAlias();
+
+	auto getChunkLink = [this, i8PtrType](llvm::IRBuilder<>& builder, Value chunk) {
+		return builder.CreateBitCast(chunk, llvm::PointerType::get(i8PtrType, 0));
+	};
+
+	{
+		auto region = fEnterRegion_->getArg(0);
+		llvm::IRBuilder<> builder(llvm::BasicBlock::Create(context_, "", fEnterRegion_));
+		builder.CreateStore(llvm::ConstantPointerNull::get(i8PtrType), builder.CreateStructGEP(regionType_, region, cursorIndex));
+		builder.CreateStore(llvm::ConstantPointerNull::get(i8PtrType), builder.CreateStructGEP(regionType_, region, endIndex));
+		builder.CreateStore(llvm::ConstantPointerNull::get(i8PtrType), builder.CreateStructGEP(regionType_, region, chunksIndex));
+		auto previous = builder.CreateBitCast(builder.CreateLoad(regionPtrType, currentRegion), i8PtrType);
+		builder.CreateStore(previous, builder.CreateStructGEP(regionType_, region, previousIndex));
+		builder.CreateStore(region, currentRegion);
+		builder.CreateRetVoid();
+	}
+
+	{
+		auto region = fExitRegion_->getArg(0);
+		auto entryBlock = llvm::BasicBlock::Create(context_, "", fExitRegion_);
+		auto loopBlock = llvm::BasicBlock::Create(context_, "", fExitRegion_);
+		auto freeBlock = llvm::BasicBlock::Create(context_, "", fExitRegion_);
+		auto exitBlock = llvm::BasicBlock::Create(context_, "", fExitRegion_);
+
+		llvm::IRBuilder<> builder(entryBlock);
+		auto firstChunk = builder.CreateLoad(i8PtrType, builder.CreateStructGEP(regionType_, region, chunksIndex));
+		builder.CreateBr(loopBlock);
+
+		builder.SetInsertPoint(loopBlock);
+		auto chunk = builder.CreatePHI(i8PtrType, 2);
+		chunk->addIncoming(firstChunk, entryBlock);
+		builder.CreateCondBr(builder.CreateIsNull(chunk), exitBlock, freeBlock);
+
+		builder.SetInsertPoint(freeBlock);
+		auto next = builder.CreateLoad(i8PtrType, getChunkLink(builder, chunk));
+		builder.CreateCall(fFree_, { chunk });
+		chunk->addIncoming(next, freeBlock);
+		builder.CreateBr(loopBlock);
+
+		builder.SetInsertPoint(exitBlock);
+		auto previous = builder.CreateLoad(i8PtrType, builder.CreateStructGEP(regionType_, region, previousIndex));
+		builder.CreateStore(builder.CreateBitCast(previous, regionPtrType), currentRegion);
+		builder.CreateRetVoid();
+	}
+
+	{
+		auto region = fAllocateInRegion_->getArg(0);
+		auto size = fAllocateInRegion_->getArg(1);
+		auto entryBlock = llvm::BasicBlock::Create(context_, "", fAllocateInRegion_);
+		auto bumpBlock = llvm::BasicBlock::Create(context_, "", fAllocateInRegion_);
+		auto chunkBlock = llvm::BasicBlock::Create(context_, "", fAllocateInRegion_);
+
+		// every object is 8 byte aligned, as the chunk link before the first one is
+		llvm::IRBuilder<> builder(entryBlock);
+		auto alignedSize = builder.CreateAnd(builder.CreateAdd(size, llvm::ConstantInt::get(getSizeType(), 7)), llvm::ConstantInt::get(getSizeType(), ~7ull));
+		auto cursorPtr = builder.CreateStructGEP(regionType_, region, cursorIndex);
+		auto endPtr = builder.CreateStructGEP(regionType_, region, endIndex);
+		auto cursor = builder.CreateLoad(i8PtrType, cursorPtr);
+		auto remaining = builder.CreateSub(builder.CreatePtrToInt(builder.CreateLoad(i8PtrType, endPtr), getSizeType()), builder.CreatePtrToInt(cursor, getSizeType()));
+		builder.CreateCondBr(builder.CreateICmpULE(alignedSize, remaining), bumpBlock, chunkBlock);
+
+		builder.SetInsertPoint(bumpBlock);
+		builder.CreateStore(builder.CreateGEP(builder.getInt8Ty(), cursor, alignedSize), cursorPtr);
+		builder.CreateRet(cursor);
+
+		// an object larger than a chunk gets a chunk of its own
+		builder.SetInsertPoint(chunkBlock);
+		auto linkSize = llvm::ConstantInt::get(getSizeType(), 8);
+		auto minimumSize = builder.CreateAdd(alignedSize, linkSize);
+		auto chunkSize = llvm::ConstantInt::get(getSizeType(), kRegionChunkSize);
+		auto allocatedSize = builder.CreateSelect(builder.CreateICmpULT(minimumSize, chunkSize), chunkSize, minimumSize);
+		auto chunk = builder.CreateCall(fMalloc_, { allocatedSize });
+		auto chunksPtr = builder.CreateStructGEP(regionType_, region, chunksIndex);
+		builder.CreateStore(builder.CreateLoad(i8PtrType, chunksPtr), getChunkLink(builder, chunk));
+		builder.CreateStore(chunk, chunksPtr);
+		auto object = builder.CreateGEP(builder.getInt8Ty(), chunk, linkSize);
+		builder.CreateStore(builder.CreateGEP(builder.getInt8Ty(), object, alignedSize), cursorPtr);
+		builder.CreateStore(builder.CreateGEP(builder.getInt8Ty(), chunk, allocatedSize), endPtr);
+		builder.CreateRet(object);
+	}
+
+	{
+		auto size = fNew_->getArg(0);
+		auto entryBlock = llvm::BasicBlock::Create(context_, "", fNew_);
+		auto heapBlock = llvm::BasicBlock::Create(context_, "", fNew_);
+		auto regionBlock = llvm::BasicBlock::Create(context_, "", fNew_);
+
+		llvm::IRBuilder<> builder(entryBlock);
+		auto region = builder.CreateLoad(regionPtrType, currentRegion);
+		builder.CreateCondBr(builder.CreateIsNull(region), heapBlock, regionBlock);
+
+		// the reference count is the first member of the object (see kReferenceCountMemberIndex)
+		builder.SetInsertPoint(heapBlock);
+		auto heapObject = builder.CreateCall(fAllocate_, { size });
+		builder.CreateStore(llvm::ConstantInt::get(getReferenceCountType(), 1), builder.CreateBitCast(heapObject, llvm::PointerType::get(getReferenceCountType(), 0)));
+		builder.CreateRet(heapObject);
+
+		builder.SetInsertPoint(regionBlock);
+		auto regionObject = builder.CreateCall(fAllocateInRegion_, { region, size });
+		builder.CreateStore(getPinnedReferenceCount(), builder.CreateBitCast(regionObject, llvm::PointerType::get(getReferenceCountType(), 0)));
+		builder.CreateRet(regionObject);
+	}
+
+	return false;
+}
+
+// reports the index and aborts, see createBoundsCheck()
+bool Generator::createBoundsFailFunction() {
+	auto i32Type = llvm::Type::getInt32Ty(context_);
+	auto i64Type = llvm::Type::getInt64Ty(context_);
+	auto voidType = llvm::Type::getVoidTy(context_);
+	if (createRuntimeFunction(llvm::FunctionType::get(voidType, { i64Type, i64Type }, false), ".bounds.fail", fBoundsFail_)) {
+		debugLog(__LINE__);
+		return true;
+	}
+	fBoundsFail_->setDoesNotReturn();
+	fBoundsFail_->addFnAttr(llvm::Attribute::Cold);
+	fBoundsFail_->addFnAttr(llvm::Attribute::NoInline);
+
+	// created on the first check, after the declarations of the program which may name them too
+	auto fDprintf = module_.getOrInsertFunction("dprintf", llvm::FunctionType::get(i32Type, { i32Type, llvm::Type::getInt8PtrTy(context_) }, true));
+	auto fFflush = module_.getOrInsertFunction("fflush", llvm::FunctionType::get(i32Type, { llvm::Type::getInt8PtrTy(context_) }, false));
+	auto fAbort = module_.getOrInsertFunction("abort", llvm::FunctionType::get(voidType, false));
+
+	llvm::IRBuilder<> builder(llvm::BasicBlock::Create(context_, "", fBoundsFail_));
+	auto format = builder.CreateGlobalStringPtr("index %lld out of bounds for length %lld\n", ".bounds.format", 0, &module_);
+	builder.CreateCall(fDprintf, { llvm::ConstantInt::get(i32Type, 2), format, fBoundsFail_->getArg(0), fBoundsFail_->getArg(1) });
+	// the output written so far, as abort() does not flush it
+	builder.CreateCall(fFflush, { llvm::ConstantPointerNull::get(llvm::Type::getInt8PtrTy(context_)) });
+	builder.CreateCall(fAbort, {});
+	builder.CreateUnreachable();
+
+	return false;
+}
+
+bool Generator::createHeapStatistics(llvm::GlobalVariable*& allocations, llvm::GlobalVariable*& deallocations, llvm::GlobalVariable*& slabs) {
+	allocations = createRuntimeVariable(getSizeType(), ".heap.allocations");
+	deallocations = createRuntimeVariable(getSizeType(), ".heap.deallocations");
+	slabs = createRuntimeVariable(getSizeType(), ".heap.slabs");
+
+	// dprintf instead of fprintf, as stderr is a variable of the C library
+	Function fDprintf;
+	if (createFunctionDeclare(llvm::FunctionType::get(llvm::Type::getInt32Ty(context_), { llvm::Type::getInt32Ty(context_), llvm::Type::getInt8PtrTy(context_) }, true), "dprintf", fDprintf)) {
+		debugLog(__LINE__);
+		return true;
+	}
+
+	Function report;
+	if (createRuntimeFunction(llvm::FunctionType::get(llvm::Type::getVoidTy(context_), false), ".heap.report", report)) {
+		debugLog(__LINE__);
+		return true;
+	}
+
+	llvm::IRBuilder<> builder(llvm::BasicBlock::Create(context_, "", report));
+	auto format = builder.CreateGlobalStringPtr("heap: %zu allocations, %zu deallocations, %zu slabs\n", ".heap.format", 0, &module_);
+	builder.CreateCall(fDprintf, {
+		llvm::ConstantInt::get(llvm::Type::getInt32Ty(context_), 2),
+		format,
+		builder.CreateLoad(getSizeType(), allocations),
+		builder.CreateLoad(getSizeType(), deallocations),
+		builder.CreateLoad(getSizeType(), slabs),
+	});
+	builder.CreateRetVoid();
+
+	// the report of each module is the same one, so it runs once, with the copy of the report the linker keeps
+	llvm::Constant* reportKey = nullptr;
+	if (llvm::Triple(module_.getTargetTriple()).supportsCOMDAT()) {
+		report->setComdat(module_.getOrInsertComdat(report->getName()));
+		reportKey = report;
+	}
+	llvm::appendToGlobalDtors(module_, report, 0, reportKey);
+
+	return false;
+}
+
+bool Generator::createRetain(Value object) {
+	return createReferenceCount(builder_, object, true);
+}
+
+bool Generator::createRelease(Value object) {
+	return createReferenceCount(builder_, object, false);
+}
+
+bool Generator::createReferenceCount(llvm::IRBuilder<>& builder, Value object, bool isRetain) {
+	if (isUnboxedReference(object->getType())) {
+		return false;
+	}
+	auto ptr = builder.CreateBitCast(object, llvm::Type::getInt8PtrTy(context_));
+	if (isRetain) {
+		return builder.CreateCall(fRetain_, { ptr }) == nullptr;
+	}
+
+	// an object whose members hold references has a release of its own, which releases them when the object is freed
+	auto objectType = object->getType()->getPointerElementType();
+	if (containsReference(objectType, false)) {
+		Function f;
+		if (getObjectReleaseFunction(object->getType(), f)) {
+			debugLog(__LINE__);
+			return true;
+		}
+		return builder.CreateCall(f, { ptr }) == nullptr;
+	}
+
+	auto size = llvm::ConstantInt::get(getSizeType(), getReferencedObjectSize(object->getType()));
+	return builder.CreateCall(fRelease_, { ptr, size }) == nullptr;
+}
+
+void Generator::setReferenceMembers(StructType type, const std::vector<bool>& isReference) {
+	referenceMembers_[type] = isReference;
+}
+
+bool Generator::isReferenceMember(StructType type, unsigned int index) const {
+	auto members = referenceMembers_.find(type);
+	return (members != referenceMembers_.end()) && (index < members->second.size()) && members->second[index];
+}
+
+// A pointer is a counted reference when it points to a built-in object (see BuiltInObjectTypes),
+// or when isReference tells that it is one, as a reference to a struct has the same type as a pointer to it.
+bool Generator::containsReference(Type type, bool isReference) const {
+	if (type->isPointerTy()) {
+		return !isUnboxedReference(type) && (isReference || builtInObjectTypes_.contains(type->getPointerElementType()));
+	}
+	if (type->isArrayTy()) {
+		return containsReference(type->getArrayElementType(), isReference);
+	}
+	if (auto structType = llvm::dyn_cast<llvm::StructType>(type)) {
+		for (unsigned int i = 0; i < structType->getNumElements(); ++i) {
+			if (containsReference(structType->getElementType(i), isReferenceMember(structType, i))) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+bool Generator::createRetainMembers(Value ptr, bool isReference) {
+	return createMembersCall(ptr, isReference, true);
+}
+
+bool Generator::createReleaseMembers(Value ptr, bool isReference) {
+	return createMembersCall(ptr, isReference, false);
+}
+
+bool Generator::createMembersCall(Value ptr, bool isReference, bool isRetain) {
+	auto type = ptr->getType()->getPointerElementType();
+	if (!containsReference(type, isReference)) {
+		return false;
+	}
+
+	Function f;
+	if (getMembersFunction(type, isReference, isRetain, f)) {
+		debugLog(__LINE__);
+		return true;
+	}
+	return builder_.CreateCall(f, { ptr }) == nullptr;
+}
+
+// The function that retains or releases every reference held in a struct or an array of the type,
+// created on the first use and shared by the values of the type.
+bool Generator::getMembersFunction(Type type, bool isReference, bool isRetain, Function& result) {
+	auto key = std::make_tuple(type, isReference, isRetain);
+	auto found = membersFunctions_.find(key);
+	if (found != membersFunctions_.end()) {
+		result = found->second;
+		return false;
+	}
+
+	std::string name;
+	llvm::raw_string_ostream stream(name);
+	stream << (isRetain ? ".retain.members." : ".release.members.");
+	type->print(stream, false, true);
+	if (isReference) {
+		stream << "&";
+	}
+	auto functionType = llvm::FunctionType::get(llvm::Type::getVoidTy(context_), { llvm::PointerType::get(type, 0) }, false);
+	if (createRuntimeFunction(functionType, stream.str(), result)) {
+		debugLog(__LINE__);
+		return true;
+	}
+	membersFunctions_[key] = result;
+
+	llvm::IRBuilder<> builder(llvm::BasicBlock::Create(context_, "", result));
+	if (createMembersCode(builder, result->getArg(0), type, isReference, isRetain)) {
+		debugLog(__LINE__);
+		return true;
+	}
+	builder.CreateRetVoid();
+
+	return false;
+}
+
+bool Generator::createMembersCode(llvm::IRBuilder<>& builder, Value ptr, Type type, bool isReference, bool isRetain) {
+	if (type->isPointerTy()) {
+		return createReferenceCount(builder, builder.CreateLoad(type, ptr), isRetain);
+	}
+
+	if (type->isArrayTy()) {
+		// a loop over the elements, as an array may be large
+		auto f = builder.GetInsertBlock()->getParent();
+		auto preheaderBlock = builder.GetInsertBlock();
+		auto loopBlock = llvm::BasicBlock::Create(context_, "", f);
+		auto exitBlock = llvm::BasicBlock::Create(context_, "", f);
+		builder.CreateBr(loopBlock);
+
+		builder.SetInsertPoint(loopBlock);
+		auto indexType = llvm::Type::getInt64Ty(context_);
+		auto index = builder.CreatePHI(indexType, 2);
+		index->addIncoming(llvm::ConstantInt::get(indexType, 0), preheaderBlock);
+		auto element = builder.CreateInBoundsGEP(type, ptr, { llvm::ConstantInt::get(indexType, 0), index });
+		if (createMembersCode(builder, element, type->getArrayElementType(), isReference, isRetain)) {
+			debugLog(__LINE__);
+			return true;
+		}
+		auto next = builder.CreateAdd(index, llvm::ConstantInt::get(indexType, 1));
+		index->addIncoming(next, builder.GetInsertBlock());
+		builder.CreateCondBr(builder.CreateICmpEQ(next, llvm::ConstantInt::get(indexType, type->getArrayNumElements())), exitBlock, loopBlock);
+
+		builder.SetInsertPoint(exitBlock);
+		return false;
+	}
+
+	auto structType = llvm::cast<llvm::StructType>(type);
+	for (unsigned int i = 0; i < structType->getNumElements(); ++i) {
+		auto memberType = structType->getElementType(i);
+		bool isReferenceMember = this->isReferenceMember(structType, i);
+		if (!containsReference(memberType, isReferenceMember)) {
+			continue;
+		}
+		if (createMembersCode(builder, builder.CreateStructGEP(structType, ptr, i), memberType, isReferenceMember, isRetain)) {
+			debugLog(__LINE__);
+			return true;
+		}
+	}
+	return false;
+}
+
+bool Generator::getObjectReleaseFunction(Type type, Function& result) {
+	auto found = objectReleaseFunctions_.find(type);
+	if (found != objectReleaseFunctions_.end()) {
+		result = found->second;
+		return false;
+	}
+
+	std::string name;
+	llvm::raw_string_ostream stream(name);
+	stream << ".release.";
+	type->getPointerElementType()->print(stream, false, true);
+
+	Function membersFunction;
+	if (createRuntimeFunction(llvm::FunctionType::get(llvm::Type::getVoidTy(context_), { llvm::Type::getInt8PtrTy(context_) }, false), stream.str(), result) ||
+		getMembersFunction(type->getPointerElementType(), false, false, membersFunction))
+	{
+		debugLog(__LINE__);
 		return true;
 	}
+	objectReleaseFunctions_[type] = result;
+
+	return createReleaseFunctionBody(result, membersFunction);
+}
+
+// Removes a retain followed by a release of the same object in the same block.
+// Every reference held by a variable, a call argument or a returned value is counted, so the object is kept alive
+// in between by its other references and the pair has no effect, e.g. the retain of a returned variable and its release
+// at the scope exit. That only holds while nothing in between may release a reference, which may free the object
+// through the members of another object, so a call or a store of a pointer in between keeps the pair.
+bool Generator::optimizeReferenceCounting(Function function) {
+	auto getObject = [this](llvm::Instruction& instruction, Function f) -> Value {
+		auto call = llvm::dyn_cast<llvm::CallInst>(&instruction);
+		if ((call == nullptr) || (call->getCalledFunction() != f)) {
+			return nullptr;
+		}
+		return call->getArgOperand(0)->stripPointerCasts();
+	};
+
+	// a retain or a release of a pinned object changes nothing, so it is removed wherever it is
+	std::vector<llvm::Instruction*> pinned;
+	for (auto& instruction : llvm::instructions(*function)) {
+		auto object = getObject(instruction, fRetain_);
+		if (object == nullptr) {
+			object = getObject(instruction, fRelease_);
+		}
+		std::set<llvm::Value*> visited;
+		if ((object != nullptr) && isPinnedObject(object, visited)) {
+			pinned.push_back(&instruction);
+		}
+	}
+	for (auto instruction : pinned) {
+		auto cast = llvm::dyn_cast<llvm::Instruction>(llvm::cast<llvm::CallInst>(instruction)->getArgOperand(0));
+		instruction->eraseFromParent();
+		if ((cast != nullptr) && llvm::isa<llvm::BitCastInst>(cast) && cast->use_empty()) {
+			cast->eraseFromParent();
+		}
+	}
+	pinnedObjects_.clear();
+
+	for (auto& block : *function) {
+		std::vector<llvm::Instruction*> erased;
+		std::vector<std::pair<Value, llvm::Instruction*>> retains;
+		for (auto& instruction : block) {
+			if (auto object = getObject(instruction, fRetain_)) {
+				retains.push_back(std::make_pair(object, &instruction));
+				continue;
+			}
+
+			auto object = getObject(instruction, fRelease_);
+			if (object == nullptr) {
+				auto store = llvm::dyn_cast<llvm::StoreInst>(&instruction);
+				bool isCall = llvm::isa<llvm::CallBase>(instruction) && !llvm::isa<llvm::DbgInfoIntrinsic>(instruction) && !llvm::isa<llvm::AssumeInst>(instruction);
+				if (isCall || ((store != nullptr) && store->getValueOperand()->getType()->isPointerTy())) {
+					retains.clear();
+				}
+				continue;
+			}
+
+			bool isPaired = false;
+			for (auto retain = retains.rbegin(); retain != retains.rend(); ++retain) {
+				if (retain->first == object) {
+					erased.push_back(retain->second);
+					erased.push_back(&instruction);
+					retains.erase(std::next(retain).base());
+					isPaired = true;
+					break;
+				}
+			}
+			// the release of another object may free this one
+			if (!isPaired) {
+				retains.clear();
+			}
+		}
+
+		for (auto instruction : erased) {
+			auto cast = llvm::dyn_cast<llvm::Instruction>(llvm::cast<llvm::CallInst>(instruction)->getArgOperand(0));
+			instruction->eraseFromParent();
+			if ((cast != nullptr) && llvm::isa<llvm::BitCastInst>(cast) && cast->use_empty()) {
+				cast->eraseFromParent();
+			}
+		}
+	}
+
+	return false;
+}
+
+// Whether the object has a pinned reference count on every path: it is allocated by createRegionObject() or createStackObject(),
+// it is returned by a call given to addPinnedObject(), or it is a phi or a select of such objects.
+bool Generator::isPinnedObject(Value object, std::set<llvm::Value*>& visited) const {
+	object = object->stripPointerCasts();
+	if (!visited.insert(object).second) {
+		// a phi of a loop is pinned if the values that enter the loop are
+		return true;
+	}
+
+	if (llvm::isa<llvm::AllocaInst>(object)) {
+		return true;
+	}
+	if (auto call = llvm::dyn_cast<llvm::CallInst>(object)) {
+		return (call->getCalledFunction() == fAllocateInRegion_) || (pinnedObjects_.find(call) != pinnedObjects_.end());
+	}
+	if (auto select = llvm::dyn_cast<llvm::SelectInst>(object)) {
+		return isPinnedObject(select->getTrueValue(), visited) && isPinnedObject(select->getFalseValue(), visited);
+	}
+	if (auto phi = llvm::dyn_cast<llvm::PHINode>(object)) {
+		for (auto& incoming : phi->incoming_values()) {
+			if (!isPinnedObject(incoming, visited)) {
+				return false;
+			}
+		}
+		return true;
+	}
+	return false;
+}
+
+// The result of a call in a region, when the callee returns only an object it allocates with new, see FunctionNode::getCapturedArguments().
+// Other calls in a region may return an object allocated outside of it, so their results are counted as usual.
+void Generator::addPinnedObject(Value object) {
+	pinnedObjects_.insert(object);
+}
+
+bool Generator::createRegionObject(Type type, Value region, Value& result) {
+	// the same layout as an object from createCallMalloc(), from the region the new is written in
+	Value size;
+	if (createSizeOf(type->getPointerElementType(), size)) {
+		debugLog(__LINE__);
+		return true;
+	}
+
+	result = builder_.CreateCall(fAllocateInRegion_, { region, size });
+	auto referenceCount = builder_.CreateBitCast(result, llvm::PointerType::get(getReferenceCountType(), 0));
+	return builder_.CreateStore(getPinnedReferenceCount(), referenceCount) == nullptr;
+}
+
+bool Generator::createStackObject(Type type, Value& result) {
+	// the same layout as an object from createCallMalloc(), in the entry block
+	if (createAlloc(type->getPointerElementType(), result)) {
+		debugLog(__LINE__);
+		return true;
+	}
+
+	auto referenceCount = builder_.CreateBitCast(result, llvm::PointerType::get(getReferenceCountType(), 0));
+	return builder_.CreateStore(getPinnedReferenceCount(), referenceCount) == nullptr;
+}
+
+bool Generator::isUnboxedReference(Type type) const {
+	if (!isCompactObjects_ || !type->isPointerTy()) {
+		return false;
+	}
+	auto objectType = llvm::dyn_cast<llvm::StructType>(type->getPointerElementType());
+	if ((objectType == nullptr) || (objectType->getNumElements() != kStructEntityMemberIndex + 1)) {
+		return false;
+	}
+
+	// the value of a reference can not be changed, so the reference can hold the value itself
+	return builtInObjectTypes_.contains(objectType) && (objectType->getElementType(kStructEntityMemberIndex)->getPrimitiveSizeInBits() <= 32);
+}
+
+bool Generator::createUnboxedReference(Type type, Value value, Value& result) {
+	// (bits of the value << 1) | 1, which is never null, and is told apart from an object by the lowest bit
+	auto valueType = type->getPointerElementType()->getStructElementType(kStructEntityMemberIndex);
+	if (value == nullptr) {
+		value = llvm::Constant::getNullValue(valueType);
+	}
+
+	auto bitsType = llvm::Type::getIntNTy(context_, static_cast<unsigned int>(valueType->getPrimitiveSizeInBits()));
+	auto bits = builder_.CreateZExt(builder_.CreateBitCast(value, bitsType), getSizeType());
+	auto tagged = builder_.CreateOr(builder_.CreateShl(bits, 1), llvm::ConstantInt::get(getSizeType(), 1));
+	result = builder_.CreateIntToPtr(tagged, type);
+	return result == nullptr;
+}
+
+bool Generator::createEnterRegion(Value& result) {
+	if (createAlloc(regionType_, result)) {
+		debugLog(__LINE__);
+		return true;
+	}
+	return builder_.CreateCall(fEnterRegion_, { result }) == nullptr;
+}
+
+bool Generator::createExitRegion(Value region) {
+	return builder_.CreateCall(fExitRegion_, { region }) == nullptr;
+}
+
+bool Generator::createAlloc(Type type, Value& result) {
+	auto f = builder_.GetInsertBlock()->getParent();
+	auto& entryBlock = f->getEntryBlock();
+	llvm::IRBuilder<> tempBuilder(&entryBlock, entryBlock.begin());
+	result = tempBuilder.CreateAlloca(type);
+	return result == nullptr;
+}
+
+bool Generator::createLocalCopy(Value value, Value& result) {
+	return createAlloc(value->getType(), result) || createStore(value, result);
+}
+
+bool Generator::createStore(Value value, Value destPtr) {
+	auto type = destPtr->getType()->getPointerElementType();
+	if (type->isAggregateType() && (kMemIntrinsicThreshold < module_.getDataLayout().getTypeAllocSize(type))) {
+		return createAggregateStore(value, destPtr);
+	}
+
+	if (value == nullptr) {
+		value = llvm::Constant::getNullValue(destPtr->getType()->getPointerElementType());
+	}
+	return builder_.CreateStore(value, destPtr) == nullptr;
+}
+
+// A store of a first class aggregate is split into a store per element, which makes large IR and slow instruction selection
+// for big arrays. Zero is stored with llvm.memset, a constant is copied from the constant pool, and a value just loaded
+// is copied from where it was loaded, so the loaded temporary is never materialized.
+bool Generator::createAggregateStore(Value value, Value destPtr) {
+	auto type = destPtr->getType()->getPointerElementType();
+	auto& layout = module_.getDataLayout();
+	auto size = layout.getTypeAllocSize(type);
+	// a pointer to a value is aligned for the type at least
+	auto destAlign = std::max(destPtr->getPointerAlignment(layout), layout.getABITypeAlign(type));
+
+	auto constant = llvm::dyn_cast_or_null<llvm::Constant>(value);
+	if ((value == nullptr) || ((constant != nullptr) && constant->isNullValue())) {
+		return builder_.CreateMemSet(destPtr, builder_.getInt8(0), size, destAlign) == nullptr;
+	}
+
+	Value srcPtr = nullptr;
+	if (constant != nullptr) {
+		if (createGlobalConstant(constant, srcPtr)) {
+			debugLog(__LINE__);
+			return true;
+		}
+	}
+	else if (isUnclobberedLoad(value)) {
+		srcPtr = llvm::cast<llvm::LoadInst>(value)->getPointerOperand();
+	}
+	if (srcPtr == nullptr) {
+		return builder_.CreateStore(value, destPtr) == nullptr;
+	}
+
+	// the source may be the destination itself, e.g. "a = a", which llvm.memcpy does not allow;
+	// llvm.memmove becomes llvm.memcpy when the optimizer proves that they do not overlap
+	auto srcAlign = std::max(srcPtr->getPointerAlignment(layout), layout.getABITypeAlign(type));
+	if (builder_.CreateMemMove(destPtr, destAlign, srcPtr, srcAlign, size) == nullptr) {
+		debugLog(__LINE__);
+		return true;
+	}
+	auto load = llvm::dyn_cast<llvm::LoadInst>(value);
+	if ((load != nullptr) && load->use_empty()) {
+		load->eraseFromParent();
+	}
+	return false;
+}
+
+// whether the value is loaded in the current block and nothing may have written memory since,
+// so that its source still holds it
+bool Generator::isUnclobberedLoad(Value value) {
+	auto load = llvm::dyn_cast<llvm::LoadInst>(value);
+	if ((load == nullptr) || !load->isSimple() || (load->getParent() != builder_.GetInsertBlock())) {
+		return false;
+	}
+	for (auto i = std::next(load->getIterator()); i != builder_.GetInsertPoint(); ++i) {
+		// the insert point is not after the load
+		if ((i == load->getParent()->end()) || i->mayWriteToMemory()) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool Generator::createLoad(Value srcPtr, Value& resultValue) {
+	resultValue = builder_.CreateLoad(srcPtr->getType()->getPointerElementType(), srcPtr);
+	return resultValue == nullptr;
+}
+
+bool Generator::createReferenceLoad(Value srcPtr, Value& resultValue) {
+	// a reference always refers to a live object; see also createReferenceAssumption()
+	auto load = builder_.CreateLoad(srcPtr->getType()->getPointerElementType(), srcPtr);
+	if (load == nullptr) {
+		debugLog(__LINE__);
+		return true;
+	}
+
+	load->setMetadata(llvm::LLVMContext::MD_nonnull, llvm::MDNode::get(context_, {}));
+	if (!isUnboxedReference(load->getType())) {
+		auto size = llvm::ConstantAsMetadata::get(llvm::ConstantInt::get(llvm::Type::getInt64Ty(context_), getReferencedObjectSize(load->getType())));
+		load->setMetadata(llvm::LLVMContext::MD_dereferenceable, llvm::MDNode::get(context_, { size }));
+	}
 
+	resultValue = load;
+	return false;
+}
+
+bool Generator::createInitializeObject(Value object, Value initializer) {
+	// the reference count is set by createCallMalloc() or createStackObject()
+	auto objectType = llvm::cast<llvm::StructType>(object->getType()->getPointerElementType());
+	if (!builtInObjectTypes_.contains(objectType)) {
+		// the object of a struct, which is zeroed after the count like a struct variable
+		for (unsigned int i = 1; i < objectType->getNumElements(); ++i) {
+			if (createStore(nullptr, builder_.CreateStructGEP(objectType, object, i))) {
+				debugLog(__LINE__);
+				return true;
+			}
+		}
+		return false;
+	}
 
-	if (initializer == nullptr) {
-		initializer = llvm::Constant::getNullValue(entity->getType()->getPointerElementType());
+	// the indices are constants of context_, as the JIT has a generator with a context of its own for each tier
+	auto entity = builder_.CreateStructGEP(objectType, object, kStructEntityMemberIndex);
+	if (entity == nullptr) {
+		debugLog(__LINE__);
+		return true;
 	}
-	if (builder_.CreateStore(initializer, entity) == nullptr) {
+
+
+	if (createStore(initializer, entity)) {
 		debugLog(__LINE__);
 		return true;
 	}
@@ -710,7 +1942,7 @@ bool Generator::BuiltInObjectTypes::init(Generator& g) {
 		}
 
 		std::vector<llvm::Type*> members;
-		members.push_back(g.getSizeType());
+		members.push_back(g.getReferenceCountType());
 		members.push_back(g.getTypeIdType());
 		Type llvmType;
 		if (g.getType(builtInTypes[i], llvmType)) {
@@ -735,6 +1967,15 @@ Generator::StructType Generator::BuiltInObjectTypes::getType(Token::Type type) c
 	return nullptr;
 }
 
+bool Generator::BuiltInObjectTypes::contains(llvm::Type* type) const {
+	for (auto t : types_) {
+		if (type == t) {
+			return true;
+		}
+	}
+	return false;
+}
+
 bool Generator::createGetArrayElement(const Type& type, const Value& array, uint64_t index, Value& result) {
 	const std::vector<Value> indexes = {
 		llvm::ConstantInt::get(llvm::Type::getInt32Ty(context_), 0),
@@ -745,18 +1986,521 @@ bool Generator::createGetArrayElement(const Type& type, const Value& array, uint
 	return result == nullptr;
 }
 
+bool Generator::createElementPointer(Value array, Value index, Value& result) {
+	auto zero = llvm::ConstantInt::get(llvm::Type::getInt64Ty(context_), 0);
+	result = builder_.CreateInBoundsGEP(array->getType()->getPointerElementType(), array, { zero, index });
+	return result == nullptr;
+}
+
+bool Generator::createMemberPointer(Value object, size_t index, Value& result) {
+	result = builder_.CreateStructGEP(object->getType()->getPointerElementType(), object, static_cast<unsigned int>(index));
+	return result == nullptr;
+}
+
+// the element of a column of a struct of arrays, see createSoaType()
+bool Generator::createColumnElementPointer(Value array, size_t column, Value index, Value& result) {
+	auto zero = llvm::ConstantInt::get(llvm::Type::getInt64Ty(context_), 0);
+	auto columnIndex = llvm::ConstantInt::get(llvm::Type::getInt32Ty(context_), column);
+	result = builder_.CreateInBoundsGEP(array->getType()->getPointerElementType(), array, { zero, columnIndex, index });
+	return result == nullptr;
+}
+
+// An index of i64 is out of bounds when it is negative too, as the comparison is unsigned.
+// The check is left to the optimizer: a check implied by a loop condition such as "i < N" is folded by the induction variable
+// simplification, a check of a loop invariant index is unswitched out of the loop, and the vectorizer runs the in-bounds
+// iterations of other loops without it. The branch weights and the cold noreturn failure keep the check off the hot path.
+bool Generator::createBoundsCheck(Value index, Value size) {
+	return createCheck(builder_.CreateICmpULT(index, size), index, size);
+}
+
+// begin <= end <= size, for the elements from begin to end
+bool Generator::createRangeCheck(Value begin, Value end, Value size) {
+	return createCheck(builder_.CreateICmpULE(end, size), end, size) ||
+		createCheck(builder_.CreateICmpULE(begin, end), begin, end);
+}
+
+// reports the index and the size unless the condition holds
+bool Generator::createCheck(Value condition, Value index, Value size) {
+	if ((fBoundsFail_ == nullptr) && createBoundsFailFunction()) {
+		debugLog(__LINE__);
+		return true;
+	}
+
+	auto function = builder_.GetInsertBlock()->getParent();
+	auto inBounds = llvm::BasicBlock::Create(context_, "", function);
+	auto outOfBounds = llvm::BasicBlock::Create(context_, "", function);
+	builder_.CreateCondBr(condition, inBounds, outOfBounds, llvm::MDBuilder(context_).createBranchWeights(1 << 20, 1));
+
+	builder_.SetInsertPoint(outOfBounds);
+	builder_.CreateCall(fBoundsFail_, { index, size });
+	builder_.CreateUnreachable();
+
+	builder_.SetInsertPoint(inBounds);
+	return false;
+}
+
+bool Generator::createPointerOffset(Value ptr, Value index, Value& result) {
+	result = builder_.CreateInBoundsGEP(ptr->getType()->getPointerElementType(), ptr, index);
+	return result == nullptr;
+}
+
+bool Generator::createSlice(Value data, Value length, Value& result) {
+	Type sliceType;
+	if (createSliceType(data->getType()->getPointerElementType(), sliceType)) {
+		debugLog(__LINE__);
+		return true;
+	}
+	auto slice = builder_.CreateInsertValue(llvm::UndefValue::get(sliceType), data, kSliceDataMemberIndex);
+	result = builder_.CreateInsertValue(slice, length, kSliceLengthMemberIndex);
+	return result == nullptr;
+}
+
+bool Generator::createSliceData(Value slice, Value& result) {
+	result = builder_.CreateExtractValue(slice, kSliceDataMemberIndex);
+	return result == nullptr;
+}
+
+bool Generator::createSliceLength(Value slice, Value& result) {
+	result = builder_.CreateExtractValue(slice, kSliceLengthMemberIndex);
+	return result == nullptr;
+}
+
+bool Generator::createSliceLengthPointer(Value slicePtr, Value& result) {
+	return createMemberPointer(slicePtr, kSliceLengthMemberIndex, result);
+}
+
 bool Generator::createPtrType(const Type& type, Type& result) {
 	result = llvm::PointerType::get(type, 0);
 	return result == nullptr;
 }
 
-bool Generator::createGlobalVariable(const Type& arrayType, const Constant& value, Value& result) {
-	result = new llvm::GlobalVariable(
+// A read only copy of the constant in .rodata, shared by every literal with the same contents.
+// LLVM uniques constants by type and contents, so the constant itself is the key of the pool.
+// unnamed_addr lets the linker merge it with equal constants of other modules too.
+bool Generator::createGlobalConstant(Value value, Value& result) {
+	auto constant = llvm::dyn_cast<llvm::Constant>(value);
+	if (constant == nullptr) {
+		debugLog(__LINE__);
+		return true;
+	}
+
+	auto found = constantPool_.find(constant);
+	if (found != constantPool_.end()) {
+		result = found->second;
+		return false;
+	}
+
+	auto global = new llvm::GlobalVariable(module_, constant->getType(), true, llvm::GlobalValue::PrivateLinkage, constant, ".const");
+	global->setUnnamedAddr(llvm::GlobalValue::UnnamedAddr::Global);
+	global->setAlignment(module_.getDataLayout().getPrefTypeAlign(constant->getType()));
+	constantPool_[constant] = global;
+	result = global;
+	return false;
+}
+
+// Variables are built in SSA form while the code is generated, as in Braun et al.,
+// "Simple and Efficient Construction of Static Single Assignment Form".
+// A block is sealed when all of its predecessors are generated. Blocks are sealed unless unsealBlock() was called,
+// so the code for a branch must be created before the code of its destinations, except for loop headers.
+bool Generator::createVariable(Type type, bool isReference, Variable& result) {
+	variables_.push_back(std::make_unique<VariableState>(VariableState({ type, isReference, {}, nullptr, nullptr })));
+	result = variables_.back().get();
+	return false;
+}
+
+bool Generator::writeVariable(Variable variable, Value value) {
+	if (value == nullptr) {
+		value = llvm::Constant::getNullValue(variable->type);
+	}
+
+	auto block = builder_.GetInsertBlock();
+	variable->definitions[block] = value;
+	createDebugValue(variable, value, block, nullptr);
+
+	return false;
+}
+
+bool Generator::readVariable(Variable variable, Value& result) {
+	result = readVariable(variable, builder_.GetInsertBlock());
+	return result == nullptr;
+}
+
+void Generator::unsealBlock(BasicBlock block) {
+	unsealedBlocks_.insert(block);
+}
+
+bool Generator::sealBlock(BasicBlock block) {
+	unsealedBlocks_.erase(block);
+
+	auto incompletePhis = incompletePhis_.find(block);
+	if (incompletePhis == incompletePhis_.end()) {
+		return false;
+	}
+	auto phis = std::move(incompletePhis->second);
+	incompletePhis_.erase(incompletePhis);
+
+	for (auto& phi : phis) {
+		addPhiOperands(phi.first, phi.second);
+	}
+
+	return false;
+}
+
+void Generator::clearVariables() {
+	variables_.clear();
+	unsealedBlocks_.clear();
+	incompletePhis_.clear();
+}
+
+Generator::Value Generator::readVariable(Variable variable, BasicBlock block) {
+	auto definition = variable->definitions.find(block);
+	if (definition != variable->definitions.end()) {
+		return definition->second;
+	}
+	return readVariableRecursive(variable, block);
+}
+
+Generator::Value Generator::readVariableRecursive(Variable variable, BasicBlock block) {
+	Value value;
+	if (unsealedBlocks_.find(block) != unsealedBlocks_.end()) {
+		auto phi = createVariablePhi(variable, block);
+		incompletePhis_[block].push_back(std::make_pair(variable, phi));
+		value = phi;
+	}
+	else {
+		std::vector<BasicBlock> predecessors(llvm::pred_begin(block), llvm::pred_end(block));
+		if (predecessors.empty()) {
+			// unreachable
+			value = llvm::UndefValue::get(variable->type);
+		}
+		else if (predecessors.size() == 1) {
+			value = readVariable(variable, predecessors[0]);
+		}
+		else {
+			// the phi is the definition while its operands are read, to break cycles
+			auto phi = createVariablePhi(variable, block);
+			variable->definitions[block] = phi;
+			value = addPhiOperands(variable, phi);
+		}
+	}
+
+	variable->definitions[block] = value;
+	return value;
+}
+
+Generator::Value Generator::addPhiOperands(Variable variable, llvm::PHINode* phi) {
+	auto block = phi->getParent();
+	std::vector<BasicBlock> predecessors(llvm::pred_begin(block), llvm::pred_end(block));
+	for (auto predecessor : predecessors) {
+		phi->addIncoming(readVariable(variable, predecessor), predecessor);
+	}
+	return tryRemoveTrivialPhi(phi);
+}
+
+Generator::Value Generator::tryRemoveTrivialPhi(llvm::PHINode* phi) {
+	Value same = nullptr;
+	for (auto& operand : phi->incoming_values()) {
+		if ((operand == same) || (operand == phi)) {
+			continue;
+		}
+		if (same != nullptr) {
+			return phi;
+		}
+		same = operand;
+	}
+	if (same == nullptr) {
+		// unreachable or read before any definition
+		same = llvm::UndefValue::get(phi->getType());
+	}
+
+	std::vector<llvm::WeakVH> users;
+	std::set<llvm::Instruction*> assumptions;
+	for (auto user : phi->users()) {
+		if ((user != phi) && llvm::isa<llvm::PHINode>(user)) {
+			users.push_back(user);
+		}
+		// same has the facts of createReferenceAssumption() from where it is defined;
+		// an assumption uses the phi once per operand bundle
+		if (llvm::isa<llvm::AssumeInst>(user)) {
+			assumptions.insert(llvm::cast<llvm::Instruction>(user));
+		}
+	}
+	for (auto assumption : assumptions) {
+		assumption->eraseFromParent();
+	}
+
+	phi->replaceAllUsesWith(same);
+	for (auto& variable : variables_) {
+		for (auto& definition : variable->definitions) {
+			if (definition.second == phi) {
+				definition.second = same;
+			}
+		}
+	}
+	phi->eraseFromParent();
+
+	// same may itself become trivial and be replaced while the users are simplified
+	llvm::WeakTrackingVH result(same);
+	for (auto& user : users) {
+		if (user) {
+			tryRemoveTrivialPhi(llvm::cast<llvm::PHINode>(user));
+		}
+	}
+
+	return result;
+}
+
+llvm::PHINode* Generator::createVariablePhi(Variable variable, BasicBlock block) {
+	llvm::PHINode* phi;
+	if (block->empty()) {
+		phi = llvm::PHINode::Create(variable->type, 0, "", block);
+	}
+	else {
+		phi = llvm::PHINode::Create(variable->type, 0, "", &block->front());
+	}
+
+	// after the phis, or at the end when the code of the block has not been generated yet
+	createDebugValue(variable, phi, block, block->getFirstNonPHI());
+	if (variable->isReference) {
+		createReferenceAssumption(phi);
+	}
+
+	return phi;
+}
+
+// The value of a reference variable in SSA form is a reference load, a call or an argument,
+// which carry nonnull and dereferenceable themselves (see createReferenceLoad()), but a phi that merges them does not.
+// An assumption gives the phi the same facts that the load of the variable had when it was in memory.
+void Generator::createReferenceAssumption(llvm::PHINode* phi) {
+	auto block = phi->getParent();
+	llvm::IRBuilder<> builder(context_);
+	if (block->getFirstNonPHI() != nullptr) {
+		builder.SetInsertPoint(block->getFirstNonPHI());
+	}
+	else {
+		builder.SetInsertPoint(block);
+	}
+
+	std::vector<llvm::OperandBundleDef> bundles = { llvm::OperandBundleDef("nonnull", std::vector<Value>({ phi })) };
+	if (!isUnboxedReference(phi->getType())) {
+		auto size = llvm::ConstantInt::get(llvm::Type::getInt64Ty(context_), getReferencedObjectSize(phi->getType()));
+		bundles.push_back(llvm::OperandBundleDef("dereferenceable", std::vector<Value>({ phi, size })));
+	}
+	builder.CreateAssumption(builder.getTrue(), bundles);
+}
+
+bool Generator::createTierStub(Function function) {
+	const std::string& name = function->getName().str();
+
+	auto stub = new llvm::GlobalVariable(
 		module_,
-		arrayType,
+		function->getType(),
 		false,
-		llvm::GlobalValue::CommonLinkage,
-		value
+		llvm::GlobalValue::ExternalLinkage,
+		function,
+		getTierStubName(name)
 	);
-	return result == nullptr;
+	if (stub == nullptr) {
+		debugLog(__LINE__);
+		return true;
+	}
+
+	auto counter = new llvm::GlobalVariable(
+		module_,
+		llvm::Type::getInt64Ty(context_),
+		false,
+		llvm::GlobalValue::ExternalLinkage,
+		llvm::ConstantInt::get(llvm::Type::getInt64Ty(context_), 0),
+		getTierCounterName(name)
+	);
+	if (counter == nullptr) {
+		debugLog(__LINE__);
+		return true;
+	}
+
+	tierStubs_[function] = stub;
+	tierCounters_[function] = counter;
+	tieredFunctionNames_.push_back(name);
+
+	return false;
+}
+
+bool Generator::createDebugCompileUnit() {
+	// perf and debuggers resolve the file against the directory, so it must not depend on where they run
+	llvm::SmallString<256> directory(sourceDirectory_);
+	if (llvm::sys::fs::make_absolute(directory)) {
+		debugLog(__LINE__);
+		return true;
+	}
+
+	debugBuilder_ = std::make_unique<llvm::DIBuilder>(module_);
+	debugFile_ = debugBuilder_->createFile(module_.getSourceFileName(), directory);
+	// there is no DWARF language code for mahina, and C is the closest for debuggers
+	debugCompileUnit_ = debugBuilder_->createCompileUnit(llvm::dwarf::DW_LANG_C, debugFile_, "mahina", false, "", 0, llvm::StringRef(), debugEmissionKind_);
+
+	module_.addModuleFlag(llvm::Module::Warning, "Dwarf Version", 4);
+	module_.addModuleFlag(llvm::Module::Warning, "Debug Info Version", llvm::DEBUG_METADATA_VERSION);
+
+	return false;
+}
+
+llvm::DIType* Generator::getDebugType(const ValueType& type) {
+	// only scalars are described; pointers, references, arrays and slices stay invisible to the debugger
+	if ((type.pointerCount != 0) || type.isReference || !type.arraySizes.empty() || type.isSlice) {
+		return nullptr;
+	}
+
+	switch (type.basicType) {
+	case Token::Type::TYPE_BOOL:
+		return debugBuilder_->createBasicType("bool", 8, llvm::dwarf::DW_ATE_boolean);
+	case Token::Type::TYPE_I8:
+		return debugBuilder_->createBasicType("i8", 8, llvm::dwarf::DW_ATE_signed);
+	case Token::Type::TYPE_I16:
+		return debugBuilder_->createBasicType("i16", 16, llvm::dwarf::DW_ATE_signed);
+	case Token::Type::TYPE_I32:
+		return debugBuilder_->createBasicType("i32", 32, llvm::dwarf::DW_ATE_signed);
+	case Token::Type::TYPE_I64:
+		return debugBuilder_->createBasicType("i64", 64, llvm::dwarf::DW_ATE_signed);
+	case Token::Type::TYPE_U8:
+		return debugBuilder_->createBasicType("u8", 8, llvm::dwarf::DW_ATE_unsigned);
+	case Token::Type::TYPE_U16:
+		return debugBuilder_->createBasicType("u16", 16, llvm::dwarf::DW_ATE_unsigned);
+	case Token::Type::TYPE_U32:
+		return debugBuilder_->createBasicType("u32", 32, llvm::dwarf::DW_ATE_unsigned);
+	case Token::Type::TYPE_U64:
+		return debugBuilder_->createBasicType("u64", 64, llvm::dwarf::DW_ATE_unsigned);
+	case Token::Type::TYPE_F32:
+		return debugBuilder_->createBasicType("f32", 32, llvm::dwarf::DW_ATE_float);
+	case Token::Type::TYPE_F64:
+		return debugBuilder_->createBasicType("f64", 64, llvm::dwarf::DW_ATE_float);
+	default:
+		return nullptr;
+	}
+}
+
+bool Generator::createDebugFunction(Function function, const Token& name) {
+	if (!debugBuilder_) {
+		return false;
+	}
+
+	auto type = debugBuilder_->createSubroutineType(debugBuilder_->getOrCreateTypeArray({}));
+	unsigned int line = static_cast<unsigned int>(name.getLine());
+	currentSubprogram_ = debugBuilder_->createFunction(debugFile_, function->getName(), llvm::StringRef(), debugFile_, line, type, line,
+		llvm::DINode::FlagPrototyped, llvm::DISubprogram::SPFlagDefinition);
+	function->setSubprogram(currentSubprogram_);
+
+	// the prologue is attributed to the function name
+	setDebugLocation(name);
+
+	return false;
+}
+
+bool Generator::createDebugParameter(const Token& name, const ValueType& type, unsigned int index, Value value) {
+	if (!currentSubprogram_ || (debugEmissionKind_ != llvm::DICompileUnit::FullDebug)) {
+		return false;
+	}
+	auto debugType = getDebugType(type);
+	if (!debugType) {
+		return false;
+	}
+
+	unsigned int line = static_cast<unsigned int>(name.getLine());
+	auto variable = debugBuilder_->createParameterVariable(currentSubprogram_, name.getString(), index, debugFile_, line, debugType, true);
+	debugBuilder_->insertDbgValueIntrinsic(value, variable, debugBuilder_->createExpression(), builder_.getCurrentDebugLocation().get(), builder_.GetInsertBlock());
+
+	return false;
+}
+
+bool Generator::createDebugLocalVariable(const Token& name, const ValueType& type, Value ptr) {
+	if (!currentSubprogram_ || (debugEmissionKind_ != llvm::DICompileUnit::FullDebug)) {
+		return false;
+	}
+	auto debugType = getDebugType(type);
+	if (!debugType) {
+		return false;
+	}
+
+	unsigned int line = static_cast<unsigned int>(name.getLine());
+	auto variable = debugBuilder_->createAutoVariable(currentSubprogram_, name.getString(), debugFile_, line, debugType, true);
+	auto location = llvm::DILocation::get(context_, line, static_cast<unsigned int>(name.getColumn()), currentSubprogram_);
+	debugBuilder_->insertDeclare(ptr, variable, debugBuilder_->createExpression(), location, builder_.GetInsertBlock());
+
+	return false;
+}
+
+bool Generator::createDebugVariable(const Token& name, const ValueType& type, Variable variable) {
+	if (!currentSubprogram_ || (debugEmissionKind_ != llvm::DICompileUnit::FullDebug)) {
+		return false;
+	}
+	auto debugType = getDebugType(type);
+	if (!debugType) {
+		return false;
+	}
+
+	// its location is described by a dbg.value at each definition
+	unsigned int line = static_cast<unsigned int>(name.getLine());
+	variable->debugVariable = debugBuilder_->createAutoVariable(currentSubprogram_, name.getString(), debugFile_, line, debugType, true);
+	variable->debugLocation = llvm::DILocation::get(context_, line, static_cast<unsigned int>(name.getColumn()), currentSubprogram_);
+
+	return false;
+}
+
+void Generator::createDebugValue(Variable variable, Value value, BasicBlock block, llvm::Instruction* insertBefore) {
+	if (variable->debugVariable == nullptr) {
+		return;
+	}
+
+	if (insertBefore != nullptr) {
+		debugBuilder_->insertDbgValueIntrinsic(value, variable->debugVariable, debugBuilder_->createExpression(), variable->debugLocation, insertBefore);
+	}
+	else {
+		debugBuilder_->insertDbgValueIntrinsic(value, variable->debugVariable, debugBuilder_->createExpression(), variable->debugLocation, block);
+	}
+}
+
+void Generator::setDebugLocation(const Token& token) {
+	if (!currentSubprogram_) {
+		return;
+	}
+	builder_.SetCurrentDebugLocation(llvm::DILocation::get(context_, static_cast<unsigned int>(token.getLine()), static_cast<unsigned int>(token.getColumn()), currentSubprogram_));
+}
+
+void Generator::finishDebugFunction() {
+	if (!currentSubprogram_) {
+		return;
+	}
+	debugBuilder_->finalizeSubprogram(currentSubprogram_);
+	currentSubprogram_ = nullptr;
+	builder_.SetCurrentDebugLocation(llvm::DebugLoc());
+}
+
+bool Generator::finalizeDebugInfo() {
+	if (debugBuilder_) {
+		debugBuilder_->finalize();
+	}
+	return false;
+}
+
+bool Generator::createIncrementTierCounter() {
+	auto block = builder_.GetInsertBlock();
+	if (block == nullptr) {
+		debugLog(__LINE__);
+		return true;
+	}
+
+	auto counter = tierCounters_.find(block->getParent());
+	if (counter == tierCounters_.end()) {
+		debugLog(__LINE__);
+		return true;
+	}
+
+	// the JIT reads the counter from another thread; monotonic load and store are plain moves on x86
+	auto type = counter->second->getValueType();
+	auto load = builder_.CreateLoad(type, counter->second);
+	load->setAtomic(llvm::AtomicOrdering::Monotonic);
+	auto add = builder_.CreateAdd(load, llvm::ConstantInt::get(type, 1));
+	auto store = builder_.CreateStore(add, counter->second);
+	store->setAtomic(llvm::AtomicOrdering::Monotonic);
+
+	return false;
 }
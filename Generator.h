@@ -1,6 +1,11 @@
 #pragma once
 
 #include <string>
+#include <map>
+#include <memory>
+#include <set>
+#include <tuple>
+#include <vector>
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Function.h"
@@ -8,12 +13,15 @@
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/NoFolder.h"
 #include "llvm/IR/Verifier.h"
+#include "llvm/IR/DIBuilder.h"
 #include "llvm/Support/TargetSelect.h"
-#include "llvm/Support/TargetRegistry.h"
+#include "llvm/MC/TargetRegistry.h"
+#include "llvm/Support/Host.h"
 #include "llvm/Target/TargetOptions.h"
 #include "llvm/Target/TargetMachine.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/IR/LegacyPassManager.h"
+#include "llvm/ADT/SmallVector.h"
 #include "Token.h"
 #include "ValueType.h"
 
@@ -29,15 +37,96 @@ public:
 	typedef llvm::Value* Value;
 	typedef llvm::Constant* Constant;
 
-	Generator(const std::string& filename) : builder_(context_), module_(filename, context_), targetMachine_(nullptr), fMalloc_(nullptr), builtInObjectTypes_() {}
+	// a local variable kept in SSA form instead of in an alloca, see readVariable()
+	struct VariableState {
+		Type type;
+		bool isReference;
+		std::map<BasicBlock, Value> definitions;
+		llvm::DILocalVariable* debugVariable;
+		llvm::DILocation* debugLocation;
+	};
+	typedef VariableState* Variable;
+
+	enum class Allocator {
+		MALLOC, // every object from malloc
+		POOL, // small objects from the size class free lists, see createAllocatorFunctions()
+	};
+
+	Generator(const std::string& filename) : builder_(context_), module_(filename, context_), targetMachine_(nullptr), fMalloc_(nullptr), fFree_(nullptr), fRetain_(nullptr), fRelease_(nullptr), fAllocate_(nullptr), fDeallocate_(nullptr), fNew_(nullptr), fAllocateInRegion_(nullptr), fEnterRegion_(nullptr), fExitRegion_(nullptr), fBoundsFail_(nullptr), regionType_(nullptr), builtInObjectTypes_(), targetCpu_("generic"), allocator_(Allocator::POOL), isHeapStatistics_(false), isCompactObjects_(false), isTieredCompilation_(false), isFlatten_(false),
+		debugEmissionKind_(llvm::DICompileUnit::NoDebug), debugCompileUnit_(nullptr), debugFile_(nullptr), currentSubprogram_(nullptr) {}
 	~Generator() = default;
 
 	bool init();
 	bool writeString(const std::string& outputPath) const;
 	bool writeObjectFile(const std::string& outputPath);
+	bool writeBitcode(llvm::SmallVectorImpl<char>& buffer) const;
+	bool writeBitcodeFile(const std::string& outputPath, bool withSummary);
+	bool writeFunctionBitcode(const std::string& name, llvm::SmallVectorImpl<char>& buffer) const;
+	bool linkBitcodeFile(const std::string& bitcodePath);
+	bool optimize(unsigned int optimizationLevel, bool prepareForThinLto);
+
+	static bool optimizeModule(llvm::Module& module, llvm::TargetMachine* targetMachine, unsigned int optimizationLevel, bool prepareForThinLto = false,
+		const std::string& profileGeneratePath = "", const std::string& profileUsePath = "");
 
 	void llvmExample();
 
+	// must be set before init()
+	void setTargetCpu(const std::string& cpu) {
+		targetCpu_ = cpu;
+	}
+
+	const std::string& getTargetCpu() const {
+		return targetCpu_;
+	}
+
+	// comma separated, e.g. "+avx2,-avx512f"
+	void setTargetFeatures(const std::string& features) {
+		targetFeatures_ = features;
+	}
+
+	const std::string& getTargetFeatures() const {
+		return targetFeatures_;
+	}
+
+	// the instrumented program writes its raw profile to this path at exit
+	void setProfileGeneratePath(const std::string& path) {
+		profileGeneratePath_ = path;
+	}
+
+	// an indexed profile merged by llvm-profdata
+	void setProfileUsePath(const std::string& path) {
+		profileUsePath_ = path;
+	}
+
+	// must be set before init(); LineTablesOnly for -gline-tables-only, FullDebug for -g
+	void setDebugEmissionKind(llvm::DICompileUnit::DebugEmissionKind kind) {
+		debugEmissionKind_ = kind;
+	}
+
+	void setSourceDirectory(const std::string& directory) {
+		sourceDirectory_ = directory;
+	}
+
+	// must be set before init()
+	void setAllocator(Allocator allocator) {
+		allocator_ = allocator;
+	}
+
+	// must be set before init(); the program writes the allocation counts to stderr at exit
+	void setHeapStatistics(bool isHeapStatistics) {
+		isHeapStatistics_ = isHeapStatistics;
+	}
+
+	// must be set before init(); a 32 bit reference count and a 16 bit type id share the first 8 bytes of an object,
+	// and references to primitives of up to 32 bits hold the value instead of an object, see createUnboxedReference()
+	void setCompactObjects(bool isCompactObjects) {
+		isCompactObjects_ = isCompactObjects;
+	}
+
+	static std::string getDefaultTargetTriple();
+	static std::string getHostCpuName();
+	static std::string getHostCpuFeatures();
+
 	void setCurrentPackageName(const std::string& name) {
 		currentPackageName_ = name;
 	}
@@ -50,20 +139,75 @@ public:
 		return currentReturnType_;
 	}
 
+	// tiered JIT: calls to mahina functions go through "<name>.stub" and
+	// function entries and loop iterations count up "<name>.counter"
+	void setTieredCompilation(bool isTiered) {
+		isTieredCompilation_ = isTiered;
+	}
+
+	bool isTieredCompilation() const {
+		return isTieredCompilation_;
+	}
+
+	const std::vector<std::string>& getTieredFunctionNames() const {
+		return tieredFunctionNames_;
+	}
+
+	static std::string getTierStubName(const std::string& functionName) {
+		return functionName + ".stub";
+	}
+
+	static std::string getTierCounterName(const std::string& functionName) {
+		return functionName + ".counter";
+	}
+
+	// the allocator, the regions and the reference counting, and their state, see createRuntimeFunction()
+	static bool isRuntime(const llvm::GlobalValue& value) {
+		return value.hasLinkOnceODRLinkage() && value.getName().startswith(".");
+	}
+
+	enum class Inlining {
+		DEFAULT,
+		HINT,
+		ALWAYS,
+		NEVER,
+	};
+
+	enum class MemoryEffect {
+		ANY,
+		READ_ONLY,
+		NONE,
+	};
+
+	// calls created while set are inlined unless the callee is noinline, for functions marked flatten
+	void setFlatten(bool isFlatten) {
+		isFlatten_ = isFlatten;
+	}
+
 	Type getSizeType();
 	Type getTypeIdType();
+	Type getReferenceCountType();
+	uint64_t getAlignment(Type type);
 	Value getArgument(size_t index);
 	BasicBlock getCurrentBlock();
 	void setInsertPoint(BasicBlock destBlock);
 
 	bool createType(const ValueType& type, Type& result);
+	bool createStructValueType(StructType structType, const ValueType& type, Type& result);
+	bool createSoaType(const std::vector<Type>& memberTypes, const ValueType& type, Type& result);
+	bool createSliceType(Type elementType, Type& result);
 	bool createStructType(const std::string& name, StructType& result);
-	bool createStructMember(const std::vector<Type>& typeList, StructType dest);
 	bool createFunctionType(Type returnType, const std::vector<Type>& argumentTypes, bool hasVariableArguments, FunctionType& result);
 	bool createFunctionDeclare(FunctionType functionType, const std::string& name, Function& result);
+	bool setInlining(Function function, Inlining inlining);
+	bool setMemoryEffect(Function function, MemoryEffect memoryEffect);
+	bool setNoUnwind(Function function);
+	bool setReferenceArgument(Function function, unsigned int index);
+	bool setReferenceReturn(Function function);
 	bool createBasicBlock(const Function& function, const BasicBlock& insertBefore, BasicBlock& result);
 	bool createIf(const Value& condition, const BasicBlock& blockTrue, const BasicBlock& blockFalse);
 	bool createGoto(const BasicBlock& dest);
+	bool createUnreachable();
 	bool createReturnVoid();
 	bool createReturn(Value value);
 	bool createNegate(Token::Type valueType, Value value, Value& result);
@@ -78,8 +222,9 @@ public:
 	bool createCommpareGreaterEqual(Token::Type valueType, Value lhs, Value rhs, Value& result);
 	bool createCommpareEqual(Token::Type valueType, Value lhs, Value rhs, Value& result);
 	bool createCommpareNotEqual(Token::Type valueType, Value lhs, Value rhs, Value& result);
-	bool createLogicalOr(Token::Type valueType, Value lhs, Value rhs, Value& result);
-	bool createLogicalAnd(Token::Type valueType, Value lhs, Value rhs, Value& result);
+	bool createLogicalOr(Value lhs, Value rhs, Value& result);
+	bool createLogicalAnd(Value lhs, Value rhs, Value& result);
+	bool createPhi(const std::vector<std::pair<Value, BasicBlock>>& incomings, Value& result);
 	bool createBooleanConstant(bool b, Constant& result);
 	bool createI8Constant(uint32_t value, Constant& result);
 	bool createI16Constant(int64_t value, Constant& result);
@@ -98,19 +243,61 @@ public:
 	bool createBitCast(Value src, Type destType, Value& result);
 	bool createCall(Function f, const std::vector<Value>& values, Value& result);
 	bool createCallMalloc(Type type, Value& result);
+	bool createStackObject(Type type, Value& result);
+	bool createRegionObject(Type type, Value region, Value& result);
+	bool isUnboxedReference(Type type) const;
+	bool createUnboxedReference(Type type, Value value, Value& result);
+	bool createEnterRegion(Value& result);
+	bool createExitRegion(Value region);
+	bool createRetain(Value object);
+	bool createRelease(Value object);
+	void setReferenceMembers(StructType type, const std::vector<bool>& isReference);
+	bool containsReference(Type type, bool isReference) const;
+	bool createRetainMembers(Value ptr, bool isReference);
+	bool createReleaseMembers(Value ptr, bool isReference);
+	void addPinnedObject(Value object);
+	bool optimizeReferenceCounting(Function function);
 	bool createAlloc(Type type, Value& result);
+	bool createLocalCopy(Value value, Value& result);
 	bool createStore(Value value, Value destPtr);
 	bool createLoad(Value srcPtr, Value& resultValue);
+	bool createReferenceLoad(Value srcPtr, Value& resultValue);
 	bool createInitializeObject(Value object, Value initializer);
 	bool createGetArrayElement(const Type& type, const Value& array, uint64_t index, Value& result);
+	bool createElementPointer(Value array, Value index, Value& result);
+	bool createMemberPointer(Value object, size_t index, Value& result);
+	bool createColumnElementPointer(Value array, size_t column, Value index, Value& result);
+	bool createBoundsCheck(Value index, Value size);
+	bool createRangeCheck(Value begin, Value end, Value size);
+	bool createPointerOffset(Value ptr, Value index, Value& result);
+	bool createSlice(Value data, Value length, Value& result);
+	bool createSliceData(Value slice, Value& result);
+	bool createSliceLength(Value slice, Value& result);
+	bool createSliceLengthPointer(Value slicePtr, Value& result);
 	bool createPtrType(const Type& type, Type& result);
-	bool createGlobalVariable(const Type& type, const Constant& value, Value& result);
+	bool createGlobalConstant(Value value, Value& result);
+	bool createVariable(Type type, bool isReference, Variable& result);
+	bool writeVariable(Variable variable, Value value);
+	bool readVariable(Variable variable, Value& result);
+	void unsealBlock(BasicBlock block);
+	bool sealBlock(BasicBlock block);
+	void clearVariables();
+	bool createTierStub(Function function);
+	bool createIncrementTierCounter();
+	bool createDebugFunction(Function function, const Token& name);
+	bool createDebugParameter(const Token& name, const ValueType& type, unsigned int index, Value value);
+	bool createDebugLocalVariable(const Token& name, const ValueType& type, Value ptr);
+	bool createDebugVariable(const Token& name, const ValueType& type, Variable variable);
+	void setDebugLocation(const Token& token);
+	void finishDebugFunction();
+	bool finalizeDebugInfo();
 
 private:
 	class BuiltInObjectTypes {
 	public:
 		bool init(Generator& g);
 		StructType getType(Token::Type type) const;
+		bool contains(llvm::Type* type) const;
 
 	private:
 		StructType types_[static_cast<size_t>(Token::Type::TYPE_F64) - static_cast<size_t>(Token::Type::TYPE_BOOL) + 1];
@@ -123,17 +310,104 @@ private:
 	std::string currentPackageName_;
 	ValueType currentReturnType_;
 	Function fMalloc_;
+	Function fFree_;
+	Function fRetain_;
+	Function fRelease_;
+	Function fAllocate_;
+	Function fDeallocate_;
+	Function fNew_;
+	Function fAllocateInRegion_;
+	Function fEnterRegion_;
+	Function fExitRegion_;
+	Function fBoundsFail_;
+	StructType regionType_;
 	BuiltInObjectTypes builtInObjectTypes_;
+	std::string targetCpu_;
+	std::string targetFeatures_;
+	Allocator allocator_;
+	bool isHeapStatistics_;
+	bool isCompactObjects_;
+	std::string profileGeneratePath_;
+	std::string profileUsePath_;
+	bool isTieredCompilation_;
+	bool isFlatten_;
+	std::vector<std::string> tieredFunctionNames_;
+	std::map<Function, llvm::GlobalVariable*> tierStubs_;
+	std::map<Function, llvm::GlobalVariable*> tierCounters_;
+	std::map<Constant, llvm::GlobalVariable*> constantPool_;
+	std::map<StructType, std::vector<bool>> referenceMembers_;
+	std::map<std::tuple<Type, bool, bool>, Function> membersFunctions_;
+	std::map<Type, Function> objectReleaseFunctions_;
+	std::set<llvm::Value*> pinnedObjects_;
+	llvm::DICompileUnit::DebugEmissionKind debugEmissionKind_;
+	std::string sourceDirectory_;
+	std::unique_ptr<llvm::DIBuilder> debugBuilder_;
+	llvm::DICompileUnit* debugCompileUnit_;
+	llvm::DIFile* debugFile_;
+	llvm::DISubprogram* currentSubprogram_;
+
+	std::vector<std::unique_ptr<VariableState>> variables_;
+	std::set<BasicBlock> unsealedBlocks_;
+	std::map<BasicBlock, std::vector<std::pair<Variable, llvm::PHINode*>>> incompletePhis_;
 
-	// see also createStructMember()
+	// the layout of a built-in object, see BuiltInObjectTypes::init();
+	// a struct has the reference count only, followed by its members (see StructNode::generateMember())
 	const unsigned int kReferenceCountMemberIndex = 0;
 	const unsigned int kTypeIdMemberIndex = 1;
 	const unsigned int kStructEntityMemberIndex = 2;
 
+	// see createSliceType()
+	const unsigned int kSliceDataMemberIndex = 0;
+	const unsigned int kSliceLengthMemberIndex = 1;
+
+	// objects up to kMaxPooledObjectSize are taken from the free list of their size class,
+	// and a free list is refilled from a slab of kSlabSize bytes allocated with malloc
+	const uint64_t kSizeClassGranularity = 8;
+	const uint64_t kMaxPooledObjectSize = 256;
+	const uint64_t kSlabSize = 64 * 1024;
+
+	// objects on the stack or in a region are freed with their frame or region, not by the reference count,
+	// so their count starts high enough never to be released to zero
+	const uint64_t kPinnedReferenceCount = 1ull << 62;
+	const uint64_t kCompactPinnedReferenceCount = 1ull << 30;
+	const uint64_t kRegionChunkSize = 64 * 1024;
+
+	// aggregates larger than this are stored with llvm.memset and llvm.memcpy, see createAggregateStore()
+	const uint64_t kMemIntrinsicThreshold = 64;
+
 	bool getType(Token::Type, Generator::Type&);
 	bool createReferenceType(Token::Type, Type&);
 	bool createBuiltInCode();
 	bool createMallocDeclare();
+	bool createReferenceCountingFunctions();
+	bool createReleaseFunctionBody(Function function, Function membersFunction);
+	bool createReferenceCount(llvm::IRBuilder<>& builder, Value object, bool isRetain);
+	bool isReferenceMember(StructType type, unsigned int index) const;
+	bool createMembersCall(Value ptr, bool isReference, bool isRetain);
+	bool getMembersFunction(Type type, bool isReference, bool isRetain, Function& result);
+	bool createMembersCode(llvm::IRBuilder<>& builder, Value ptr, Type type, bool isReference, bool isRetain);
+	bool getObjectReleaseFunction(Type type, Function& result);
+	bool isPinnedObject(Value object, std::set<llvm::Value*>& visited) const;
+	bool createAllocatorFunctions();
+	bool createRegionFunctions();
+	bool createBoundsFailFunction();
+	bool createCheck(Value condition, Value index, Value size);
+	bool createAggregateStore(Value value, Value destPtr);
+	bool isUnclobberedLoad(Value value);
+	bool createHeapStatistics(llvm::GlobalVariable*& allocations, llvm::GlobalVariable*& deallocations, llvm::GlobalVariable*& slabs);
+	bool createRuntimeFunction(FunctionType functionType, const std::string& name, Function& result);
+	llvm::GlobalVariable* createRuntimeVariable(Type type, const std::string& name);
 	bool createTruncOrExt(Value&, Type, Value&);
 	bool createSizeOf(Type, Value&);
+	uint64_t getReferencedObjectSize(Type);
+	Constant getPinnedReferenceCount();
+	bool createDebugCompileUnit();
+	Value readVariable(Variable, BasicBlock);
+	Value readVariableRecursive(Variable, BasicBlock);
+	Value addPhiOperands(Variable, llvm::PHINode*);
+	Value tryRemoveTrivialPhi(llvm::PHINode*);
+	llvm::PHINode* createVariablePhi(Variable, BasicBlock);
+	void createReferenceAssumption(llvm::PHINode* phi);
+	void createDebugValue(Variable, Value, BasicBlock, llvm::Instruction*);
+	llvm::DIType* getDebugType(const ValueType& type);
 };
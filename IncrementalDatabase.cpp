@@ -0,0 +1,122 @@
+#include "IncrementalDatabase.h"
+#include <set>
+#include <sstream>
+#include "Node.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/SHA1.h"
+#include "llvm/Support/raw_ostream.h"
+
+extern std::vector<std::string> debugLogs;
+
+namespace {
+	void debugLog(size_t line) {
+		std::stringstream ss;
+		ss << __FILE__ << ":" << line;
+		debugLogs.push_back(ss.str());
+	}
+
+	const char* const kEntryExtension = ".bc";
+
+	void update(llvm::SHA1& hasher, const std::string& value) {
+		// length prefixes keep ("ab", "c") and ("a", "bc") apart
+		hasher.update(std::to_string(value.size()) + ":");
+		hasher.update(value);
+	}
+}
+
+bool IncrementalDatabase::init() {
+	if (llvm::sys::fs::create_directories(directory_)) {
+		debugLog(__LINE__);
+		return true;
+	}
+	return false;
+}
+
+bool IncrementalDatabase::computeFingerprint(const Context& ctx, const FunctionNode& function, const std::vector<std::string>& parameters, std::string& result) const {
+	if (function.getSourceTokens().empty()) {
+		debugLog(__LINE__);
+		return true;
+	}
+
+	llvm::SHA1 hasher;
+	for (auto& parameter : parameters) {
+		update(hasher, parameter);
+	}
+
+	// a struct layout change alters member offsets in every function, so all structs take part
+	for (auto& cu : ctx.getCompileUnits()) {
+		for (auto& s : cu.getStructs()) {
+			update(hasher, s.getSourceTokens());
+		}
+	}
+
+	update(hasher, function.getSourceTokens());
+
+	// the stored definition has its callees inlined and their attributes inferred,
+	// so every function reachable through calls takes part, in name order
+	std::set<std::string> reachable;
+	std::vector<const FunctionNode*> pending = { &function };
+	while (!pending.empty()) {
+		auto f = pending.back();
+		pending.pop_back();
+		for (auto& name : f->getCallees()) {
+			if (!reachable.insert(name).second) {
+				continue;
+			}
+			auto callee = ctx.getFunctionNode(name);
+			if (callee) {
+				pending.push_back(callee);
+			}
+		}
+	}
+	for (auto& name : reachable) {
+		update(hasher, name);
+		auto callee = ctx.getFunctionNode(name);
+		update(hasher, callee ? callee->getSourceTokens() : "");
+	}
+
+	result = llvm::toHex(hasher.final(), true);
+	return false;
+}
+
+std::string IncrementalDatabase::getEntryPath(const std::string& fingerprint) const {
+	llvm::SmallString<256> path(directory_);
+	llvm::sys::path::append(path, fingerprint + kEntryExtension);
+	return path.str().str();
+}
+
+bool IncrementalDatabase::contains(const std::string& fingerprint) const {
+	return llvm::sys::fs::exists(getEntryPath(fingerprint));
+}
+
+bool IncrementalDatabase::store(const std::string& fingerprint, const llvm::SmallVectorImpl<char>& bitcode) {
+	llvm::SmallString<256> model(directory_);
+	llvm::sys::path::append(model, fingerprint + "-%%%%%%%%.tmp");
+
+	int fd;
+	llvm::SmallString<256> temporaryPath;
+	if (llvm::sys::fs::createUniqueFile(model, fd, temporaryPath)) {
+		debugLog(__LINE__);
+		return true;
+	}
+
+	bool error;
+	{
+		llvm::raw_fd_ostream stream(fd, true);
+		stream.write(bitcode.data(), bitcode.size());
+		stream.close();
+		error = stream.has_error();
+		stream.clear_error();
+	}
+
+	// the fingerprint names the content, so a concurrent writer of the same entry publishes identical bytes
+	if (error || llvm::sys::fs::rename(temporaryPath, getEntryPath(fingerprint))) {
+		llvm::sys::fs::remove(temporaryPath);
+		debugLog(__LINE__);
+		return true;
+	}
+
+	return false;
+}
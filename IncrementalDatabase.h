@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "llvm/ADT/SmallVector.h"
+
+class Context;
+class FunctionNode;
+
+// Per-function store of optimized bitcode for incremental rebuilds.
+// A function is fingerprinted from its own tokens, the tokens of every function it reaches through calls,
+// every struct definition and the compile parameters, so an unchanged fingerprint means the stored
+// definition can be linked in instead of being generated and optimized again.
+class IncrementalDatabase
+{
+public:
+	IncrementalDatabase(const std::string& directory) : directory_(directory) {}
+	~IncrementalDatabase() = default;
+
+	bool init();
+	bool computeFingerprint(const Context& ctx, const FunctionNode& function, const std::vector<std::string>& parameters, std::string& result) const;
+	bool contains(const std::string& fingerprint) const;
+	bool store(const std::string& fingerprint, const llvm::SmallVectorImpl<char>& bitcode);
+	std::string getEntryPath(const std::string& fingerprint) const;
+
+private:
+	std::string directory_;
+};
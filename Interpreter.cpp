@@ -0,0 +1,434 @@
+#include "Interpreter.h"
+#include <cmath>
+#include "llvm/ADT/APInt.h"
+#include "Node.h"
+
+namespace {
+	// enough for table and hash computations, small enough not to be noticed when a loop does not terminate
+	const size_t kMaxSteps = 1000000;
+	const size_t kMaxCallDepth = 64;
+
+	unsigned int getBitWidth(Token::Type type) {
+		switch (type) {
+		case Token::Type::TYPE_I8:
+		case Token::Type::TYPE_U8:
+			return 8;
+		case Token::Type::TYPE_I16:
+		case Token::Type::TYPE_U16:
+			return 16;
+		case Token::Type::TYPE_I32:
+		case Token::Type::TYPE_U32:
+			return 32;
+		default:
+			return 64;
+		}
+	}
+
+	llvm::APInt toAPInt(const Interpreter::Value& value) {
+		return llvm::APInt(getBitWidth(value.type), static_cast<uint64_t>(value.constant.i), Token::isSignedIntegerType(value.type));
+	}
+
+	// integers are kept sign extended for signed types and zero extended for unsigned types
+	void setInteger(const llvm::APInt& value, Token::Type type, Interpreter::Value& result) {
+		result.type = type;
+		result.constant.type = Token::Type::CONSTANT_INTEGER;
+		result.constant.i = Token::isSignedIntegerType(type) ? value.getSExtValue() : static_cast<int64_t>(value.getZExtValue());
+	}
+
+	void setFloat(double value, Token::Type type, Interpreter::Value& result) {
+		result.type = type;
+		result.constant.type = Token::Type::CONSTANT_FLOAT;
+		result.constant.d = (type == Token::Type::TYPE_F32) ? static_cast<double>(static_cast<float>(value)) : value;
+	}
+
+	void setBool(bool value, Interpreter::Value& result) {
+		result.type = Token::Type::TYPE_BOOL;
+		result.constant.type = Token::Type::CONSTANT_BOOL;
+		result.constant.b = value;
+	}
+
+	bool evaluateInteger(Token::Type operatorType, const Interpreter::Value& lhs, const Interpreter::Value& rhs, Interpreter::Value& result) {
+		llvm::APInt l = toAPInt(lhs);
+		llvm::APInt r = toAPInt(rhs);
+		bool isSigned = Token::isSignedIntegerType(lhs.type);
+
+		switch (operatorType) {
+		case Token::Type::PLUS:
+			setInteger(l + r, lhs.type, result);
+			return false;
+		case Token::Type::MINUS:
+			setInteger(l - r, lhs.type, result);
+			return false;
+		case Token::Type::ASTERISK:
+			setInteger(l * r, lhs.type, result);
+			return false;
+		case Token::Type::SLASH:
+		case Token::Type::PERCENT:
+			// both are undefined behavior of the instructions
+			if (r.isNullValue() || (isSigned && l.isMinSignedValue() && r.isAllOnesValue())) {
+				return true;
+			}
+			if (operatorType == Token::Type::SLASH) {
+				setInteger(isSigned ? l.sdiv(r) : l.udiv(r), lhs.type, result);
+			}
+			else {
+				setInteger(isSigned ? l.srem(r) : l.urem(r), lhs.type, result);
+			}
+			return false;
+		case Token::Type::COMPARE_LESSER_THAN:
+			setBool(isSigned ? l.slt(r) : l.ult(r), result);
+			return false;
+		case Token::Type::COMPARE_LESSER_EQUAL:
+			setBool(isSigned ? l.sle(r) : l.ule(r), result);
+			return false;
+		case Token::Type::COMPARE_GREATER_THAN:
+			setBool(isSigned ? l.sgt(r) : l.ugt(r), result);
+			return false;
+		case Token::Type::COMPARE_GREATER_EQUAL:
+			setBool(isSigned ? l.sge(r) : l.uge(r), result);
+			return false;
+		case Token::Type::COMPARE_EQUAL:
+			setBool(l == r, result);
+			return false;
+		case Token::Type::COMPARE_NOT_EQUAL:
+			setBool(l != r, result);
+			return false;
+		default:
+			return true;
+		}
+	}
+
+	bool evaluateFloat(Token::Type operatorType, const Interpreter::Value& lhs, const Interpreter::Value& rhs, Interpreter::Value& result) {
+		// f32 operations are done in double and rounded, which gives the same result for + - * / and %
+		double l = lhs.constant.d;
+		double r = rhs.constant.d;
+
+		switch (operatorType) {
+		case Token::Type::PLUS:
+			setFloat(l + r, lhs.type, result);
+			return false;
+		case Token::Type::MINUS:
+			setFloat(l - r, lhs.type, result);
+			return false;
+		case Token::Type::ASTERISK:
+			setFloat(l * r, lhs.type, result);
+			return false;
+		case Token::Type::SLASH:
+			setFloat(l / r, lhs.type, result);
+			return false;
+		case Token::Type::PERCENT:
+			setFloat(std::fmod(l, r), lhs.type, result);
+			return false;
+		// the generator emits ordered comparisons, which are false for NaN
+		case Token::Type::COMPARE_LESSER_THAN:
+			setBool(l < r, result);
+			return false;
+		case Token::Type::COMPARE_LESSER_EQUAL:
+			setBool(l <= r, result);
+			return false;
+		case Token::Type::COMPARE_GREATER_THAN:
+			setBool(l > r, result);
+			return false;
+		case Token::Type::COMPARE_GREATER_EQUAL:
+			setBool(l >= r, result);
+			return false;
+		case Token::Type::COMPARE_EQUAL:
+			setBool(l == r, result);
+			return false;
+		case Token::Type::COMPARE_NOT_EQUAL:
+			setBool((l < r) || (l > r), result);
+			return false;
+		default:
+			return true;
+		}
+	}
+
+	bool castFloatToInteger(double value, Token::Type destType, Interpreter::Value& result) {
+		// out of range values are poison for fptosi and fptoui
+		if (std::isnan(value)) {
+			return true;
+		}
+		double truncated = std::trunc(value);
+		unsigned int width = getBitWidth(destType);
+		if (Token::isSignedIntegerType(destType)) {
+			double limit = std::ldexp(1.0, width - 1);
+			if ((truncated < -limit) || (limit <= truncated)) {
+				return true;
+			}
+			setInteger(llvm::APInt(width, static_cast<uint64_t>(static_cast<int64_t>(truncated)), true), destType, result);
+		}
+		else {
+			double limit = std::ldexp(1.0, width);
+			if ((truncated < 0.0) || (limit <= truncated)) {
+				return true;
+			}
+			setInteger(llvm::APInt(width, static_cast<uint64_t>(truncated), false), destType, result);
+		}
+		return false;
+	}
+}
+
+Interpreter::Interpreter(const Context& ctx) : ctx_(ctx), steps_(0) {
+	// the arguments of the outermost call are evaluated in a frame without variables
+	Frame frame;
+	frame.returnType = Token::Type::UNDEFINED;
+	frame.isReturned = false;
+	frame.isBreaked = false;
+	frame.scopes.emplace_back();
+	frames_.push_back(frame);
+}
+
+bool Interpreter::call(const FunctionNode& function, const std::vector<Value>& arguments, Value& result) {
+	if (!function.isConst() || (function.getBlock() == nullptr) || (frames_.size() >= kMaxCallDepth)) {
+		return true;
+	}
+
+	auto& parameters = function.getArguments();
+	if (parameters.size() != arguments.size()) {
+		return true;
+	}
+
+	Frame frame;
+	frame.returnType = function.getReturnType().getValueType().basicType;
+	frame.isReturned = false;
+	frame.isBreaked = false;
+	frame.scopes.emplace_back();
+	for (size_t i = 0; i < parameters.size(); i++) {
+		Value value;
+		if (convert(arguments[i], parameters[i].getValueType().basicType, value)) {
+			return true;
+		}
+		frame.scopes.back().push_back(Variable({ parameters[i].getName().getString(), value, true }));
+	}
+
+	frames_.push_back(frame);
+	bool error = function.getBlock()->execute(*this);
+	Frame finished = frames_.back();
+	frames_.pop_back();
+
+	if (error || !finished.isReturned) {
+		return true;
+	}
+
+	result = finished.returnValue;
+	return false;
+}
+
+bool Interpreter::step() {
+	steps_++;
+	return steps_ > kMaxSteps;
+}
+
+void Interpreter::addScope() {
+	frames_.back().scopes.emplace_back();
+}
+
+void Interpreter::removeScope() {
+	frames_.back().scopes.pop_back();
+}
+
+bool Interpreter::addVariable(const std::string& name, const Value& value) {
+	if (Token::isConstant(value.type)) {
+		return true;
+	}
+	frames_.back().scopes.back().push_back(Variable({ name, value, false }));
+	return false;
+}
+
+bool Interpreter::getVariable(const std::string& name, Value& result) const {
+	auto& scopes = frames_.back().scopes;
+	for (auto scope = scopes.rbegin(); scope != scopes.rend(); ++scope) {
+		for (auto variable = scope->rbegin(); variable != scope->rend(); ++variable) {
+			if (variable->name == name) {
+				result = variable->value;
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+bool Interpreter::setVariable(const std::string& name, const Value& value) {
+	auto& scopes = frames_.back().scopes;
+	for (auto scope = scopes.rbegin(); scope != scopes.rend(); ++scope) {
+		for (auto variable = scope->rbegin(); variable != scope->rend(); ++variable) {
+			if (variable->name == name) {
+				if (variable->isArgument) {
+					return true;
+				}
+				return convert(value, variable->value.type, variable->value);
+			}
+		}
+	}
+	return true;
+}
+
+bool Interpreter::setReturnValue(const Value& value) {
+	auto& frame = frames_.back();
+	if (convert(value, frame.returnType, frame.returnValue)) {
+		return true;
+	}
+	frame.isReturned = true;
+	return false;
+}
+
+bool Interpreter::evaluateBinaryOperation(Token::Type operatorType, const Value& lhs, const Value& rhs, Value& result) {
+	if (Token::isConstant(lhs.type) && Token::isConstant(rhs.type)) {
+		if (ConstantEvaluator::evaluateBinaryOperation(operatorType, lhs.constant, rhs.constant, result.constant) != ConstantEvaluator::Status::OK) {
+			return true;
+		}
+		result.type = result.constant.type;
+		return false;
+	}
+
+	// a literal takes the type of the other operand, as castConstantToValueType does
+	Value l = lhs;
+	Value r = rhs;
+	if (Token::isConstant(lhs.type) && convert(lhs, rhs.type, l)) {
+		return true;
+	}
+	if (Token::isConstant(rhs.type) && convert(rhs, lhs.type, r)) {
+		return true;
+	}
+	if (l.type != r.type) {
+		return true;
+	}
+
+	if (l.type == Token::Type::TYPE_BOOL) {
+		if (operatorType == Token::Type::COMPARE_EQUAL) {
+			setBool(l.constant.b == r.constant.b, result);
+			return false;
+		}
+		if (operatorType == Token::Type::COMPARE_NOT_EQUAL) {
+			setBool(l.constant.b != r.constant.b, result);
+			return false;
+		}
+		return true;
+	}
+	if (Token::isIntegerType(l.type)) {
+		return evaluateInteger(operatorType, l, r, result);
+	}
+	if (Token::isFloatingPointType(l.type)) {
+		return evaluateFloat(operatorType, l, r, result);
+	}
+	return true;
+}
+
+bool Interpreter::evaluateUnaryOperation(Token::Type operatorType, const Value& value, Value& result) {
+	if (operatorType != Token::Type::MINUS) {
+		return true;
+	}
+
+	if (Token::isConstant(value.type)) {
+		if (ConstantEvaluator::evaluateUnaryOperation(operatorType, value.constant, result.constant) != ConstantEvaluator::Status::OK) {
+			return true;
+		}
+		result.type = result.constant.type;
+		return false;
+	}
+	if (Token::isIntegerType(value.type)) {
+		setInteger(-toAPInt(value), value.type, result);
+		return false;
+	}
+	if (Token::isFloatingPointType(value.type)) {
+		setFloat(-value.constant.d, value.type, result);
+		return false;
+	}
+	return true;
+}
+
+bool Interpreter::convert(const Value& value, Token::Type destType, Value& result) {
+	if (value.type == destType) {
+		result = value;
+		return false;
+	}
+
+	switch (value.type) {
+	case Token::Type::CONSTANT_BOOL:
+		if (destType != Token::Type::TYPE_BOOL) {
+			return true;
+		}
+		setBool(value.constant.b, result);
+		return false;
+	case Token::Type::CONSTANT_INTEGER:
+		if (!ConstantEvaluator::isRepresentable(value.constant.i, destType)) {
+			return true;
+		}
+		result = value;
+		result.type = destType;
+		return false;
+	case Token::Type::CONSTANT_FLOAT:
+		if (!Token::isFloatingPointType(destType)) {
+			return true;
+		}
+		setFloat(value.constant.d, destType, result);
+		return false;
+	default:
+		return true;
+	}
+}
+
+bool Interpreter::cast(const Value& value, Token::Type destType, Value& result) {
+	// same conversions as Generator::createCast
+	Value src = value;
+	if (src.type == Token::Type::CONSTANT_INTEGER) {
+		// a literal is signed, see ConstantEvaluator
+		src.type = Token::Type::TYPE_I64;
+	}
+	else if (src.type == Token::Type::CONSTANT_FLOAT) {
+		src.type = Token::Type::TYPE_F64;
+	}
+
+	if (src.type == destType) {
+		result = src;
+		return false;
+	}
+
+	if (Token::isFloatingPointType(src.type)) {
+		if (Token::isFloatingPointType(destType)) {
+			setFloat(src.constant.d, destType, result);
+			return false;
+		}
+		if (Token::isIntegerType(destType)) {
+			return castFloatToInteger(src.constant.d, destType, result);
+		}
+		return true;
+	}
+
+	if (Token::isIntegerType(src.type)) {
+		if (Token::isFloatingPointType(destType)) {
+			// converted directly so that f32 is rounded once
+			if (destType == Token::Type::TYPE_F32) {
+				float f = Token::isSignedIntegerType(src.type) ? static_cast<float>(src.constant.i) : static_cast<float>(static_cast<uint64_t>(src.constant.i));
+				setFloat(f, destType, result);
+			}
+			else {
+				double d = Token::isSignedIntegerType(src.type) ? static_cast<double>(src.constant.i) : static_cast<double>(static_cast<uint64_t>(src.constant.i));
+				setFloat(d, destType, result);
+			}
+			return false;
+		}
+		if (Token::isIntegerType(destType)) {
+			// createTruncOrExt zero extends
+			setInteger(toAPInt(src).zextOrTrunc(getBitWidth(destType)), destType, result);
+			return false;
+		}
+		return true;
+	}
+
+	return true;
+}
+
+Token::Type Interpreter::getDefaultType(Token::Type constantType) {
+	// same as the types LetNode gives to variables without a type
+	switch (constantType) {
+	case Token::Type::CONSTANT_BOOL:
+		return Token::Type::TYPE_BOOL;
+	case Token::Type::CONSTANT_INTEGER:
+		return Token::Type::TYPE_I32;
+	case Token::Type::CONSTANT_FLOAT:
+		return Token::Type::TYPE_F64;
+	default:
+		return constantType;
+	}
+}
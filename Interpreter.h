@@ -0,0 +1,82 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "Token.h"
+#include "ConstantEvaluator.h"
+
+class Context;
+class FunctionNode;
+
+// Evaluates calls of const functions at compile time by walking their syntax trees.
+// Values follow the instructions the generator would emit, e.g. integers wrap around at the width of their type,
+// so a call replaced by its result behaves exactly as the call would have.
+// Whatever the generated code leaves undefined (division by zero, out of range float to integer casts),
+// and calls that do not finish within the step limit, fail the evaluation and the call is left to run time.
+class Interpreter
+{
+public:
+	struct Value {
+		// TYPE_BOOL, an integer or floating point type, or CONSTANT_BOOL, CONSTANT_INTEGER, CONSTANT_FLOAT for literals
+		Token::Type type;
+		ConstantValue constant;
+
+		Value() : type(Token::Type::UNDEFINED) {}
+	};
+
+	Interpreter(const Context& ctx);
+	~Interpreter() = default;
+
+	bool call(const FunctionNode& function, const std::vector<Value>& arguments, Value& result);
+
+	const Context& getContext() const {
+		return ctx_;
+	}
+
+	bool step();
+
+	void addScope();
+	void removeScope();
+	bool addVariable(const std::string& name, const Value& value);
+	bool getVariable(const std::string& name, Value& result) const;
+	bool setVariable(const std::string& name, const Value& value);
+
+	bool setReturnValue(const Value& value);
+
+	bool isReturned() const {
+		return frames_.back().isReturned;
+	}
+
+	void setBreaked(bool flag) {
+		frames_.back().isBreaked = flag;
+	}
+
+	bool isBreaked() const {
+		return frames_.back().isBreaked;
+	}
+
+	static bool evaluateBinaryOperation(Token::Type operatorType, const Value& lhs, const Value& rhs, Value& result);
+	static bool evaluateUnaryOperation(Token::Type operatorType, const Value& value, Value& result);
+	static bool convert(const Value& value, Token::Type destType, Value& result);
+	static bool cast(const Value& value, Token::Type destType, Value& result);
+	static Token::Type getDefaultType(Token::Type constantType);
+
+private:
+	struct Variable {
+		std::string name;
+		Value value;
+		bool isArgument;
+	};
+
+	struct Frame {
+		std::vector<std::vector<Variable>> scopes;
+		Token::Type returnType;
+		Value returnValue;
+		bool isReturned;
+		bool isBreaked;
+	};
+
+	const Context& ctx_;
+	std::vector<Frame> frames_;
+	size_t steps_;
+};
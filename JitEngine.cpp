@@ -0,0 +1,330 @@
+#include "JitEngine.h"
+#include <chrono>
+#include <sstream>
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
+#include "llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h"
+#include "llvm/ExecutionEngine/Orc/RTDyldObjectLinkingLayer.h"
+#include "llvm/ExecutionEngine/SectionMemoryManager.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+extern std::vector<std::string> debugLogs;
+
+namespace {
+	void debugLog(size_t line) {
+		std::stringstream ss;
+		ss << __FILE__ << ":" << line;
+		debugLogs.push_back(ss.str());
+	}
+
+	const unsigned int kTier1OptimizationLevel = 3;
+	const std::chrono::milliseconds kWatchInterval(10);
+}
+
+JitEngine::~JitEngine() {
+	isStopped_ = true;
+	if (watcher_.joinable()) {
+		watcher_.join();
+	}
+}
+
+bool JitEngine::init() {
+	llvm::InitializeNativeTarget();
+	llvm::InitializeNativeTargetAsmPrinter();
+
+	if (isPerfSupported_) {
+		// promoted code is told apart from the tier 0 code of the same function by its name
+		tier0PerfMap_ = std::make_unique<PerfMapListener>("");
+		tier1PerfMap_ = std::make_unique<PerfMapListener>(" [tier 1]");
+		if (tier0PerfMap_->init() || tier1PerfMap_->init()) {
+			debugLog(__LINE__);
+			return true;
+		}
+
+		// owned by LLVM, and null when LLVM is built without perf support
+		perfJitDumpListener_ = llvm::JITEventListener::createPerfJITEventListener();
+	}
+
+	if (createJit(llvm::CodeGenOpt::None, false, tier0PerfMap_.get(), tier0_) ||
+		createJit(llvm::CodeGenOpt::Aggressive, true, tier1PerfMap_.get(), tier1_))
+	{
+		debugLog(__LINE__);
+		return true;
+	}
+
+	llvm::orc::JITTargetMachineBuilder builder(llvm::Triple(""));
+	if (createTargetMachineBuilder(llvm::CodeGenOpt::Aggressive, true, builder)) {
+		debugLog(__LINE__);
+		return true;
+	}
+	auto targetMachine = builder.createTargetMachine();
+	if (!targetMachine) {
+		llvm::consumeError(targetMachine.takeError());
+		debugLog(__LINE__);
+		return true;
+	}
+	tier1TargetMachine_ = std::move(*targetMachine);
+
+	return false;
+}
+
+// tier 1 compiles for the target given by setTarget(), as the ahead-of-time compilation does
+bool JitEngine::createTargetMachineBuilder(llvm::CodeGenOpt::Level level, bool isTier1, llvm::orc::JITTargetMachineBuilder& result) {
+	auto builder = llvm::orc::JITTargetMachineBuilder::detectHost();
+	if (!builder) {
+		llvm::consumeError(builder.takeError());
+		debugLog(__LINE__);
+		return true;
+	}
+	builder->setCodeGenOptLevel(level);
+	if (isTier1) {
+		if (!targetCpu_.empty()) {
+			builder->setCPU(targetCpu_);
+		}
+		builder->getFeatures() = llvm::SubtargetFeatures(targetFeatures_);
+	}
+
+	result = std::move(*builder);
+	return false;
+}
+
+bool JitEngine::createJit(llvm::CodeGenOpt::Level level, bool isTier1, PerfMapListener* perfMap, std::unique_ptr<llvm::orc::LLJIT>& result) {
+	llvm::orc::JITTargetMachineBuilder builder(llvm::Triple(""));
+	if (createTargetMachineBuilder(level, isTier1, builder)) {
+		debugLog(__LINE__);
+		return true;
+	}
+
+	llvm::orc::LLJITBuilder jitBuilder;
+	jitBuilder.setJITTargetMachineBuilder(std::move(builder));
+	if (perfMap) {
+		// event listeners are only supported by the RuntimeDyld linking layer
+		std::vector<llvm::JITEventListener*> listeners = { perfMap };
+		if (perfJitDumpListener_) {
+			listeners.push_back(perfJitDumpListener_);
+		}
+		jitBuilder.setObjectLinkingLayerCreator([listeners](llvm::orc::ExecutionSession& session, const llvm::Triple&) -> llvm::Expected<std::unique_ptr<llvm::orc::ObjectLayer>> {
+			auto layer = std::make_unique<llvm::orc::RTDyldObjectLinkingLayer>(session, []() {
+				return std::make_unique<llvm::SectionMemoryManager>();
+			});
+			for (auto listener : listeners) {
+				layer->registerJITEventListener(*listener);
+			}
+			return layer;
+		});
+	}
+
+	auto jit = jitBuilder.create();
+	if (!jit) {
+		llvm::consumeError(jit.takeError());
+		debugLog(__LINE__);
+		return true;
+	}
+	result = std::move(*jit);
+
+	return addProcessSymbols(*result, result->getMainJITDylib());
+}
+
+bool JitEngine::addProcessSymbols(llvm::orc::LLJIT& jit, llvm::orc::JITDylib& dylib) {
+	// extern "C" functions and malloc are resolved from the compiler process
+	auto generator = llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(jit.getDataLayout().getGlobalPrefix());
+	if (!generator) {
+		llvm::consumeError(generator.takeError());
+		debugLog(__LINE__);
+		return true;
+	}
+	dylib.addGenerator(std::move(*generator));
+
+	return false;
+}
+
+bool JitEngine::parseModule(const llvm::SmallVectorImpl<char>& bitcode, llvm::orc::ThreadSafeModule& result) {
+	auto context = std::make_unique<llvm::LLVMContext>();
+	llvm::MemoryBufferRef buffer(llvm::StringRef(bitcode.data(), bitcode.size()), "mahina");
+	auto module = llvm::parseBitcodeFile(buffer, *context);
+	if (!module) {
+		llvm::consumeError(module.takeError());
+		debugLog(__LINE__);
+		return true;
+	}
+
+	result = llvm::orc::ThreadSafeModule(std::move(*module), std::move(context));
+	return false;
+}
+
+bool JitEngine::addTier0Module(const Generator& g) {
+	llvm::SmallVector<char, 0> bitcode;
+	if (g.writeBitcode(bitcode)) {
+		debugLog(__LINE__);
+		return true;
+	}
+
+	llvm::orc::ThreadSafeModule module;
+	if (parseModule(bitcode, module)) {
+		debugLog(__LINE__);
+		return true;
+	}
+
+	auto error = tier0_->addIRModule(std::move(module));
+	if (error) {
+		llvm::consumeError(std::move(error));
+		debugLog(__LINE__);
+		return true;
+	}
+
+	tieredFunctionNames_ = g.getTieredFunctionNames();
+
+	return false;
+}
+
+bool JitEngine::setTier1Module(const Generator& g) {
+	tier1Bitcode_.clear();
+	return g.writeBitcode(tier1Bitcode_);
+}
+
+bool JitEngine::run(const std::string& entryName, int& exitCode) {
+	tieredFunctions_.clear();
+	for (auto& name : tieredFunctionNames_) {
+		auto counter = tier0_->lookup(Generator::getTierCounterName(name));
+		if (!counter) {
+			llvm::consumeError(counter.takeError());
+			debugLog(__LINE__);
+			return true;
+		}
+		auto stub = tier0_->lookup(Generator::getTierStubName(name));
+		if (!stub) {
+			llvm::consumeError(stub.takeError());
+			debugLog(__LINE__);
+			return true;
+		}
+
+		tieredFunctions_.push_back(TieredFunction({
+			name,
+			reinterpret_cast<std::atomic<uint64_t>*>(counter->getAddress()),
+			reinterpret_cast<std::atomic<uint64_t>*>(stub->getAddress()),
+			false
+		}));
+	}
+
+	auto entry = tier0_->lookup(entryName);
+	if (!entry) {
+		llvm::consumeError(entry.takeError());
+		debugLog(__LINE__);
+		return true;
+	}
+
+	isStopped_ = false;
+	if (!tier1Bitcode_.empty()) {
+		watcher_ = std::thread(&JitEngine::watch, this);
+	}
+
+	auto f = reinterpret_cast<int (*)()>(entry->getAddress());
+	exitCode = f();
+
+	isStopped_ = true;
+	if (watcher_.joinable()) {
+		watcher_.join();
+	}
+
+	return false;
+}
+
+void JitEngine::watch() {
+	while (!isStopped_) {
+		for (auto& function : tieredFunctions_) {
+			if (function.isPromoted) {
+				continue;
+			}
+			if (function.counter->load(std::memory_order_relaxed) < threshold_) {
+				continue;
+			}
+
+			// do not retry a function that failed to compile
+			function.isPromoted = true;
+			if (promote(function)) {
+				log_ << "jit: failed to promote " << function.name << "\n";
+			}
+		}
+
+		std::this_thread::sleep_for(kWatchInterval);
+	}
+}
+
+bool JitEngine::promote(TieredFunction& function) {
+	auto start = std::chrono::steady_clock::now();
+	uint64_t count = function.counter->load(std::memory_order_relaxed);
+
+	llvm::orc::ThreadSafeModule module;
+	if (parseModule(tier1Bitcode_, module)) {
+		debugLog(__LINE__);
+		return true;
+	}
+
+	// the runtime of tier 0 is called, so that the objects, the free lists and the regions are shared with it
+	llvm::orc::SymbolMap runtimeSymbols;
+	bool error = module.withModuleDo([&](llvm::Module& m) {
+		for (auto& f : m) {
+			if (f.isDeclaration() || !Generator::isRuntime(f)) {
+				continue;
+			}
+			auto symbol = tier0_->lookup(f.getName());
+			if (!symbol) {
+				llvm::consumeError(symbol.takeError());
+				debugLog(__LINE__);
+				return true;
+			}
+			runtimeSymbols[tier1_->mangleAndIntern(f.getName())] = llvm::JITEvaluatedSymbol(symbol->getAddress(), llvm::JITSymbolFlags::Exported);
+			f.deleteBody();
+		}
+
+		// keep the other definitions for inlining, but let globaldce drop what is not reachable
+		for (auto& f : m) {
+			if (!f.isDeclaration() && (f.getName() != function.name)) {
+				f.setLinkage(llvm::GlobalValue::InternalLinkage);
+			}
+		}
+		return Generator::optimizeModule(m, tier1TargetMachine_.get(), kTier1OptimizationLevel);
+	});
+	if (error) {
+		debugLog(__LINE__);
+		return true;
+	}
+
+	auto dylib = tier1_->createJITDylib("tier1." + function.name);
+	if (!dylib) {
+		llvm::consumeError(dylib.takeError());
+		debugLog(__LINE__);
+		return true;
+	}
+	if (addProcessSymbols(*tier1_, *dylib)) {
+		debugLog(__LINE__);
+		return true;
+	}
+	auto defineError = dylib->define(llvm::orc::absoluteSymbols(std::move(runtimeSymbols)));
+	if (defineError) {
+		llvm::consumeError(std::move(defineError));
+		debugLog(__LINE__);
+		return true;
+	}
+
+	auto addError = tier1_->addIRModule(*dylib, std::move(module));
+	if (addError) {
+		llvm::consumeError(std::move(addError));
+		debugLog(__LINE__);
+		return true;
+	}
+
+	auto symbol = tier1_->lookup(*dylib, function.name);
+	if (!symbol) {
+		llvm::consumeError(symbol.takeError());
+		debugLog(__LINE__);
+		return true;
+	}
+
+	function.stub->store(symbol->getAddress(), std::memory_order_release);
+
+	auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+	log_ << "jit: " << function.name << " promoted to tier 1 (-O" << kTier1OptimizationLevel << ") after " << count << " counts in " << elapsed.count() << " ms\n";
+
+	return false;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
+#include "Generator.h"
+#include "PerfMapListener.h"
+
+// Runs a module in-process in two tiers.
+// Tier 0 is the instrumented module (see Generator::setTieredCompilation) compiled without optimization.
+// When the counter of a function reaches the threshold, a background thread compiles the function
+// from the tier 1 module at -O3 and swaps the stub of the function to the optimized code.
+class JitEngine
+{
+public:
+	JitEngine(std::ostream& log, uint64_t threshold) : log_(log), threshold_(threshold), isPerfSupported_(false), perfJitDumpListener_(nullptr), isStopped_(false) {}
+	~JitEngine();
+
+	// must be set before init(); writes /tmp/perf-<pid>.map and a jitdump file for perf inject --jit
+	void setPerfSupport(bool isSupported) {
+		isPerfSupported_ = isSupported;
+	}
+
+	// must be set before init(); see Generator::setTargetCpu() and Generator::setTargetFeatures()
+	void setTarget(const std::string& cpu, const std::string& features) {
+		targetCpu_ = cpu;
+		targetFeatures_ = features;
+	}
+
+	bool init();
+	bool addTier0Module(const Generator& g);
+	bool setTier1Module(const Generator& g);
+	bool run(const std::string& entryName, int& exitCode);
+
+private:
+	struct TieredFunction {
+		std::string name;
+		std::atomic<uint64_t>* counter;
+		std::atomic<uint64_t>* stub;
+		bool isPromoted;
+	};
+
+	std::ostream& log_;
+	uint64_t threshold_;
+	bool isPerfSupported_;
+	std::string targetCpu_;
+	std::string targetFeatures_;
+	// listeners must outlive the JITs that notify them
+	std::unique_ptr<PerfMapListener> tier0PerfMap_;
+	std::unique_ptr<PerfMapListener> tier1PerfMap_;
+	llvm::JITEventListener* perfJitDumpListener_;
+	std::unique_ptr<llvm::orc::LLJIT> tier0_;
+	std::unique_ptr<llvm::orc::LLJIT> tier1_;
+	std::unique_ptr<llvm::TargetMachine> tier1TargetMachine_;
+	llvm::SmallVector<char, 0> tier1Bitcode_;
+	std::vector<std::string> tieredFunctionNames_;
+	std::vector<TieredFunction> tieredFunctions_;
+	std::atomic<bool> isStopped_;
+	std::thread watcher_;
+
+	bool createTargetMachineBuilder(llvm::CodeGenOpt::Level level, bool isTier1, llvm::orc::JITTargetMachineBuilder& result);
+	bool createJit(llvm::CodeGenOpt::Level level, bool isTier1, PerfMapListener* perfMap, std::unique_ptr<llvm::orc::LLJIT>& result);
+	bool addProcessSymbols(llvm::orc::LLJIT& jit, llvm::orc::JITDylib& dylib);
+	bool parseModule(const llvm::SmallVectorImpl<char>& bitcode, llvm::orc::ThreadSafeModule& result);
+	bool promote(TieredFunction& function);
+	void watch();
+};
@@ -1,4 +1,5 @@
 #include "Node.h"
+#include <algorithm>
 #include <sstream>
 #include "util.h"
 #include "Tokenizer.h"
@@ -12,6 +13,78 @@ namespace {
 		debugLogs.push_back(ss.str());
 	}
 
+	// the rhs of && and || is evaluated unconditionally when it has at most this many nodes,
+	// e.g. "i < n && x != 0"; a mispredicted branch costs more than a few extra ALU operations
+	const size_t kSpeculationBudget = 5;
+
+	// body tokens of a function without calls below which it gets inlinehint, e.g. "{ return p.x * p.x; }"
+	const size_t kInlineHintBodySize = 24;
+
+	bool consumeSpeculationBudget(size_t& budget) {
+		if (budget == 0) {
+			return false;
+		}
+		budget--;
+		return true;
+	}
+
+	// bool, integer and floating point values, the only values const functions compute
+	bool isScalarType(const ValueType& type) {
+		if ((type.pointerCount != 0) || type.isReference || !type.arraySizes.empty() || type.isSlice) {
+			return false;
+		}
+		return (type.basicType == Token::Type::TYPE_BOOL) || Token::isIntegerType(type.basicType) || Token::isFloatingPointType(type.basicType);
+	}
+
+	// arrays and structs are addressed, and a reference to a struct is a pointer like the other references
+	bool isAddressedType(const ValueType& type) {
+		if (type.isSlice || (type.pointerCount != 0)) {
+			return false;
+		}
+		return !type.arraySizes.empty() || (type.isStruct() && !type.isReference);
+	}
+
+	// see EscapeAnalysis::setNumberSlice()
+	bool isNumberSliceType(const ValueType& type) {
+		return type.isSlice && (type.basicType != Token::Type::SYMBOL);
+	}
+
+	// a variable, an argument and a returned value own their reference,
+	// so a reference borrowed from a variable is retained when it is copied to one of them
+	bool createRetainIfBorrowed(Generator& g, const ExpressionNode& src, Generator::Value value) {
+		if (!src.getValueType().isReference || !src.getValueType().arraySizes.empty() || src.isOwnedReference()) {
+			return false;
+		}
+		return g.createRetain(value);
+	}
+
+	// the same for the references held by a struct or an array, which is copied to be retained in place
+	bool createRetainMembersIfBorrowed(Generator& g, Context& ctx, const ExpressionNode& src, Generator::Value value) {
+		auto& type = src.getValueType();
+		if ((type.isReference && type.arraySizes.empty()) || src.isOwnedReference() || !ctx.holdsReferences(type)) {
+			return false;
+		}
+		Generator::Value ptr;
+		return g.createLocalCopy(value, ptr) || g.createRetainMembers(ptr, type.isReference);
+	}
+
+	// releases the references held by a struct or an array that is not kept, e.g. returned by a call and discarded
+	bool createReleaseMembers(Generator& g, Context& ctx, const ValueType& type, Generator::Value value) {
+		if ((type.isReference && type.arraySizes.empty()) || !ctx.holdsReferences(type)) {
+			return false;
+		}
+		Generator::Value ptr;
+		return g.createLocalCopy(value, ptr) || g.createReleaseMembers(ptr, type.isReference);
+	}
+
+	bool getBool(const Interpreter::Value& value, bool& result) {
+		if ((value.type != Token::Type::TYPE_BOOL) && (value.type != Token::Type::CONSTANT_BOOL)) {
+			return true;
+		}
+		result = value.constant.b;
+		return false;
+	}
+
 	bool castConstantToValueType_BasicType(Generator& g, const ValueType& srcType, Generator::Value srcValue, const ValueType& destType, Generator::Value& result);
 	bool castConstantToValueType_ArrayType(Generator& g, Context& ctx, const std::shared_ptr<ExpressionNode>& src, const ValueType& destType, Generator::Value& result);
 	bool castConstantToValueType(Generator& g, Context& ctx, const std::shared_ptr<ExpressionNode>& src, const ValueType& destType, Generator::Value& result) {
@@ -27,6 +100,13 @@ namespace {
 			result = srcValue;
 		}
 		else if (srcType.arraySizes.empty()) {
+			// the literal would be truncated silently by the cast
+			if ((srcType.basicType == Token::Type::CONSTANT_INTEGER) && Token::isIntegerType(destType.basicType) && (destType.pointerCount == 0) &&
+				!ConstantEvaluator::isRepresentable(src->getConstantInteger(), destType.basicType))
+			{
+				ctx.addCompileError(std::make_shared<ConstantTooLarge>(src->getToken()));
+				return true;
+			}
 			return castConstantToValueType_BasicType(g, srcType, srcValue, destType, result);
 		}
 		else {
@@ -35,6 +115,20 @@ namespace {
 		return false;
 	}
 
+	// an array index as i64
+	bool createIndex(Generator& g, Context& ctx, const std::shared_ptr<ExpressionNode>& index, Generator::Value& result) {
+		auto& type = index->getValueType();
+		bool isInteger = Token::isIntegerType(type.basicType) || (type.basicType == Token::Type::CONSTANT_INTEGER);
+		if (!isInteger || (type.pointerCount != 0) || type.isReference || !type.arraySizes.empty()) {
+			ctx.addCompileError(std::make_shared<TypeMismatchError>(index->getToken(), ValueType(Token::Type::TYPE_I64), type));
+			return true;
+		}
+		if (type.basicType == Token::Type::CONSTANT_INTEGER) {
+			return castConstantToValueType(g, ctx, index, ValueType(Token::Type::TYPE_I64), result);
+		}
+		return g.createCast(type.basicType, index->getGeneratedValue(), Token::Type::TYPE_I64, result);
+	}
+
 	bool castConstantToValueType_BasicType(Generator& g, const ValueType& srcType, Generator::Value srcValue, const ValueType& destType, Generator::Value& result) {
 		if ((srcType.basicType == Token::Type::CONSTANT_INTEGER) && (Token::isIntegerType(destType.basicType))) {
 			if (g.createCast(srcType.basicType, srcValue, destType.basicType, result)) {
@@ -148,9 +242,17 @@ void VariableDefinitionNode::debugPrint(DebugPrinter& dp) {
 
 void VariableValueNode::debugPrint(DebugPrinter& dp) {
 	dp.o << name_.getString();
-	if (arrayIndex_) {
+	if (arrayIndex_ || isSliceRange_) {
 		dp.o << "[";
-		arrayIndex_->debugPrint(dp);
+		if (arrayIndex_) {
+			arrayIndex_->debugPrint(dp);
+		}
+		if (isSliceRange_) {
+			dp.o << ":";
+			if (sliceEnd_) {
+				sliceEnd_->debugPrint(dp);
+			}
+		}
 		dp.o << "]";
 	}
 	if (member_) {
@@ -282,6 +384,14 @@ void WhileNode::debugPrint(DebugPrinter& dp) {
 	dp.o << dp << "}";
 }
 
+void RegionNode::debugPrint(DebugPrinter& dp) {
+	dp.o << "region {\n";
+	dp.indentLevel++;
+	block_.debugPrint(dp);
+	dp.indentLevel--;
+	dp.o << dp << "}";
+}
+
 void ReturnNode::debugPrint(DebugPrinter& dp) {
 	dp.o << "return ";
 	if (value_) {
@@ -324,6 +434,12 @@ void CompileUnitNode::debugPrint(DebugPrinter& dp) {
 }
 
 void StructNode::debugPrint(DebugPrinter& dp) {
+	if (isReprC_) {
+		dp.o << "@repr(C)\n";
+	}
+	if (isSoa_) {
+		dp.o << "@soa\n";
+	}
 	dp.o << "struct " << name_.getString() << " {\n";
 	dp.indentLevel++;
 	for (auto member : members_) {
@@ -336,7 +452,7 @@ void StructNode::debugPrint(DebugPrinter& dp) {
 }
 
 void FunctionNode::debugPrint(DebugPrinter& dp) {
-	dp.o << dp << "fn " << name_.getString() << "(";
+	dp.o << dp << (isConst_ ? "const fn " : "fn ") << name_.getString() << "(";
 	bool isFirst = true;
 	for (auto arg : args_) {
 		if (!isFirst) {
@@ -375,12 +491,17 @@ void Context::debugPrint(DebugPrinter& dp) {
 
 bool TypeNode::generate(Generator& g, Context& ctx) {
 	if (type_.isReference) {
-		if (type_.basicType == Token::Type::TYPE_VOID) {
+		// a slice does not own its elements, so it can not view references, which are counted
+		if ((type_.basicType == Token::Type::TYPE_VOID) || type_.isSlice) {
 			ctx.addCompileError(std::make_shared<InvalidReferenceTypeError>(token_));
 			return true;
 		}
 	}
 
+	if (!arraySizes_.empty()) {
+		// the same tree may be generated more than once (e.g. for each JIT tier)
+		type_.arraySizes.clear();
+	}
 	for (auto arraySize : arraySizes_) {
 		if (arraySize->generate(g, ctx)) {
 			debugLog(__LINE__);
@@ -394,38 +515,337 @@ bool TypeNode::generate(Generator& g, Context& ctx) {
 		type_.arraySizes.push_back(arraySize->getConstantInteger());
 	}
 
-	if (g.createType(type_, generatedType_)) {
+	if (type_.basicType == Token::Type::SYMBOL) {
+		auto structNode = ctx.getStructNode(type_.structName);
+		if (structNode == nullptr) {
+			ctx.addCompileError(std::make_shared<UndefinedSymbolError>(token_));
+			return true;
+		}
+		bool error = (structNode->isSoa() && (type_.pointerCount == 0) && !type_.isReference && !type_.arraySizes.empty()) ?
+			g.createSoaType(structNode->getMemberTypes(), type_, generatedType_) :
+			g.createStructValueType(structNode->getGeneratedType(), type_, generatedType_);
+		if (error) {
+			debugLog(__LINE__);
+			return true;
+		}
+	}
+	else if (g.createType(type_, generatedType_)) {
 		debugLog(__LINE__);
 		return true;
 	}
 
+	if (type_.isSlice) {
+		if (g.createSliceType(generatedType_, generatedType_)) {
+			debugLog(__LINE__);
+			return true;
+		}
+	}
+
 	return false;
 }
 
+bool TypeNode::isScalar() const {
+	return arraySizes_.empty() && isScalarType(type_);
+}
+
 bool VariableDefinitionNode::generateType(Generator& g, Context& ctx) {
 	return type_.generate(g, ctx);
 }
 
 bool VariableValueNode::generate(Generator& g, Context& ctx) {
 	Generator::Value temp;
-	if (ctx.getSymbol(name_.getString(), valueType_, temp)) {
+	if (ctx.getSymbol(name_.getString(), valueType_, temp, generatedVariable_)) {
 		ctx.addCompileError(std::make_shared<UndefinedSymbolError>(name_));
 		return true;
 	}
 
-	if (valueType_.isArgument) {
+	isAssignable_ = true;
+	if ((arrayIndex_ != nullptr) || isSliceRange_ || (member_ != nullptr)) {
+		// the element or the member is addressed through the array or the struct
+		bool isArgument = valueType_.isArgument;
+		// a slice is a view of the elements of its caller, which may be overwritten
+		bool isSliceElement = valueType_.isSlice && (arrayIndex_ != nullptr) && !isSliceRange_;
+		if ((isArgument && !isAddressedType(valueType_)) || (generatedVariable_ != nullptr)) {
+			// passed by value, so a copy is addressed; arrays and structs are copied once, see FunctionNode::addArgumentToSymbolTable()
+			Generator::Value value = temp;
+			if ((generatedVariable_ != nullptr) && g.readVariable(generatedVariable_, value)) {
+				debugLog(__LINE__);
+				return true;
+			}
+			if (g.createLocalCopy(value, temp)) {
+				debugLog(__LINE__);
+				return true;
+			}
+			generatedVariable_ = nullptr;
+		}
+
+		generatedVariablePtr_ = temp;
+		if (generateElementPointer(g, ctx, generatedVariablePtr_)) {
+			debugLog(__LINE__);
+			return true;
+		}
+		// elements of an argument can not be overwritten either
+		valueType_.isArgument = isArgument && !isSliceElement;
+
+		if (!isRhsValue_) {
+			bool error = valueType_.isReference ?
+				g.createReferenceLoad(generatedVariablePtr_, generatedValue_) :
+				g.createLoad(generatedVariablePtr_, generatedValue_);
+			if (error) {
+				debugLog(__LINE__);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	if (valueType_.isArgument && !isAddressedType(valueType_)) {
 		generatedValue_ = temp;
 	}
+	else if (generatedVariable_ != nullptr) {
+		if (!isRhsValue_) {
+			if (g.readVariable(generatedVariable_, generatedValue_)) {
+				debugLog(__LINE__);
+				return true;
+			}
+		}
+	}
 	else {
 		generatedVariablePtr_ = temp;
 		if (!isRhsValue_) {
-			if (g.createLoad(temp, generatedValue_)) {
+			if (valueType_.isReference) {
+				if (g.createReferenceLoad(temp, generatedValue_)) {
+					debugLog(__LINE__);
+					return true;
+				}
+			}
+			else {
+				if (g.createLoad(temp, generatedValue_)) {
+					debugLog(__LINE__);
+					return true;
+				}
+			}
+		}
+	}
+
+	return false;
+}
+
+// the element selected by the index, then the member selected by the name after the dot;
+// ptr is the address of the value of valueType_ and is replaced by the address of the selected one
+bool VariableValueNode::generateElementPointer(Generator& g, Context& ctx, Generator::Value& ptr) {
+	// the element of a struct of arrays is only located by the member, see Generator::createSoaType()
+	Generator::Value soaIndex = nullptr;
+
+	if (isSliceRange_) {
+		if (generateSliceRange(g, ctx, ptr)) {
+			debugLog(__LINE__);
+			return true;
+		}
+	}
+	else if ((arrayIndex_ != nullptr) && valueType_.isSlice) {
+		if (arrayIndex_->generate(g, ctx)) {
+			debugLog(__LINE__);
+			return true;
+		}
+		Generator::Value index;
+		Generator::Value slice;
+		Generator::Value length;
+		Generator::Value data;
+		if (createIndex(g, ctx, arrayIndex_, index) || g.createLoad(ptr, slice) || g.createSliceLength(slice, length) || g.createSliceData(slice, data)) {
+			debugLog(__LINE__);
+			return true;
+		}
+		if (ctx.isBoundsChecked() && g.createBoundsCheck(index, length)) {
+			debugLog(__LINE__);
+			return true;
+		}
+		if (g.createPointerOffset(data, index, ptr)) {
+			debugLog(__LINE__);
+			return true;
+		}
+		valueType_.isSlice = false;
+	}
+	else if (arrayIndex_ != nullptr) {
+		if (valueType_.arraySizes.empty()) {
+			ctx.addCompileError(std::make_shared<NotArrayTypeError>(arrayIndex_->getToken()));
+			return true;
+		}
+		if (arrayIndex_->generate(g, ctx)) {
+			debugLog(__LINE__);
+			return true;
+		}
+		Generator::Value index;
+		if (createIndex(g, ctx, arrayIndex_, index)) {
+			debugLog(__LINE__);
+			return true;
+		}
+
+		uint64_t size = valueType_.arraySizes.back();
+		if (arrayIndex_->getValueType().basicType == Token::Type::CONSTANT_INTEGER) {
+			auto constantIndex = arrayIndex_->getConstantInteger();
+			if ((constantIndex < 0) || (size <= static_cast<uint64_t>(constantIndex))) {
+				ctx.addCompileError(std::make_shared<IndexOutOfBoundsError>(arrayIndex_->getToken()));
+				return true;
+			}
+		}
+		else if (ctx.isBoundsChecked()) {
+			// see Generator::createBoundsCheck() for how the optimizer removes it
+			Generator::Constant sizeValue;
+			if (g.createI64Constant(static_cast<int64_t>(size), sizeValue) || g.createBoundsCheck(index, sizeValue)) {
 				debugLog(__LINE__);
 				return true;
 			}
 		}
+
+		// the last size is the outermost array
+		valueType_.arraySizes.pop_back();
+		auto structNode = valueType_.isStruct() ? ctx.getStructNode(valueType_.structName) : nullptr;
+		if ((structNode != nullptr) && structNode->isSoa() && !valueType_.isReference) {
+			if (member_ == nullptr) {
+				ctx.addCompileError(std::make_shared<SoaElementMustBeAccessedByMemberError>(arrayIndex_->getToken()));
+				return true;
+			}
+			soaIndex = index;
+		}
+		else if (g.createElementPointer(ptr, index, ptr)) {
+			debugLog(__LINE__);
+			return true;
+		}
+	}
+
+	// the members of a referenced struct are the ones of the object it refers to
+	if ((member_ != nullptr) && valueType_.isReference && valueType_.isStruct() && valueType_.arraySizes.empty()) {
+		if (g.createReferenceLoad(ptr, ptr)) {
+			debugLog(__LINE__);
+			return true;
+		}
+		valueType_.isReference = false;
+	}
+
+	if ((member_ != nullptr) && valueType_.isSlice && valueType_.arraySizes.empty()) {
+		// the length is the only member of a slice, and is read only
+		auto& memberName = member_->getName();
+		if ((memberName.getString() != "len") || (member_->arrayIndex_ != nullptr) || member_->isSliceRange_ || (member_->member_ != nullptr)) {
+			ctx.addCompileError(std::make_shared<UndefinedMemberError>(memberName));
+			return true;
+		}
+		if (g.createSliceLengthPointer(ptr, ptr)) {
+			debugLog(__LINE__);
+			return true;
+		}
+		valueType_ = ValueType(Token::Type::TYPE_U64);
+		isAssignable_ = false;
+	}
+	else if (member_ != nullptr) {
+		auto& memberName = member_->getName();
+		auto structNode = valueType_.isStruct() ? ctx.getStructNode(valueType_.structName) : nullptr;
+		if (structNode == nullptr) {
+			ctx.addCompileError(std::make_shared<NotStructTypeError>(memberName));
+			return true;
+		}
+		size_t position;
+		if (structNode->findMember(memberName.getString(), position)) {
+			ctx.addCompileError(std::make_shared<UndefinedMemberError>(memberName));
+			return true;
+		}
+
+		bool error = (soaIndex != nullptr) ?
+			g.createColumnElementPointer(ptr, position, soaIndex, ptr) :
+			g.createMemberPointer(ptr, structNode->getMemberIndex(position), ptr);
+		if (error) {
+			debugLog(__LINE__);
+			return true;
+		}
+
+		member_->valueType_ = structNode->getMemberValueType(position);
+		if (member_->generateElementPointer(g, ctx, ptr)) {
+			debugLog(__LINE__);
+			return true;
+		}
+		valueType_ = member_->valueType_;
+		isAssignable_ = member_->isAssignable_;
+	}
+
+	return false;
+}
+
+// "[begin:end]" of an array or a slice makes a slice of the elements from begin to end, without copying them;
+// ptr is replaced by the address of the new slice, which is a value and can not be assigned
+bool VariableValueNode::generateSliceRange(Generator& g, Context& ctx, Generator::Value& ptr) {
+	if (valueType_.arraySizes.empty() && !valueType_.isSlice) {
+		ctx.addCompileError(std::make_shared<NotArrayTypeError>(name_));
+		return true;
+	}
+
+	// the elements of a slice outlive the function, and the ones of an array do not, see EscapeAnalysis
+	if (!valueType_.isSlice && ctx.isEscapingView(this)) {
+		ctx.addCompileError(std::make_shared<LocalArraySliceEscapesError>(name_));
+		return true;
+	}
+
+	Generator::Value data;
+	Generator::Value length;
+	if (valueType_.isSlice) {
+		Generator::Value slice;
+		if (g.createLoad(ptr, slice) || g.createSliceData(slice, data) || g.createSliceLength(slice, length)) {
+			debugLog(__LINE__);
+			return true;
+		}
+	}
+	else {
+		Generator::Constant zero;
+		Generator::Constant size;
+		if (g.createI64Constant(0, zero) || g.createElementPointer(ptr, zero, data) ||
+			g.createI64Constant(static_cast<int64_t>(valueType_.arraySizes.back()), size)) {
+			debugLog(__LINE__);
+			return true;
+		}
+		length = size;
+		valueType_.arraySizes.pop_back();
+	}
+
+	auto structNode = valueType_.isStruct() ? ctx.getStructNode(valueType_.structName) : nullptr;
+	if ((structNode != nullptr) && structNode->isSoa() && !valueType_.isReference && valueType_.arraySizes.empty()) {
+		ctx.addCompileError(std::make_shared<SoaElementMustBeAccessedByMemberError>(name_));
+		return true;
+	}
+
+	// the bounds default to the whole array
+	Generator::Value begin;
+	Generator::Value end = length;
+	if (arrayIndex_ != nullptr) {
+		if (arrayIndex_->generate(g, ctx) || createIndex(g, ctx, arrayIndex_, begin)) {
+			debugLog(__LINE__);
+			return true;
+		}
+	}
+	else {
+		Generator::Constant zero;
+		if (g.createI64Constant(0, zero)) {
+			debugLog(__LINE__);
+			return true;
+		}
+		begin = zero;
+	}
+	if (sliceEnd_ != nullptr) {
+		if (sliceEnd_->generate(g, ctx) || createIndex(g, ctx, sliceEnd_, end)) {
+			debugLog(__LINE__);
+			return true;
+		}
+	}
+	if (ctx.isBoundsChecked() && g.createRangeCheck(begin, end, length)) {
+		debugLog(__LINE__);
+		return true;
 	}
 
+	Generator::Value slice;
+	if (g.createPointerOffset(data, begin, data) || g.createSub(Token::Type::TYPE_I64, end, begin, length) || g.createSlice(data, length, slice) || g.createLocalCopy(slice, ptr)) {
+		debugLog(__LINE__);
+		return true;
+	}
+	valueType_.isSlice = true;
+	isAssignable_ = false;
 	return false;
 }
 
@@ -507,26 +927,33 @@ bool UnaryOperationNode::generate(Generator& g, Context& ctx) {
 		return true;
 	}
 
-	switch (operatorType_.getType()) {
-	case Token::Type::MINUS:
-		if (g.createNegate(valueType_.basicType, value_->getGeneratedValue(), generatedValue_)) {
+	if (Token::isConstant(valueType_.basicType)) {
+		ConstantValue value;
+		if (value_->getConstantValue(value)) {
 			debugLog(__LINE__);
 			return true;
 		}
 
-		if (valueType_.basicType == Token::Type::CONSTANT_INTEGER) {
-			int64_t num = value_->getConstantInteger();
-			if (num == INT64_MIN) {
-				ctx.addCompileError(std::make_shared<ConstantTooLarge>(operatorType_));
-				return true;
-			}
-			constantInteger_ = -num;
+		ConstantValue result;
+		auto status = ConstantEvaluator::evaluateUnaryOperation(operatorType_.getType(), value, result);
+		if (status == ConstantEvaluator::Status::INTEGER_OVERFLOW) {
+			ctx.addCompileError(std::make_shared<ConstantTooLarge>(operatorType_));
+			return true;
 		}
-		else if (valueType_.basicType == Token::Type::CONSTANT_FLOAT) {
-			double num = value_->getConstantDouble();
-			constantDouble_ = -num;
+		if ((status != ConstantEvaluator::Status::OK) || setConstantValue(g, result)) {
+			debugLog(__LINE__);
+			return true;
 		}
 
+		return false;
+	}
+
+	switch (operatorType_.getType()) {
+	case Token::Type::MINUS:
+		if (g.createNegate(valueType_.basicType, value_->getGeneratedValue(), generatedValue_)) {
+			debugLog(__LINE__);
+			return true;
+		}
 		break;
 	default:
 		debugLog(__LINE__);
@@ -537,6 +964,10 @@ bool UnaryOperationNode::generate(Generator& g, Context& ctx) {
 }
 
 bool BinaryOperationNode::generate(Generator& g, Context& ctx) {
+	if ((operatorType_.getType() == Token::Type::LOGICAL_OR) || (operatorType_.getType() == Token::Type::LOGICAL_AND)) {
+		return generateLogicalOperation(g, ctx);
+	}
+
 	if (lhs_->generate(g, ctx)) {
 		debugLog(__LINE__);
 		return true;
@@ -545,6 +976,7 @@ bool BinaryOperationNode::generate(Generator& g, Context& ctx) {
 		debugLog(__LINE__);
 		return true;
 	}
+	g.setDebugLocation(operatorType_);
 
 	ValueType lhsType = lhs_->getValueType();
 	ValueType rhsType = rhs_->getValueType();
@@ -553,6 +985,15 @@ bool BinaryOperationNode::generate(Generator& g, Context& ctx) {
 		return true;
 	}
 
+	if (checkOperand(ctx, operatorType_, lhsType, lhs_)) {
+		debugLog(__LINE__);
+		return true;
+	}
+
+	if (Token::isConstant(lhsType.basicType) && Token::isConstant(rhsType.basicType) && lhsType.arraySizes.empty()) {
+		return evaluateConstant(g, ctx);
+	}
+
 	Generator::Value newLhs;
 	Generator::Value newRhs;
 	if (Token::isConstant(lhsType.basicType)) {
@@ -572,232 +1013,246 @@ bool BinaryOperationNode::generate(Generator& g, Context& ctx) {
 		valueType_ = lhsType;
 	}
 
-	if (checkOperand(ctx, operatorType_, lhsType, lhs_)) {
-		debugLog(__LINE__);
-		return true;
-	}
-
+	bool error = false;
 	switch (operatorType_.getType()) {
 	case Token::Type::PLUS:
-		if (g.createAdd(valueType_.basicType, newLhs, newRhs, generatedValue_)) {
-			debugLog(__LINE__);
-			return true;
-		}
-
-		if (valueType_.basicType == Token::Type::CONSTANT_INTEGER) {
-			int64_t lhs = lhs_->getConstantInteger();
-			int64_t rhs = rhs_->getConstantInteger();
-			// TODO: check overflow
-			constantInteger_ = lhs + rhs;
-		}
-		else if (valueType_.basicType == Token::Type::CONSTANT_FLOAT) {
-			int64_t lhs = lhs_->getConstantDouble();
-			int64_t rhs = rhs_->getConstantDouble();
-			// TODO: check overflow
-			constantDouble_ = lhs + rhs;
-		}
-
+		error = g.createAdd(valueType_.basicType, newLhs, newRhs, generatedValue_);
 		break;
 	case Token::Type::MINUS:
-		if (g.createSub(valueType_.basicType, newLhs, newRhs, generatedValue_)) {
-			debugLog(__LINE__);
-			return true;
-		}
-
-		if (valueType_.basicType == Token::Type::CONSTANT_INTEGER) {
-			int64_t lhs = lhs_->getConstantInteger();
-			int64_t rhs = rhs_->getConstantInteger();
-			// TODO: check overflow
-			constantInteger_ = lhs - rhs;
-		}
-		else if (valueType_.basicType == Token::Type::CONSTANT_FLOAT) {
-			int64_t lhs = lhs_->getConstantDouble();
-			int64_t rhs = rhs_->getConstantDouble();
-			// TODO: check overflow
-			constantDouble_ = lhs - rhs;
-		}
-
+		error = g.createSub(valueType_.basicType, newLhs, newRhs, generatedValue_);
 		break;
 	case Token::Type::ASTERISK:
-		if (g.createMul(valueType_.basicType, newLhs, newRhs, generatedValue_)) {
-			debugLog(__LINE__);
-			return true;
-		}
-
-		if (valueType_.basicType == Token::Type::CONSTANT_INTEGER) {
-			int64_t lhs = lhs_->getConstantInteger();
-			int64_t rhs = rhs_->getConstantInteger();
-			// TODO: check overflow
-			constantInteger_ = lhs * rhs;
-		}
-		else if (valueType_.basicType == Token::Type::CONSTANT_FLOAT) {
-			int64_t lhs = lhs_->getConstantDouble();
-			int64_t rhs = rhs_->getConstantDouble();
-			// TODO: check overflow
-			constantDouble_ = lhs * rhs;
-		}
-
+		error = g.createMul(valueType_.basicType, newLhs, newRhs, generatedValue_);
 		break;
 	case Token::Type::SLASH:
-		if (g.createDiv(valueType_.basicType, newLhs, newRhs, generatedValue_)) {
-			debugLog(__LINE__);
-			return true;
-		}
-
-		if (valueType_.basicType == Token::Type::CONSTANT_INTEGER) {
-			int64_t lhs = lhs_->getConstantInteger();
-			int64_t rhs = rhs_->getConstantInteger();
-			// TODO: check overflow
-			constantInteger_ = lhs / rhs;
-		}
-		else if (valueType_.basicType == Token::Type::CONSTANT_FLOAT) {
-			int64_t lhs = lhs_->getConstantDouble();
-			int64_t rhs = rhs_->getConstantDouble();
-			// TODO: check overflow
-			constantDouble_ = lhs / rhs;
-		}
-
+		error = g.createDiv(valueType_.basicType, newLhs, newRhs, generatedValue_);
 		break;
 	case Token::Type::PERCENT:
-		if (g.createRem(valueType_.basicType, newLhs, newRhs, generatedValue_)) {
-			debugLog(__LINE__);
-			return true;
-		}
-
-		if (valueType_.basicType == Token::Type::CONSTANT_INTEGER) {
-			int64_t lhs = lhs_->getConstantInteger();
-			int64_t rhs = rhs_->getConstantInteger();
-			// TODO: check overflow
-			constantInteger_ = lhs % rhs;
-		}
-		else if (valueType_.basicType == Token::Type::CONSTANT_FLOAT) {
-			int64_t lhs = lhs_->getConstantDouble();
-			int64_t rhs = rhs_->getConstantDouble();
-			// TODO: check overflow
-			constantDouble_ = lhs % rhs;
-		}
-
+		error = g.createRem(valueType_.basicType, newLhs, newRhs, generatedValue_);
 		break;
 	case Token::Type::COMPARE_LESSER_THAN:
-		if (g.createCommpareLesserThan(valueType_.basicType, newLhs, newRhs, generatedValue_)) {
-			debugLog(__LINE__);
-			return true;
-		}
-
-		if (valueType_.basicType == Token::Type::CONSTANT_INTEGER) {
-			constantBool_ = lhs_->getConstantInteger() < rhs_->getConstantInteger();
-		}
-		else if (valueType_.basicType == Token::Type::CONSTANT_FLOAT) {
-			constantBool_ = lhs_->getConstantInteger() < rhs_->getConstantInteger();
-		}
-
+		error = g.createCommpareLesserThan(valueType_.basicType, newLhs, newRhs, generatedValue_);
 		break;
 	case Token::Type::COMPARE_LESSER_EQUAL:
-		if (g.createCommpareLesserEqual(valueType_.basicType, newLhs, newRhs, generatedValue_)) {
-			debugLog(__LINE__);
-			return true;
-		}
-
-		if (valueType_.basicType == Token::Type::CONSTANT_INTEGER) {
-			constantBool_ = lhs_->getConstantInteger() <= rhs_->getConstantInteger();
-		}
-		else if (valueType_.basicType == Token::Type::CONSTANT_FLOAT) {
-			constantBool_ = lhs_->getConstantInteger() <= rhs_->getConstantInteger();
-		}
-
+		error = g.createCommpareLesserEqual(valueType_.basicType, newLhs, newRhs, generatedValue_);
 		break;
 	case Token::Type::COMPARE_GREATER_THAN:
-		if (g.createCommpareGreaterThan(valueType_.basicType, newLhs, newRhs, generatedValue_)) {
-			debugLog(__LINE__);
-			return true;
-		}
-
-		if (valueType_.basicType == Token::Type::CONSTANT_INTEGER) {
-			constantBool_ = lhs_->getConstantInteger() > rhs_->getConstantInteger();
-		}
-		else if (valueType_.basicType == Token::Type::CONSTANT_FLOAT) {
-			constantBool_ = lhs_->getConstantInteger() > rhs_->getConstantInteger();
-		}
-
+		error = g.createCommpareGreaterThan(valueType_.basicType, newLhs, newRhs, generatedValue_);
 		break;
 	case Token::Type::COMPARE_GREATER_EQUAL:
-		if (g.createCommpareGreaterEqual(valueType_.basicType, newLhs, newRhs, generatedValue_)) {
-			debugLog(__LINE__);
-			return true;
-		}
-
-		if (valueType_.basicType == Token::Type::CONSTANT_INTEGER) {
-			constantBool_ = lhs_->getConstantInteger() >= rhs_->getConstantInteger();
-		}
-		else if (valueType_.basicType == Token::Type::CONSTANT_FLOAT) {
-			constantBool_ = lhs_->getConstantInteger() >= rhs_->getConstantInteger();
-		}
-
+		error = g.createCommpareGreaterEqual(valueType_.basicType, newLhs, newRhs, generatedValue_);
 		break;
 	case Token::Type::COMPARE_EQUAL:
-		if (g.createCommpareEqual(valueType_.basicType, newLhs, newRhs, generatedValue_)) {
-			debugLog(__LINE__);
-			return true;
-		}
+		error = g.createCommpareEqual(valueType_.basicType, newLhs, newRhs, generatedValue_);
+		break;
+	case Token::Type::COMPARE_NOT_EQUAL:
+		error = g.createCommpareNotEqual(valueType_.basicType, newLhs, newRhs, generatedValue_);
+		break;
+	default:
+		error = true;
+		break;
+	}
+	if (error) {
+		debugLog(__LINE__);
+		return true;
+	}
 
-		if (valueType_.basicType == Token::Type::CONSTANT_INTEGER) {
-			constantBool_ = lhs_->getConstantInteger() == rhs_->getConstantInteger();
-		}
-		else if (valueType_.basicType == Token::Type::CONSTANT_FLOAT) {
-			constantBool_ = lhs_->getConstantInteger() == rhs_->getConstantInteger();
-		}
+	// comparisons yield bool whatever the operand type is, so that they can be operands of && and ||
+	if (operatorType_.isEqualOrNotEqualOperator() || operatorType_.isGreaterOrLesserOperator()) {
+		valueType_ = ValueType(Token::Type::TYPE_BOOL, 0, false);
+	}
+
+	return false;
+}
+
+bool BinaryOperationNode::evaluateConstant(Generator& g, Context& ctx) {
+	ConstantValue lhs;
+	ConstantValue rhs;
+	if (lhs_->getConstantValue(lhs) || rhs_->getConstantValue(rhs)) {
+		debugLog(__LINE__);
+		return true;
+	}
+
+	ConstantValue result;
+	auto status = ConstantEvaluator::evaluateBinaryOperation(operatorType_.getType(), lhs, rhs, result);
+	if (status == ConstantEvaluator::Status::INTEGER_OVERFLOW) {
+		ctx.addCompileError(std::make_shared<ConstantTooLarge>(operatorType_));
+		return true;
+	}
+	if (status == ConstantEvaluator::Status::DIVISION_BY_ZERO) {
+		ctx.addCompileError(std::make_shared<DivisionByZeroError>(operatorType_));
+		return true;
+	}
+	if (status != ConstantEvaluator::Status::OK) {
+		debugLog(__LINE__);
+		return true;
+	}
 
+	if (setConstantValue(g, result)) {
+		debugLog(__LINE__);
+		return true;
+	}
+
+	return false;
+}
+
+bool ExpressionNode::setConstantValue(Generator& g, const ConstantValue& value) {
+	Generator::Constant temp;
+	bool error = false;
+	switch (value.type) {
+	case Token::Type::CONSTANT_BOOL:
+		constantBool_ = value.b;
+		error = g.createBooleanConstant(constantBool_, temp);
 		break;
-	case Token::Type::COMPARE_NOT_EQUAL:
-		if (g.createCommpareNotEqual(valueType_.basicType, newLhs, newRhs, generatedValue_)) {
-			debugLog(__LINE__);
-			return true;
-		}
+	case Token::Type::CONSTANT_INTEGER:
+		constantInteger_ = value.i;
+		error = g.createI64Constant(constantInteger_, temp);
+		break;
+	case Token::Type::CONSTANT_FLOAT:
+		constantDouble_ = value.d;
+		error = g.createDoubleConstant(constantDouble_, temp);
+		break;
+	default:
+		error = true;
+		break;
+	}
+	if (error) {
+		debugLog(__LINE__);
+		return true;
+	}
 
-		if (valueType_.basicType == Token::Type::CONSTANT_INTEGER) {
-			constantBool_ = lhs_->getConstantInteger() != rhs_->getConstantInteger();
-		}
-		else if (valueType_.basicType == Token::Type::CONSTANT_FLOAT) {
-			constantBool_ = lhs_->getConstantInteger() != rhs_->getConstantInteger();
-		}
+	generatedValue_ = temp;
+	valueType_ = ValueType(value.type, 0, false);
+
+	return false;
+}
 
+bool ExpressionNode::getConstantValue(ConstantValue& result) const {
+	result.type = valueType_.basicType;
+	switch (valueType_.basicType) {
+	case Token::Type::CONSTANT_BOOL:
+		result.b = constantBool_;
 		break;
-	case Token::Type::LOGICAL_OR:
-		if (g.createLogicalOr(valueType_.basicType, newLhs, newRhs, generatedValue_)) {
+	case Token::Type::CONSTANT_INTEGER:
+		result.i = constantInteger_;
+		break;
+	case Token::Type::CONSTANT_FLOAT:
+		result.d = constantDouble_;
+		break;
+	default:
+		debugLog(__LINE__);
+		return true;
+	}
+
+	return false;
+}
+
+bool BinaryOperationNode::generateLogicalOperation(Generator& g, Context& ctx) {
+	bool isOr = (operatorType_.getType() == Token::Type::LOGICAL_OR);
+
+	if (lhs_->generate(g, ctx)) {
+		debugLog(__LINE__);
+		return true;
+	}
+	if (checkOperand(ctx, operatorType_, lhs_->getValueType(), lhs_)) {
+		debugLog(__LINE__);
+		return true;
+	}
+
+	size_t budget = kSpeculationBudget;
+	if (rhs_->isCheapToSpeculate(budget)) {
+		// branchless: both operands in the current block
+		if (rhs_->generate(g, ctx)) {
 			debugLog(__LINE__);
 			return true;
 		}
-
-		if (valueType_.basicType == Token::Type::CONSTANT_BOOL) {
-			constantBool_ = lhs_->getConstantBool() | rhs_->getConstantBool();
-		}
-		else if (valueType_.basicType == Token::Type::CONSTANT_FLOAT) {
-			constantBool_ = lhs_->getConstantBool() | rhs_->getConstantBool();
+		if (checkOperand(ctx, operatorType_, rhs_->getValueType(), rhs_)) {
+			debugLog(__LINE__);
+			return true;
 		}
 
-		break;
-	case Token::Type::LOGICAL_AND:
-		if (g.createLogicalAnd(valueType_.basicType, newLhs, newRhs, generatedValue_)) {
+		g.setDebugLocation(operatorType_);
+		bool error = isOr ?
+			g.createLogicalOr(lhs_->getGeneratedValue(), rhs_->getGeneratedValue(), generatedValue_) :
+			g.createLogicalAnd(lhs_->getGeneratedValue(), rhs_->getGeneratedValue(), generatedValue_);
+		if (error) {
 			debugLog(__LINE__);
 			return true;
 		}
 
-		if (valueType_.basicType == Token::Type::CONSTANT_BOOL) {
-			constantBool_ = lhs_->getConstantBool() & rhs_->getConstantBool();
+		if ((lhs_->getValueType().basicType == Token::Type::CONSTANT_BOOL) && (rhs_->getValueType().basicType == Token::Type::CONSTANT_BOOL)) {
+			constantBool_ = isOr ? (lhs_->getConstantBool() || rhs_->getConstantBool()) : (lhs_->getConstantBool() && rhs_->getConstantBool());
+			valueType_ = ValueType(Token::Type::CONSTANT_BOOL, 0, false);
 		}
-		else if (valueType_.basicType == Token::Type::CONSTANT_FLOAT) {
-			constantBool_ = lhs_->getConstantBool() & rhs_->getConstantBool();
+		else {
+			valueType_ = ValueType(Token::Type::TYPE_BOOL, 0, false);
 		}
 
-		break;
-	default:
+		return false;
+	}
+
+	// short-circuit: the rhs has its own block, which || skips when the lhs is true and && when it is false
+	Generator::BasicBlock lhsBlock = g.getCurrentBlock();
+	Generator::BasicBlock rhsBlock;
+	Generator::BasicBlock successorBlock;
+	if (g.createBasicBlock(nullptr, ctx.getLastBlock(), rhsBlock) ||
+		g.createBasicBlock(nullptr, ctx.getLastBlock(), successorBlock))
+	{
 		debugLog(__LINE__);
 		return true;
 	}
 
+	g.setDebugLocation(operatorType_);
+	bool error = isOr ?
+		g.createIf(lhs_->getGeneratedValue(), successorBlock, rhsBlock) :
+		g.createIf(lhs_->getGeneratedValue(), rhsBlock, successorBlock);
+	if (error) {
+		debugLog(__LINE__);
+		return true;
+	}
+
+	g.setInsertPoint(rhsBlock);
+	if (rhs_->generate(g, ctx)) {
+		debugLog(__LINE__);
+		return true;
+	}
+	if (checkOperand(ctx, operatorType_, rhs_->getValueType(), rhs_)) {
+		debugLog(__LINE__);
+		return true;
+	}
+	// the rhs may have ended in another block if it contains && or || itself
+	Generator::BasicBlock rhsEndBlock = g.getCurrentBlock();
+	if (g.createGoto(successorBlock)) {
+		debugLog(__LINE__);
+		return true;
+	}
+
+	g.setInsertPoint(successorBlock);
+	Generator::Constant shortCircuitValue;
+	if (g.createBooleanConstant(isOr, shortCircuitValue)) {
+		debugLog(__LINE__);
+		return true;
+	}
+	if (g.createPhi({ { shortCircuitValue, lhsBlock }, { rhs_->getGeneratedValue(), rhsEndBlock } }, generatedValue_)) {
+		debugLog(__LINE__);
+		return true;
+	}
+	valueType_ = ValueType(Token::Type::TYPE_BOOL, 0, false);
+
 	return false;
 }
 
+bool BinaryOperationNode::isCheapToSpeculate(size_t& budget) const {
+	switch (operatorType_.getType()) {
+	case Token::Type::SLASH:
+	case Token::Type::PERCENT:
+		// division by zero traps
+		return false;
+	default:
+		return consumeSpeculationBudget(budget) && lhs_->isCheapToSpeculate(budget) && rhs_->isCheapToSpeculate(budget);
+	}
+}
+
 bool BinaryOperationNode::checkOperand(Context& ctx, const Token& operatorToken, const ValueType& operandType, const std::shared_ptr<ExpressionNode>& value) {
 	if (operandType.pointerCount != 0) {
 		debugLog(__LINE__);
@@ -846,6 +1301,253 @@ bool BinaryOperationNode::checkOperand(Context& ctx, const Token& operatorToken,
 	return false;
 }
 
+bool UnaryOperationNode::isCheapToSpeculate(size_t& budget) const {
+	return consumeSpeculationBudget(budget) && value_->isCheapToSpeculate(budget);
+}
+
+bool VariableValueNode::isCheapToSpeculate(size_t& budget) const {
+	// a local or an argument; elements and members may be behind a pointer the lhs guards
+	return (arrayIndex_ == nullptr) && !isSliceRange_ && (member_ == nullptr) && consumeSpeculationBudget(budget);
+}
+
+bool ConstantNode::isCheapToSpeculate(size_t& budget) const {
+	return consumeSpeculationBudget(budget);
+}
+
+bool CastNode::isCheapToSpeculate(size_t& budget) const {
+	return consumeSpeculationBudget(budget) && value_->isCheapToSpeculate(budget);
+}
+
+bool ExpressionNode::checkConstFunction(Context& ctx) const {
+	ctx.addCompileError(std::make_shared<NotAllowedInConstFunctionError>(getToken()));
+	return true;
+}
+
+bool UnaryOperationNode::checkConstFunction(Context& ctx) const {
+	return value_->checkConstFunction(ctx);
+}
+
+bool UnaryOperationNode::evaluate(Interpreter& interpreter, Interpreter::Value& result) const {
+	Interpreter::Value value;
+	if (value_->evaluate(interpreter, value)) {
+		return true;
+	}
+	return Interpreter::evaluateUnaryOperation(operatorType_.getType(), value, result);
+}
+
+bool BinaryOperationNode::checkConstFunction(Context& ctx) const {
+	bool error = lhs_->checkConstFunction(ctx);
+	if (rhs_->checkConstFunction(ctx)) {
+		error = true;
+	}
+	return error;
+}
+
+bool BinaryOperationNode::evaluate(Interpreter& interpreter, Interpreter::Value& result) const {
+	Interpreter::Value lhs;
+	if (lhs_->evaluate(interpreter, lhs)) {
+		return true;
+	}
+
+	bool isOr = (operatorType_.getType() == Token::Type::LOGICAL_OR);
+	if (isOr || (operatorType_.getType() == Token::Type::LOGICAL_AND)) {
+		bool lhsValue;
+		bool rhsValue;
+		if (getBool(lhs, lhsValue)) {
+			return true;
+		}
+		if (lhsValue == isOr) {
+			rhsValue = lhsValue;
+		}
+		else {
+			Interpreter::Value rhs;
+			if (rhs_->evaluate(interpreter, rhs) || getBool(rhs, rhsValue)) {
+				return true;
+			}
+		}
+		result.type = Token::Type::TYPE_BOOL;
+		result.constant.type = Token::Type::CONSTANT_BOOL;
+		result.constant.b = rhsValue;
+		return false;
+	}
+
+	Interpreter::Value rhs;
+	if (rhs_->evaluate(interpreter, rhs)) {
+		return true;
+	}
+	return Interpreter::evaluateBinaryOperation(operatorType_.getType(), lhs, rhs, result);
+}
+
+bool VariableValueNode::checkConstFunction(Context& ctx) const {
+	if ((arrayIndex_ != nullptr) || isSliceRange_ || (member_ != nullptr)) {
+		return ExpressionNode::checkConstFunction(ctx);
+	}
+	return false;
+}
+
+bool VariableValueNode::evaluate(Interpreter& interpreter, Interpreter::Value& result) const {
+	return interpreter.getVariable(name_.getString(), result);
+}
+
+bool ConstantNode::checkConstFunction(Context& ctx) const {
+	if (constant_.getType() == Token::Type::CONSTANT_STRING) {
+		return ExpressionNode::checkConstFunction(ctx);
+	}
+	return false;
+}
+
+bool ConstantNode::evaluate(Interpreter&, Interpreter::Value& result) const {
+	result.type = constant_.getType();
+	result.constant.type = constant_.getType();
+	switch (constant_.getType()) {
+	case Token::Type::CONSTANT_BOOL:
+		return toBoolean(constant_.getString(), result.constant.b);
+	case Token::Type::CONSTANT_INTEGER:
+		return toInt64(constant_.getString(), result.constant.i);
+	case Token::Type::CONSTANT_FLOAT:
+		return toDouble(constant_.getString(), result.constant.d);
+	default:
+		return true;
+	}
+}
+
+bool CastNode::checkConstFunction(Context& ctx) const {
+	if (!destType_.isScalar()) {
+		return ExpressionNode::checkConstFunction(ctx);
+	}
+	return value_->checkConstFunction(ctx);
+}
+
+bool CastNode::evaluate(Interpreter& interpreter, Interpreter::Value& result) const {
+	Interpreter::Value value;
+	if (value_->evaluate(interpreter, value)) {
+		return true;
+	}
+	return Interpreter::cast(value, destType_.getValueType().basicType, result);
+}
+
+bool CallNode::checkConstFunction(Context& ctx) const {
+	bool error = false;
+	auto f = ctx.getFunctionNode(f_.getName().getString());
+	if ((f == nullptr) || !f->isConst()) {
+		ctx.addCompileError(std::make_shared<NotAllowedInConstFunctionError>(f_.getName()));
+		error = true;
+	}
+	for (auto& v : *values_.getValues()) {
+		if (v->checkConstFunction(ctx)) {
+			error = true;
+		}
+	}
+	return error;
+}
+
+bool CallNode::evaluate(Interpreter& interpreter, Interpreter::Value& result) const {
+	if (interpreter.step()) {
+		return true;
+	}
+
+	auto f = interpreter.getContext().getFunctionNode(f_.getName().getString());
+	if (f == nullptr) {
+		return true;
+	}
+
+	std::vector<Interpreter::Value> arguments;
+	for (auto& v : *values_.getValues()) {
+		Interpreter::Value argument;
+		if (v->evaluate(interpreter, argument)) {
+			return true;
+		}
+		arguments.push_back(argument);
+	}
+
+	return interpreter.call(*f, arguments, result);
+}
+
+bool CallNode::execute(Interpreter& interpreter) const {
+	Interpreter::Value result;
+	return evaluate(interpreter, result);
+}
+
+void UnaryOperationNode::analyzeEscape(EscapeAnalysis& analysis, std::vector<size_t>& sources) const {
+	value_->analyzeEscape(analysis, sources);
+}
+
+void BinaryOperationNode::analyzeEscape(EscapeAnalysis& analysis, std::vector<size_t>& sources) const {
+	lhs_->analyzeEscape(analysis, sources);
+	rhs_->analyzeEscape(analysis, sources);
+}
+
+void VariableValueNode::analyzeEscape(EscapeAnalysis& analysis, std::vector<size_t>& sources) const {
+	analyzeIndexEscape(analysis);
+
+	size_t variable;
+	if (!analysis.getVariable(name_.getString(), variable)) {
+		if (analysis.isNumberSlice(variable) && !hasSliceRange() && ((arrayIndex_ != nullptr) || (member_ != nullptr))) {
+			return;
+		}
+		sources.push_back(variable);
+		// the elements may be written through the slice, which is gone with the variable if it is an array
+		if (hasSliceRange()) {
+			analysis.addWrite(variable);
+			sources.push_back(analysis.addView(getSliceRangeNode()));
+		}
+	}
+}
+
+void VariableValueNode::analyzeIndexEscape(EscapeAnalysis& analysis) const {
+	// an index is a number, so only the arguments of the calls in it may escape, e.g. "b[g(a[:])]"
+	std::vector<size_t> indexSources;
+	if (arrayIndex_ != nullptr) {
+		arrayIndex_->analyzeEscape(analysis, indexSources);
+	}
+	if (sliceEnd_ != nullptr) {
+		sliceEnd_->analyzeEscape(analysis, indexSources);
+	}
+	if (member_ != nullptr) {
+		member_->analyzeIndexEscape(analysis);
+	}
+}
+
+void CastNode::analyzeEscape(EscapeAnalysis& analysis, std::vector<size_t>& sources) const {
+	value_->analyzeEscape(analysis, sources);
+}
+
+void CallNode::analyzeEscape(EscapeAnalysis& analysis) const {
+	std::vector<size_t> sources;
+	analyzeEscape(analysis, sources);
+}
+
+void CallNode::analyzeEscape(EscapeAnalysis& analysis, std::vector<size_t>& sources) const {
+	// the result is a new object or one of the arguments, which are captured if the callee returns them;
+	// a slice holds no object, so a captured slice outlives the call only as the result
+	std::vector<bool> capturedArguments;
+	auto f = analysis.getContext().getFunctionNode(f_.getName().getString());
+	if (f != nullptr) {
+		f->getCapturedArguments(analysis.getContext(), capturedArguments);
+	}
+
+	size_t index = 0;
+	for (auto& v : *values_.getValues()) {
+		std::vector<size_t> argumentSources;
+		v->analyzeEscape(analysis, argumentSources);
+		bool isSlice = (f != nullptr) && (index < f->getArguments().size()) && f->getArguments()[index].getValueType().isSlice;
+		if ((index < capturedArguments.size()) && capturedArguments[index] && isSlice) {
+			sources.insert(sources.end(), argumentSources.begin(), argumentSources.end());
+		}
+		else if ((index >= capturedArguments.size()) || capturedArguments[index]) {
+			analysis.addEscape(argumentSources);
+		}
+		index++;
+	}
+
+	// a returned reference may be an object the callee allocated from the region
+	if ((f != nullptr) && f->getReturnType().getValueType().isReference && analysis.isInRegion()) {
+		size_t result = analysis.addVariable("");
+		analysis.addRegionObject(result, getToken(), nullptr);
+		sources.push_back(result);
+	}
+}
+
 bool CallNode::generate(Generator& g, Context& ctx) {
 	auto f = ctx.getFunctionNode(f_.getName().getString());
 	if (f == nullptr) {
@@ -858,12 +1560,112 @@ bool CallNode::generate(Generator& g, Context& ctx) {
 		return true;
 	}
 
-	if (g.createCall(f->getGeneratedFunction(), values_.getGeneratedValues(), generatedValue_)) {
+	if (f->isConst()) {
+		bool isEvaluated = false;
+		if (evaluateConstFunction(g, ctx, *f, isEvaluated)) {
+			debugLog(__LINE__);
+			return true;
+		}
+		if (isEvaluated) {
+			return false;
+		}
+	}
+
+	// the callee borrows the arguments
+	auto& values = values_.getGeneratedValues();
+	auto& nodes = *values_.getValues();
+	for (size_t i = 0; i < values.size(); i++) {
+		if (createRetainIfBorrowed(g, *nodes[i], values[i])) {
+			debugLog(__LINE__);
+			return true;
+		}
+	}
+
+	if (g.createCall(f->getGeneratedFunction(), values, generatedValue_)) {
 		debugLog(__LINE__);
 		return true;
 	}
 	valueType_ = f->getReturnType().getValueType();
 
+	// the new of the callee allocates from the region the call is in, unless the object holds references (see LetNode::generate())
+	Generator::Value region;
+	auto objectType = valueType_;
+	objectType.isReference = false;
+	if (valueType_.isReference && valueType_.arraySizes.empty() && ctx.isReturningNewObject(f_.getName().getString()) &&
+		!ctx.getCurrentRegion(region) && !ctx.holdsReferences(objectType))
+	{
+		g.addPinnedObject(generatedValue_);
+	}
+
+	for (size_t i = 0; i < values.size(); i++) {
+		if (nodes[i]->getValueType().isReference && nodes[i]->getValueType().arraySizes.empty()) {
+			if (g.createRelease(values[i])) {
+				debugLog(__LINE__);
+				return true;
+			}
+		}
+		else if (nodes[i]->isOwnedReference()) {
+			if (createReleaseMembers(g, ctx, nodes[i]->getValueType(), values[i])) {
+				debugLog(__LINE__);
+				return true;
+			}
+		}
+	}
+	if (isStatement_ && valueType_.isReference) {
+		if (g.createRelease(generatedValue_)) {
+			debugLog(__LINE__);
+			return true;
+		}
+	}
+	if (isStatement_ && createReleaseMembers(g, ctx, valueType_, generatedValue_)) {
+		debugLog(__LINE__);
+		return true;
+	}
+
+	return false;
+}
+
+bool CallNode::evaluateConstFunction(Generator& g, Context& ctx, const FunctionNode& function, bool& isEvaluated) {
+	isEvaluated = false;
+
+	// arguments made of constants and const function calls are evaluated as well,
+	// and anything else (e.g. a variable) leaves the call to run time
+	Interpreter interpreter(ctx);
+	Interpreter::Value result;
+	if (evaluate(interpreter, result)) {
+		return false;
+	}
+
+	// the constant has the return type, as the value of the call would have
+	auto& returnType = function.getReturnType().getValueType();
+	Generator::Constant temp;
+	switch (result.constant.type) {
+	case Token::Type::CONSTANT_BOOL:
+		if (g.createBooleanConstant(result.constant.b, temp)) {
+			debugLog(__LINE__);
+			return true;
+		}
+		generatedValue_ = temp;
+		break;
+	case Token::Type::CONSTANT_INTEGER:
+		if (g.createI64Constant(result.constant.i, temp) || g.createCast(Token::Type::TYPE_I64, temp, returnType.basicType, generatedValue_)) {
+			debugLog(__LINE__);
+			return true;
+		}
+		break;
+	case Token::Type::CONSTANT_FLOAT:
+		if (g.createDoubleConstant(result.constant.d, temp) || g.createCast(Token::Type::TYPE_F64, temp, returnType.basicType, generatedValue_)) {
+			debugLog(__LINE__);
+			return true;
+		}
+		break;
+	default:
+		debugLog(__LINE__);
+		return true;
+	}
+	valueType_ = returnType;
+	isEvaluated = true;
+
 	return false;
 }
 
@@ -888,7 +1690,7 @@ bool ConstantNode::generate(Generator& g, Context& ctx) {
 	case Token::Type::CONSTANT_INTEGER:
 	{
 		if (toInt64(constant_.getString(), constantInteger_)) {
-			debugLog(__LINE__);
+			ctx.addCompileError(std::make_shared<ConstantTooLarge>(constant_));
 			return true;
 		}
 
@@ -1302,36 +2104,45 @@ bool CastNode::generate(Generator& g, Context& ctx) {
 	auto& srcType = value_->getValueType();
 	auto& destType = destType_.getValueType();
 
-	if (srcType.isReference) {
-		// TODO
-		debugLog(__LINE__);
-		return true;
-	}
-	if (srcType.pointerCount != 0) {
-		// TODO: support? compile error?
-		debugLog(__LINE__);
+	// only numbers are converted; references, pointers, arrays and bool are not
+	bool isNumber = srcType.isArithmetic() && srcType.arraySizes.empty() && !srcType.isReference;
+	bool isDestNumber = destType.isArithmetic() && destType.arraySizes.empty() && !destType.isReference && !Token::isConstant(destType.basicType);
+	if (!isNumber || !isDestNumber) {
+		ctx.addCompileError(std::make_shared<TypeMismatchError>(token_, destType, srcType));
 		return true;
 	}
 
-	if (destType.isReference) {
-		// TODO
-		debugLog(__LINE__);
-		return true;
-	}
-	if (destType.pointerCount != 0) {
-		// TODO: support? compile error?
-		debugLog(__LINE__);
-		return true;
+	if (Token::isConstant(srcType.basicType)) {
+		// a single constant of the destination type, see ConstantEvaluator::evaluateCast()
+		ConstantValue value;
+		if (value_->getConstantValue(value)) {
+			debugLog(__LINE__);
+			return true;
+		}
+		ConstantValue result;
+		auto status = ConstantEvaluator::evaluateCast(value, destType.basicType, result);
+		if (status == ConstantEvaluator::Status::INTEGER_OVERFLOW) {
+			ctx.addCompileError(std::make_shared<ConstantTooLarge>(token_));
+			return true;
+		}
+		if ((status != ConstantEvaluator::Status::OK) || setConstantValue(g, result)) {
+			debugLog(__LINE__);
+			return true;
+		}
+		ValueType constantType = valueType_;
+		if (castConstantToValueType_BasicType(g, constantType, generatedValue_, destType, generatedValue_)) {
+			debugLog(__LINE__);
+			return true;
+		}
+		valueType_ = destType;
+		return false;
 	}
 
-	// TODO: compatible check
-	// TODO: overflow check
-
-	if (g.createCast(srcType.basicType, value_->getGeneratedValue(), destType_.getValueType().basicType, generatedValue_)) {
+	if (g.createCast(srcType.basicType, value_->getGeneratedValue(), destType.basicType, generatedValue_)) {
 		debugLog(__LINE__);
 		return true;
 	}
-	valueType_ = destType_.getValueType();
+	valueType_ = destType;
 
 	return false;
 }
@@ -1351,10 +2162,17 @@ bool BlockNode::generateStatements(Generator& g, Context& ctx, const Generator::
 			ctx.addCompileError(std::make_shared < CanNotGiveInstructionAfterBreakOrReturn>(s->getToken()));
 			return true;
 		}
+		g.setDebugLocation(s->getToken());
 		if (s->generate(g, ctx)) {
 			return true;
 		}
 	}
+	if (!ctx.isBreaked() && !ctx.isReturned()) {
+		if (ctx.createReleases(g, ctx.getSymbolTableDepth() - 1)) {
+			debugLog(__LINE__);
+			return true;
+		}
+	}
 	ctx.removeSymbolTable();
 	if ((successorBlock != nullptr) && !ctx.isBreaked() && !ctx.isReturned()) {
 		if (g.createGoto(successorBlock)) {
@@ -1456,46 +2274,118 @@ bool LetNode::generate(Generator& g, Context& ctx) {
 		debugLog(__LINE__);
 		return true;
 	}
-	if (g.createAlloc(type_->getGeneratedType(), generatedPtr_)) {
-		debugLog(__LINE__);
+	if (type_->getValueType().isReference && !isHeap_ && (initialValue_ == nullptr)) {
+		// references are never null
+		ctx.addCompileError(std::make_shared<ReferenceMustBeInitializedError>(name_));
 		return true;
 	}
 
-	if (isHeap_) {
-		Generator::Value ptr1;
-		if (g.createCallMalloc(type_->getGeneratedType(), ptr1)) {
+	// a literal array that is never written is read from the constant pool, instead of being copied to the stack
+	generatedPtr_ = nullptr;
+	generatedVariable_ = nullptr;
+	if (ctx.isReadOnlyObject(this) && !type_->getValueType().arraySizes.empty() && Token::isConstant(initialValue_->getValueType().basicType)) {
+		if (!type_->getValueType().isCompatible(initialValue_->getValueType())) {
+			ctx.addCompileError(std::make_shared<TypeMismatchError>(token_, type_->getValueType(), initialValue_->getValueType()));
+			return true;
+		}
+		Generator::Value value;
+		if (castConstantToValueType(g, ctx, initialValue_, type_->getValueType(), value) || g.createGlobalConstant(value, generatedPtr_)) {
 			debugLog(__LINE__);
 			return true;
 		}
-
-		Generator::Value ptr2;
-		if (g.createBitCast(ptr1, type_->getGeneratedType(), ptr2)) {
+		if (ctx.addSymbol(name_.getString(), type_->getValueType(), generatedPtr_)) {
 			debugLog(__LINE__);
 			return true;
 		}
+		return false;
+	}
 
-		if (g.createStore(ptr2, generatedPtr_)) {
+	// only arrays and structs are addressed, so the other locals are kept in SSA form
+	auto& valueType = type_->getValueType();
+	if (valueType.arraySizes.empty() && (!valueType.isStruct() || valueType.isReference)) {
+		if (g.createVariable(type_->getGeneratedType(), type_->getValueType().isReference, generatedVariable_)) {
+			debugLog(__LINE__);
+			return true;
+		}
+		if (g.createDebugVariable(name_, type_->getValueType(), generatedVariable_)) {
+			debugLog(__LINE__);
+			return true;
+		}
+	}
+	else {
+		if (g.createAlloc(type_->getGeneratedType(), generatedPtr_)) {
 			debugLog(__LINE__);
 			return true;
 		}
+		if (g.createDebugLocalVariable(name_, type_->getValueType(), generatedPtr_)) {
+			debugLog(__LINE__);
+			return true;
+		}
+	}
+
+	if (isHeap_) {
+		Generator::Value value = nullptr;
+		if (initialValue_ != nullptr) {
+			if (!type_->getValueType().isCompatible(initialValue_->getValueType())) {
+				ctx.addCompileError(std::make_shared<TypeMismatchError>(token_, type_->getValueType(), initialValue_->getValueType()));
+				return true;
+			}
+			if (castConstantToValueType(g, ctx, initialValue_, type_->getValueType(), value)) {
+				debugLog(__LINE__);
+				return true;
+			}
+		}
+
+		if (g.isUnboxedReference(type_->getGeneratedType())) {
+			Generator::Value reference;
+			if (g.createUnboxedReference(type_->getGeneratedType(), value, reference) ||
+				initialize(g, reference))
+			{
+				debugLog(__LINE__);
+				return true;
+			}
+		}
+		else {
+			// the references held by a struct object are released with it when its count drops to zero, which a pinned count never does,
+			// so such an object is on the heap even in a region; the retains and releases of the others are removed,
+			// see Generator::optimizeReferenceCounting()
+			auto objectType = type_->getValueType();
+			objectType.isReference = false;
+			bool isPinned = !ctx.holdsReferences(objectType);
+			Generator::Value region;
+			Generator::Value ptr1;
+			bool error = false;
+			if (isPinned && ctx.isStackObject(this)) {
+				error = g.createStackObject(type_->getGeneratedType(), ptr1);
+			}
+			else if (isPinned && !ctx.getCurrentRegion(region)) {
+				error = g.createRegionObject(type_->getGeneratedType(), region, ptr1);
+			}
+			else {
+				error = g.createCallMalloc(type_->getGeneratedType(), ptr1);
+			}
+			if (error) {
+				debugLog(__LINE__);
+				return true;
+			}
 
-		Generator::Value value = nullptr;
-		if (initialValue_ != nullptr) {
-			if (!type_->getValueType().isCompatible(initialValue_->getValueType())) {
-				ctx.addCompileError(std::make_shared<TypeMismatchError>(token_, type_->getValueType(), initialValue_->getValueType()));
+			Generator::Value ptr2;
+			if (g.createBitCast(ptr1, type_->getGeneratedType(), ptr2)) {
+				debugLog(__LINE__);
 				return true;
 			}
-			if (castConstantToValueType(g, ctx, initialValue_, type_->getValueType(), value)) {
+
+			if (initialize(g, ptr2)) {
 				debugLog(__LINE__);
 				return true;
 			}
-		}
 
-		// TODO: set type id
+			// TODO: set type id
 
-		if (g.createInitializeObject(ptr2, value)) {
-			debugLog(__LINE__);
-			return true;
+			if (g.createInitializeObject(ptr2, value)) {
+				debugLog(__LINE__);
+				return true;
+			}
 		}
 	}
 	else {
@@ -1509,15 +2399,30 @@ bool LetNode::generate(Generator& g, Context& ctx) {
 				debugLog(__LINE__);
 				return true;
 			}
+			if (createRetainIfBorrowed(g, *initialValue_, value)) {
+				debugLog(__LINE__);
+				return true;
+			}
 		}
 
-		if (g.createStore(value, generatedPtr_)) {
+		if (initialize(g, value)) {
 			debugLog(__LINE__);
 			return true;
 		}
+
+		// the references held by a struct or an array are retained in place after it is copied
+		if ((generatedPtr_ != nullptr) && (initialValue_ != nullptr) && !initialValue_->isOwnedReference() && ctx.holdsReferences(type_->getValueType())) {
+			if (g.createRetainMembers(generatedPtr_, type_->getValueType().isReference)) {
+				debugLog(__LINE__);
+				return true;
+			}
+		}
 	}
 
-	if (ctx.addSymbol(name_.getString(), type_->getValueType(), generatedPtr_)) {
+	bool error = (generatedVariable_ != nullptr) ?
+		ctx.addSymbol(name_.getString(), type_->getValueType(), generatedVariable_) :
+		ctx.addSymbol(name_.getString(), type_->getValueType(), generatedPtr_);
+	if (error) {
 		debugLog(__LINE__);
 		return true;
 	}
@@ -1525,6 +2430,13 @@ bool LetNode::generate(Generator& g, Context& ctx) {
 	return false;
 }
 
+bool LetNode::initialize(Generator& g, Generator::Value value) {
+	if (generatedVariable_ != nullptr) {
+		return g.writeVariable(generatedVariable_, value);
+	}
+	return g.createStore(value, generatedPtr_);
+}
+
 bool IfNode::generate(Generator& g, Context& ctx) {
 	if (condition_->generate(g, ctx)) {
 		debugLog(__LINE__);
@@ -1542,6 +2454,20 @@ bool IfNode::generate(Generator& g, Context& ctx) {
 		debugLog(__LINE__);
 		return true;
 	}
+	if (elseBlock_ != nullptr) {
+		if (elseBlock_->generateBlock(g, nullptr, successorBlock)) {
+			debugLog(__LINE__);
+			return true;
+		}
+	}
+
+	// the branch comes first, so that the variables read in each arm find their definitions through it
+	Generator::BasicBlock falseBlock = (elseBlock_ != nullptr) ? elseBlock_->getGeneratedBlock() : successorBlock;
+	if (g.createIf(condition_->getGeneratedValue(), thenBlock_.getGeneratedBlock(), falseBlock)) {
+		debugLog(__LINE__);
+		return true;
+	}
+
 	if (thenBlock_.generateStatements(g, ctx, successorBlock)) {
 		debugLog(__LINE__);
 		return true;
@@ -1549,26 +2475,11 @@ bool IfNode::generate(Generator& g, Context& ctx) {
 	ctx.setLastBlock(successorBlock);
 
 	if (elseBlock_ != nullptr) {
-		if (elseBlock_->generateBlock(g, nullptr, successorBlock)) {
-			debugLog(__LINE__);
-			return true;
-		}
 		if (elseBlock_->generateStatements(g, ctx, successorBlock)) {
 			debugLog(__LINE__);
 			return true;
 		}
 		ctx.setLastBlock(successorBlock);
-
-		if (g.createIf(condition_->getGeneratedValue(), thenBlock_.getGeneratedBlock(), elseBlock_->getGeneratedBlock())) {
-			debugLog(__LINE__);
-			return true;
-		}
-	}
-	else {
-		if (g.createIf(condition_->getGeneratedValue(), thenBlock_.getGeneratedBlock(), successorBlock)) {
-			debugLog(__LINE__);
-			return true;
-		}
 	}
 
 	g.setInsertPoint(successorBlock);
@@ -1588,6 +2499,8 @@ bool WhileNode::generate(Generator& g, Context& ctx) {
 		return true;
 	}
 	g.setInsertPoint(conditionBlock);
+	// the back edge is added after the body
+	g.unsealBlock(conditionBlock);
 
 	if (condition_->generate(g, ctx)) {
 		debugLog(__LINE__);
@@ -1614,10 +2527,21 @@ bool WhileNode::generate(Generator& g, Context& ctx) {
 	}
 	g.setInsertPoint(block_.getGeneratedBlock());
 
+	if (g.isTieredCompilation()) {
+		if (g.createIncrementTierCounter()) {
+			debugLog(__LINE__);
+			return true;
+		}
+	}
+
 	if (block_.generateStatements(g, ctx, conditionBlock)) {
 		debugLog(__LINE__);
 		return true;
 	}
+	if (g.sealBlock(conditionBlock)) {
+		debugLog(__LINE__);
+		return true;
+	}
 	ctx.setLastBlock(successorBlock);
 
 	ctx.removeSuccessorBlockForBreak();
@@ -1628,6 +2552,47 @@ bool WhileNode::generate(Generator& g, Context& ctx) {
 	return false;
 }
 
+bool RegionNode::generate(Generator& g, Context& ctx) {
+	Generator::Value region;
+	if (g.createEnterRegion(region)) {
+		debugLog(__LINE__);
+		return true;
+	}
+
+	Generator::BasicBlock successorBlock;
+	if (g.createBasicBlock(nullptr, ctx.getLastBlock(), successorBlock)) {
+		debugLog(__LINE__);
+		return true;
+	}
+	ctx.setLastBlock(successorBlock);
+
+	if (block_.generateBlock(g, nullptr, successorBlock) ||
+		g.createGoto(block_.getGeneratedBlock()))
+	{
+		debugLog(__LINE__);
+		return true;
+	}
+
+	// the region is exited when the symbol table of the block is released
+	ctx.addRegion(region);
+	if (block_.generateStatements(g, ctx, successorBlock)) {
+		debugLog(__LINE__);
+		return true;
+	}
+	ctx.removeRegion();
+	ctx.setLastBlock(successorBlock);
+
+	g.setInsertPoint(successorBlock);
+	if (ctx.isReturned()) {
+		if (g.createUnreachable()) {
+			debugLog(__LINE__);
+			return true;
+		}
+	}
+
+	return false;
+}
+
 bool ReturnNode::generate(Generator& g, Context& ctx) {
 	if (value_) {
 		if (value_->generate(g, ctx)) {
@@ -1651,7 +2616,7 @@ bool ReturnNode::generate(Generator& g, Context& ctx) {
 					ctx.addCompileError(std::make_shared<TypeMismatchError>(returnToken_, returnType, valueType));
 					return true;
 				}
-				if (g.createReturn(value_->getGeneratedValue())) {
+				if (createReturn(g, ctx, value_->getGeneratedValue())) {
 					debugLog(__LINE__);
 					return true;
 				}
@@ -1670,7 +2635,7 @@ bool ReturnNode::generate(Generator& g, Context& ctx) {
 					}
 				}
 
-				if (g.createReturn(returnValue)) {
+				if (createReturn(g, ctx, returnValue)) {
 					debugLog(__LINE__);
 					return true;
 				}
@@ -1691,7 +2656,7 @@ bool ReturnNode::generate(Generator& g, Context& ctx) {
 					}
 				}
 
-				if (g.createReturn(returnValue)) {
+				if (createReturn(g, ctx, returnValue)) {
 					debugLog(__LINE__);
 					return true;
 				}
@@ -1705,92 +2670,391 @@ bool ReturnNode::generate(Generator& g, Context& ctx) {
 					ctx.addCompileError(std::make_shared<TypeMismatchError>(returnToken_, returnType, valueType));
 					return true;
 				}
-				if (g.createReturn(value_->getGeneratedValue())) {
+				if (createRetainMembersIfBorrowed(g, ctx, *value_, value_->getGeneratedValue())) {
+					debugLog(__LINE__);
+					return true;
+				}
+				if (createReturn(g, ctx, value_->getGeneratedValue())) {
 					debugLog(__LINE__);
 					return true;
 				}
 
-				break;
-			}
+				break;
+			}
+		}
+		else {
+			if (!returnType.isCompatible(value_->getValueType())) {
+				ctx.addCompileError(std::make_shared<TypeMismatchError>(returnToken_, returnType, valueType));
+				return true;
+			}
+			Generator::Value returnValue;
+			if (castConstantToValueType(g, ctx, value_, returnType, returnValue)) {
+				debugLog(__LINE__);
+				return true;
+			}
+			if (createRetainIfBorrowed(g, *value_, returnValue) || createRetainMembersIfBorrowed(g, ctx, *value_, returnValue)) {
+				debugLog(__LINE__);
+				return true;
+			}
+			if (createReturn(g, ctx, returnValue)) {
+				debugLog(__LINE__);
+				return true;
+			}
+		}
+	}
+	else {
+		if (createReturn(g, ctx, nullptr)) {
+			debugLog(__LINE__);
+			return true;
+		}
+	}
+
+	ctx.setBreaked(true);
+	ctx.setReturned(true);
+
+	return false;
+}
+
+bool ReturnNode::createReturn(Generator& g, Context& ctx, Generator::Value value) {
+	if (ctx.createReleases(g, 0)) {
+		debugLog(__LINE__);
+		return true;
+	}
+	return (value != nullptr) ? g.createReturn(value) : g.createReturnVoid();
+}
+
+bool BreakNode::generate(Generator& g, Context& ctx) {
+	Generator::BasicBlock successor = ctx.getSuccessorBlockForBreak();
+	if (successor == nullptr) {
+		ctx.addCompileError(std::make_shared<InvalidBreakError>(token_));
+		return true;
+	}
+
+	if (ctx.createReleases(g, ctx.getSymbolTableDepthForBreak())) {
+		debugLog(__LINE__);
+		return true;
+	}
+	if (g.createGoto(successor)) {
+		debugLog(__LINE__);
+		return true;
+	}
+
+	ctx.setBreaked(true);
+
+	return false;
+}
+
+bool AssignNode::generate(Generator& g, Context& ctx) {
+	if (dest_.generate(g, ctx)) {
+		debugLog(__LINE__);
+		return true;
+	}
+
+	if (dest_.getValueType().isArgument) {
+		ctx.addCompileError(std::make_shared<CanNotOverwriteArgumentError>(this->token_));
+		return true;
+	}
+	if (!dest_.isAssignable()) {
+		ctx.addCompileError(std::make_shared<NotAssignableError>(this->token_));
+		return true;
+	}
+
+	if (value_->generate(g, ctx)) {
+		debugLog(__LINE__);
+		return true;
+	}
+
+	Generator::Value temp;
+	if (!value_->getValueType().isCompatible(dest_.getValueType())) {
+		ctx.addCompileError(std::make_shared<TypeMismatchError>(token_, dest_.getValueType(), value_->getValueType()));
+		return true;
+	}
+	if (castConstantToValueType(g, ctx, value_, dest_.getValueType(), temp)) {
+		debugLog(__LINE__);
+		return true;
+	}
+
+	// the new reference is retained before the old one is released, in case they are the same object
+	auto& destType = dest_.getValueType();
+	bool isMembers = (!destType.isReference || !destType.arraySizes.empty()) && ctx.holdsReferences(destType);
+	if (destType.isReference && !isMembers) {
+		if (createRetainIfBorrowed(g, *value_, temp)) {
+			debugLog(__LINE__);
+			return true;
+		}
+
+		Generator::Value old;
+		bool error = (dest_.getGeneratedVariable() != nullptr) ?
+			g.readVariable(dest_.getGeneratedVariable(), old) :
+			g.createLoad(dest_.getGeneratedVariablePtr(), old);
+		if (error || g.createRelease(old)) {
+			debugLog(__LINE__);
+			return true;
+		}
+	}
+
+	// the references held by an overwritten struct or array are released after the new ones are retained,
+	// so they are kept aside in a copy
+	Generator::Value oldPtr = nullptr;
+	if (isMembers) {
+		Generator::Value old;
+		if (g.createLoad(dest_.getGeneratedVariablePtr(), old) || g.createLocalCopy(old, oldPtr)) {
+			debugLog(__LINE__);
+			return true;
+		}
+	}
+
+	bool error = (dest_.getGeneratedVariable() != nullptr) ?
+		g.writeVariable(dest_.getGeneratedVariable(), temp) :
+		g.createStore(temp, dest_.getGeneratedVariablePtr());
+	if (error) {
+		debugLog(__LINE__);
+		return true;
+	}
+
+	if (isMembers) {
+		if (!value_->isOwnedReference() && g.createRetainMembers(dest_.getGeneratedVariablePtr(), destType.isReference)) {
+			debugLog(__LINE__);
+			return true;
+		}
+		if (g.createReleaseMembers(oldPtr, destType.isReference)) {
+			debugLog(__LINE__);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool StatementNode::checkConstFunction(Context& ctx) const {
+	ctx.addCompileError(std::make_shared<NotAllowedInConstFunctionError>(getToken()));
+	return true;
+}
+
+bool BlockNode::checkConstFunction(Context& ctx) const {
+	bool error = false;
+	for (auto& s : statements_) {
+		if (s->checkConstFunction(ctx)) {
+			error = true;
+		}
+	}
+	return error;
+}
+
+bool BlockNode::execute(Interpreter& interpreter) const {
+	interpreter.addScope();
+	for (auto& s : statements_) {
+		if (interpreter.step() || s->execute(interpreter)) {
+			return true;
+		}
+		if (interpreter.isReturned() || interpreter.isBreaked()) {
+			break;
+		}
+	}
+	interpreter.removeScope();
+
+	return false;
+}
+
+bool LetNode::checkConstFunction(Context& ctx) const {
+	if (isHeap_ || (initialValue_ == nullptr) || ((type_ != nullptr) && !type_->isScalar())) {
+		return StatementNode::checkConstFunction(ctx);
+	}
+	return initialValue_->checkConstFunction(ctx);
+}
+
+bool LetNode::execute(Interpreter& interpreter) const {
+	Interpreter::Value value;
+	if (initialValue_->evaluate(interpreter, value)) {
+		return true;
+	}
+
+	Token::Type type = (type_ != nullptr) ? type_->getValueType().basicType : Interpreter::getDefaultType(value.type);
+	Interpreter::Value variable;
+	if (Interpreter::convert(value, type, variable)) {
+		return true;
+	}
+
+	return interpreter.addVariable(name_.getString(), variable);
+}
+
+bool IfNode::checkConstFunction(Context& ctx) const {
+	bool error = condition_->checkConstFunction(ctx);
+	if (thenBlock_.checkConstFunction(ctx)) {
+		error = true;
+	}
+	if ((elseBlock_ != nullptr) && elseBlock_->checkConstFunction(ctx)) {
+		error = true;
+	}
+	return error;
+}
+
+bool IfNode::execute(Interpreter& interpreter) const {
+	Interpreter::Value condition;
+	bool isTrue;
+	if (condition_->evaluate(interpreter, condition) || getBool(condition, isTrue)) {
+		return true;
+	}
+
+	if (isTrue) {
+		return thenBlock_.execute(interpreter);
+	}
+	if (elseBlock_ != nullptr) {
+		return elseBlock_->execute(interpreter);
+	}
+	return false;
+}
+
+bool WhileNode::checkConstFunction(Context& ctx) const {
+	bool error = condition_->checkConstFunction(ctx);
+	if (block_.checkConstFunction(ctx)) {
+		error = true;
+	}
+	return error;
+}
+
+bool WhileNode::execute(Interpreter& interpreter) const {
+	while (true) {
+		Interpreter::Value condition;
+		bool isTrue;
+		if (interpreter.step() || condition_->evaluate(interpreter, condition) || getBool(condition, isTrue)) {
+			return true;
 		}
-		else {
-			if (!returnType.isCompatible(value_->getValueType())) {
-				ctx.addCompileError(std::make_shared<TypeMismatchError>(returnToken_, returnType, valueType));
-				return true;
-			}
-			Generator::Value returnValue;
-			if (castConstantToValueType(g, ctx, value_, returnType, returnValue)) {
-				debugLog(__LINE__);
-				return true;
-			}
-			if (g.createReturn(returnValue)) {
-				debugLog(__LINE__);
-				return true;
-			}
+		if (!isTrue) {
+			break;
 		}
-	}
-	else {
-		if (g.createReturnVoid()) {
-			debugLog(__LINE__);
+
+		if (block_.execute(interpreter)) {
 			return true;
 		}
+		if (interpreter.isReturned()) {
+			break;
+		}
+		if (interpreter.isBreaked()) {
+			interpreter.setBreaked(false);
+			break;
+		}
 	}
 
-	ctx.setBreaked(true);
-	ctx.setReturned(true);
-
 	return false;
 }
 
-bool BreakNode::generate(Generator& g, Context& ctx) {
-	Generator::BasicBlock successor = ctx.getSuccessorBlockForBreak();
-	if (successor == nullptr) {
-		ctx.addCompileError(std::make_shared<InvalidBreakError>(token_));
-		return true;
+bool ReturnNode::checkConstFunction(Context& ctx) const {
+	if (value_ == nullptr) {
+		return StatementNode::checkConstFunction(ctx);
 	}
+	return value_->checkConstFunction(ctx);
+}
 
-	if (g.createGoto(successor)) {
-		debugLog(__LINE__);
+bool ReturnNode::execute(Interpreter& interpreter) const {
+	Interpreter::Value value;
+	if (value_->evaluate(interpreter, value)) {
 		return true;
 	}
+	return interpreter.setReturnValue(value);
+}
 
-	ctx.setBreaked(true);
+bool BreakNode::checkConstFunction(Context&) const {
+	return false;
+}
 
+bool BreakNode::execute(Interpreter& interpreter) const {
+	interpreter.setBreaked(true);
 	return false;
 }
 
-bool AssignNode::generate(Generator& g, Context& ctx) {
-	if (dest_.generate(g, ctx)) {
-		debugLog(__LINE__);
-		return true;
+bool AssignNode::checkConstFunction(Context& ctx) const {
+	bool error = dest_.checkConstFunction(ctx);
+	if (value_->checkConstFunction(ctx)) {
+		error = true;
 	}
+	return error;
+}
 
-	if (dest_.getValueType().isArgument) {
-		ctx.addCompileError(std::make_shared<CanNotOverwriteArgumentError>(this->token_));
+bool AssignNode::execute(Interpreter& interpreter) const {
+	Interpreter::Value value;
+	if (value_->evaluate(interpreter, value)) {
 		return true;
 	}
+	return interpreter.setVariable(dest_.getName().getString(), value);
+}
 
-	if (value_->generate(g, ctx)) {
-		debugLog(__LINE__);
-		return true;
+void BlockNode::analyzeEscape(EscapeAnalysis& analysis) const {
+	analysis.addScope();
+	for (auto& s : statements_) {
+		s->analyzeEscape(analysis);
 	}
+	analysis.removeScope();
+}
 
-	Generator::Value temp;
-	if (!value_->getValueType().isCompatible(dest_.getValueType())) {
-		ctx.addCompileError(std::make_shared<TypeMismatchError>(token_, dest_.getValueType(), value_->getValueType()));
-		return true;
+void LetNode::analyzeEscape(EscapeAnalysis& analysis) const {
+	std::vector<size_t> sources;
+	if (initialValue_ != nullptr) {
+		initialValue_->analyzeEscape(analysis, sources);
 	}
-	if (castConstantToValueType(g, ctx, value_, dest_.getValueType(), temp)) {
-		debugLog(__LINE__);
-		return true;
+
+	size_t variable = analysis.addVariable(name_.getString());
+	if ((type_ != nullptr) && isNumberSliceType(type_->getValueType())) {
+		analysis.setNumberSlice(variable);
+	}
+	if (isHeap_) {
+		analysis.addObject(variable, this);
+		if (analysis.isInRegion()) {
+			analysis.addRegionObject(variable, name_, this);
+		}
+		// stored into the new object
+		analysis.addEscape(sources);
+	}
+	else {
+		analysis.addFlow(sources, variable);
+		if (initialValue_ != nullptr) {
+			analysis.addReadOnlyObject(variable, this);
+		}
 	}
+}
 
-	if (g.createStore(temp, dest_.getGeneratedVariablePtr())) {
-		debugLog(__LINE__);
-		return true;
+void IfNode::analyzeEscape(EscapeAnalysis& analysis) const {
+	std::vector<size_t> sources;
+	condition_->analyzeEscape(analysis, sources);
+	thenBlock_.analyzeEscape(analysis);
+	if (elseBlock_ != nullptr) {
+		elseBlock_->analyzeEscape(analysis);
 	}
+}
 
-	return false;
+void WhileNode::analyzeEscape(EscapeAnalysis& analysis) const {
+	analysis.enterLoop();
+	std::vector<size_t> sources;
+	condition_->analyzeEscape(analysis, sources);
+	block_.analyzeEscape(analysis);
+	analysis.exitLoop();
+}
+
+void RegionNode::analyzeEscape(EscapeAnalysis& analysis) const {
+	analysis.enterRegion();
+	block_.analyzeEscape(analysis);
+	analysis.exitRegion();
+}
+
+void ReturnNode::analyzeEscape(EscapeAnalysis& analysis) const {
+	if (value_ != nullptr) {
+		std::vector<size_t> sources;
+		value_->analyzeEscape(analysis, sources);
+		analysis.addEscape(sources);
+		analysis.addReturn(sources);
+	}
+}
+
+void AssignNode::analyzeEscape(EscapeAnalysis& analysis) const {
+	std::vector<size_t> sources;
+	value_->analyzeEscape(analysis, sources);
+	dest_.analyzeIndexEscape(analysis);
+
+	size_t variable;
+	if (!analysis.getVariable(dest_.getName().getString(), variable)) {
+		analysis.addFlow(sources, variable);
+		analysis.addWrite(variable);
+	}
 }
 
 bool CompileUnitNode::generate(Generator& g, Context& ctx) {
@@ -1814,6 +3078,9 @@ bool CompileUnitNode::generate(Generator& g, Context& ctx) {
 		}
 	}
 	for (auto& f : functions_) {
+		if (ctx.isReusedFunction(f.getName().getString())) {
+			continue;
+		}
 		if (f.generateDefine(g, ctx)) {
 			debugLog(__LINE__);
 			return true;
@@ -1823,6 +3090,15 @@ bool CompileUnitNode::generate(Generator& g, Context& ctx) {
 	return false;
 }
 
+const StructNode* CompileUnitNode::getStructNode(const std::string& name) const {
+	for (auto& s : structs_) {
+		if (s.getName().getString() == name) {
+			return &s;
+		}
+	}
+	return nullptr;
+}
+
 const FunctionNode* CompileUnitNode::getFunctionNode(const std::string& name) const {
 	for (auto& f : functions_) {
 		if (f.getName().getString() == name) {
@@ -1837,21 +3113,53 @@ bool StructNode::generateType(Generator& g) {
 }
 
 bool StructNode::generateMember(Generator& g, Context& ctx) {
-	std::vector<Generator::Type> types;
-	types.push_back(g.getSizeType());
-	for (auto member : members_) {
+	memberTypes_.clear();
+	for (auto& member : members_) {
 		if (member.generateType(g, ctx)) {
 			debugLog(__LINE__);
 			return true;
 		}
-		types.push_back(member.getGeneratedType());
+		memberTypes_.push_back(member.getGeneratedType());
+	}
+
+	// lay out the members by decreasing alignment to minimize padding, unless the layout is shared with C
+	std::vector<size_t> order(memberTypes_.size());
+	for (size_t i = 0; i < order.size(); ++i) {
+		order[i] = i;
+	}
+	if (!isReprC_) {
+		std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+			return g.getAlignment(memberTypes_[a]) > g.getAlignment(memberTypes_[b]);
+		});
+	}
+
+	// the header of a struct is the reference count of an object, so that it can be allocated as one
+	std::vector<Generator::Type> types;
+	types.push_back(g.getReferenceCountType());
+	memberIndices_.assign(memberTypes_.size(), 0);
+	std::vector<bool> isReference(1, false);
+	for (auto i : order) {
+		memberIndices_[i] = types.size();
+		types.push_back(memberTypes_[i]);
+		isReference.push_back(members_[i].getValueType().isReference);
 	}
 
 	generatedType_->setBody(types, false);
+	g.setReferenceMembers(generatedType_, isReference);
 
 	return false;
 }
 
+bool StructNode::findMember(const std::string& name, size_t& result) const {
+	for (size_t i = 0; i < members_.size(); ++i) {
+		if (members_[i].getName().getString() == name) {
+			result = i;
+			return false;
+		}
+	}
+	return true;
+}
+
 bool FunctionNode::generateDeclare(Generator& g, Context& ctx) {
 
 	// TODO: duplicate check
@@ -1881,10 +3189,56 @@ bool FunctionNode::generateDeclare(Generator& g, Context& ctx) {
 		return true;
 	}
 
+	if (type_ == Type::MAHINA) {
+		Generator::Inlining inlining;
+		if (getInlining(ctx, inlining)) {
+			return true;
+		}
+		if (g.setInlining(generatedFunction_, inlining)) {
+			debugLog(__LINE__);
+			return true;
+		}
+
+		// there are no exceptions in mahina
+		if (g.setNoUnwind(generatedFunction_) ||
+			g.setMemoryEffect(generatedFunction_, getMemoryEffect()))
+		{
+			debugLog(__LINE__);
+			return true;
+		}
+
+		// C functions may pass and return null, but mahina references are always initialized
+		for (size_t i = 0; i < args_.size(); ++i) {
+			if (args_[i].getValueType().isReference) {
+				if (g.setReferenceArgument(generatedFunction_, static_cast<unsigned int>(i))) {
+					debugLog(__LINE__);
+					return true;
+				}
+			}
+		}
+		if (returnType_.getValueType().isReference) {
+			if (g.setReferenceReturn(generatedFunction_)) {
+				debugLog(__LINE__);
+				return true;
+			}
+		}
+	}
+
+	if (g.isTieredCompilation() && (type_ == Type::MAHINA)) {
+		if (g.createTierStub(generatedFunction_)) {
+			debugLog(__LINE__);
+			return true;
+		}
+	}
+
 	return false;
 }
 
 bool FunctionNode::generateDefine(Generator& g, Context& ctx) {
+	if (isConst_ && checkConstFunction(ctx)) {
+		return true;
+	}
+
 	if (block_ != nullptr) {
 		if (block_->generateBlock(g, generatedFunction_, nullptr)) {
 			debugLog(__LINE__);
@@ -1892,6 +3246,22 @@ bool FunctionNode::generateDefine(Generator& g, Context& ctx) {
 		}
 		g.setInsertPoint(block_->getGeneratedBlock());
 
+		if (g.createDebugFunction(generatedFunction_, name_)) {
+			debugLog(__LINE__);
+			return true;
+		}
+
+		if (g.isTieredCompilation()) {
+			if (g.createIncrementTierCounter()) {
+				debugLog(__LINE__);
+				return true;
+			}
+		}
+
+		g.clearVariables();
+		if (setStackObjects(ctx)) {
+			return true;
+		}
 		ctx.addSymbolTable();
 		if (addArgumentToSymbolTable(g, ctx)) {
 			debugLog(__LINE__);
@@ -1900,10 +3270,13 @@ bool FunctionNode::generateDefine(Generator& g, Context& ctx) {
 
 		ValueType returnType = returnType_.getValueType();
 		g.setCurrentReturnType(returnType);
+		g.setFlatten(hasAttribute("flatten"));
+		ctx.setBoundsChecked(!hasAttribute("unchecked"));
 		if (block_->generateStatements(g, ctx)) {
 			debugLog(__LINE__);
 			return true;
 		}
+		g.setFlatten(false);
 
 		if (ctx.removeSymbolTable()) {
 			debugLog(__LINE__);
@@ -1920,6 +3293,7 @@ bool FunctionNode::generateDefine(Generator& g, Context& ctx) {
 				else {
 					g.setInsertPoint(ctx.getLastBlock());
 				}
+				g.setDebugLocation(block_->getRightCurlyBracketToken());
 				g.createReturnVoid();
 			}
 			else {
@@ -1930,10 +3304,149 @@ bool FunctionNode::generateDefine(Generator& g, Context& ctx) {
 		ctx.setReturned(false);
 
 		ctx.setLastBlock(nullptr);
+		if (g.optimizeReferenceCounting(generatedFunction_)) {
+			debugLog(__LINE__);
+			return true;
+		}
+		g.finishDebugFunction();
+	}
+	return false;
+}
+
+bool FunctionNode::hasAttribute(const std::string& name) const {
+	for (auto& attribute : attributes_) {
+		if (attribute.getString() == name) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool FunctionNode::getInlining(Context& ctx, Generator::Inlining& result) const {
+	const Token* inlineAttribute = nullptr;
+	const Token* noinlineAttribute = nullptr;
+	for (auto& attribute : attributes_) {
+		if (attribute.getString() == "inline") {
+			inlineAttribute = &attribute;
+		}
+		else if (attribute.getString() == "noinline") {
+			noinlineAttribute = &attribute;
+		}
+	}
+
+	if ((inlineAttribute != nullptr) && (noinlineAttribute != nullptr)) {
+		ctx.addCompileError(std::make_shared<ConflictingAttributeError>(*noinlineAttribute));
+		return true;
+	}
+
+	if (inlineAttribute != nullptr) {
+		result = Generator::Inlining::ALWAYS;
+	}
+	else if (noinlineAttribute != nullptr) {
+		result = Generator::Inlining::NEVER;
 	}
+	else if (callees_.empty() && (bodySize_ <= kInlineHintBodySize) && (name_.getString() != "main")) {
+		// tiny leaf functions such as accessors
+		result = Generator::Inlining::HINT;
+	}
+	else {
+		result = Generator::Inlining::DEFAULT;
+	}
+
 	return false;
 }
 
+Generator::MemoryEffect FunctionNode::getMemoryEffect() const {
+	// pure implies readonly
+	if (hasAttribute("pure")) {
+		return Generator::MemoryEffect::NONE;
+	}
+	if (hasAttribute("readonly")) {
+		return Generator::MemoryEffect::READ_ONLY;
+	}
+	return Generator::MemoryEffect::ANY;
+}
+
+bool FunctionNode::checkConstFunction(Context& ctx) const {
+	bool error = false;
+	if (!returnType_.isScalar()) {
+		ctx.addCompileError(std::make_shared<NotAllowedInConstFunctionError>(name_));
+		error = true;
+	}
+	for (auto& arg : args_) {
+		if (!isScalarType(arg.getValueType())) {
+			ctx.addCompileError(std::make_shared<NotAllowedInConstFunctionError>(arg.getName()));
+			error = true;
+		}
+	}
+	if (block_->checkConstFunction(ctx)) {
+		error = true;
+	}
+	return error;
+}
+
+void FunctionNode::getCapturedArguments(Context& ctx, std::vector<bool>& result) const {
+	if ((type_ != Type::MAHINA) || (block_ == nullptr)) {
+		result.assign(args_.size(), true);
+		return;
+	}
+	if (!ctx.getCapturedArguments(name_.getString(), result)) {
+		return;
+	}
+
+	// recursive calls are assumed to capture every argument
+	ctx.setCapturedArguments(name_.getString(), std::vector<bool>(args_.size(), true));
+
+	EscapeAnalysis analysis(ctx);
+	analysis.addScope();
+	std::vector<size_t> arguments;
+	for (auto& arg : args_) {
+		arguments.push_back(analysis.addVariable(arg.getName().getString()));
+		if (isNumberSliceType(arg.getValueType())) {
+			analysis.setNumberSlice(arguments.back());
+		}
+	}
+	block_->analyzeEscape(analysis);
+
+	result.clear();
+	for (auto argument : arguments) {
+		result.push_back(analysis.isEscaping(argument));
+	}
+	ctx.setCapturedArguments(name_.getString(), result);
+	ctx.setReturningNewObject(name_.getString(), analysis.isReturningNewObject());
+}
+
+bool FunctionNode::setStackObjects(Context& ctx) const {
+	EscapeAnalysis analysis(ctx);
+	analysis.addScope();
+	for (auto& arg : args_) {
+		size_t variable = analysis.addVariable(arg.getName().getString());
+		if (isNumberSliceType(arg.getValueType())) {
+			analysis.setNumberSlice(variable);
+		}
+	}
+	block_->analyzeEscape(analysis);
+
+	std::set<const LetNode*> stackObjects;
+	analysis.getStackObjects(stackObjects);
+	ctx.setStackObjects(stackObjects);
+
+	std::set<const LetNode*> readOnlyObjects;
+	analysis.getReadOnlyObjects(readOnlyObjects);
+	ctx.setReadOnlyObjects(readOnlyObjects);
+
+	std::set<const VariableValueNode*> escapingViews;
+	analysis.getEscapingViews(escapingViews);
+	ctx.setEscapingViews(escapingViews);
+
+	std::vector<Token> regionObjects;
+	analysis.getEscapingRegionObjects(regionObjects);
+	for (auto& token : regionObjects) {
+		ctx.addCompileError(std::make_shared<RegionObjectEscapesError>(token));
+	}
+	return !regionObjects.empty();
+}
+
 bool FunctionNode::addArgumentToSymbolTable(Generator& g, Context& ctx) {
 	size_t index = 0;
 	for (auto& arg : args_) {
@@ -1943,7 +3456,19 @@ bool FunctionNode::addArgumentToSymbolTable(Generator& g, Context& ctx) {
 			return true;
 		}
 
-		if (ctx.addSymbol(arg.getName().getString(), arg.getValueType(), argValue)) {
+		// an array or a struct is copied once to be addressed, instead of at each access to an element or a member
+		Generator::Value symbolValue = argValue;
+		if (isAddressedType(arg.getValueType()) && g.createLocalCopy(argValue, symbolValue)) {
+			debugLog(__LINE__);
+			return true;
+		}
+		if (ctx.addSymbol(arg.getName().getString(), arg.getValueType(), symbolValue)) {
+			debugLog(__LINE__);
+			return true;
+		}
+
+		// DWARF numbers arguments from 1
+		if (g.createDebugParameter(arg.getName(), arg.getValueType(), static_cast<unsigned int>(index + 1), argValue)) {
 			debugLog(__LINE__);
 			return true;
 		}
@@ -1964,6 +3489,10 @@ bool Context::generate(Generator& g) {
 			return true;
 		}
 	}
+	if (g.finalizeDebugInfo()) {
+		debugLog(__LINE__);
+		return true;
+	}
 	return false;
 }
 
@@ -1986,11 +3515,81 @@ bool Context::addSymbol(const std::string& name, const ValueType& type, Generato
 		debugLog(__LINE__);
 		return true;
 	}
-	table->push_back(Symbol({ name, type, value }));
+	table->push_back(Symbol({ name, type, value, nullptr }));
+	return false;
+}
+
+bool Context::addSymbol(const std::string& name, const ValueType& type, Generator::Variable variable) {
+	auto table = symbolTables_.rbegin();
+	if (table == symbolTables_.rend()) {
+		debugLog(__LINE__);
+		return true;
+	}
+	table->push_back(Symbol({ name, type, nullptr, variable }));
+	return false;
+}
+
+bool Context::createReleases(Generator& g, size_t depth) const {
+	for (size_t i = symbolTables_.size(); i > depth; i--) {
+		auto& table = symbolTables_[i - 1];
+		for (auto symbol = table.rbegin(); symbol != table.rend(); ++symbol) {
+			if (symbol->type.isArgument || !holdsReferences(symbol->type)) {
+				continue;
+			}
+
+			// a struct or an array is addressed
+			if (!symbol->type.isReference || !symbol->type.arraySizes.empty()) {
+				if (g.createReleaseMembers(symbol->value, symbol->type.isReference)) {
+					debugLog(__LINE__);
+					return true;
+				}
+				continue;
+			}
+
+			Generator::Value value;
+			bool error = (symbol->variable != nullptr) ?
+				g.readVariable(symbol->variable, value) :
+				g.createLoad(symbol->value, value);
+			if (error || g.createRelease(value)) {
+				debugLog(__LINE__);
+				return true;
+			}
+		}
+
+		// the objects of the region are not touched after it is exited, see EscapeAnalysis
+		for (auto region = regions_.rbegin(); region != regions_.rend(); ++region) {
+			if (region->first == i - 1) {
+				if (g.createExitRegion(region->second)) {
+					debugLog(__LINE__);
+					return true;
+				}
+			}
+		}
+	}
+	return false;
+}
+
+bool Context::holdsReferences(const ValueType& type) const {
+	if (type.isReference) {
+		return true;
+	}
+	if (!type.isStruct() || (type.pointerCount != 0) || type.isSlice) {
+		return false;
+	}
+
+	auto structNode = getStructNode(type.structName);
+	if (structNode == nullptr) {
+		return false;
+	}
+	for (size_t i = 0; i < structNode->getMemberCount(); ++i) {
+		if (holdsReferences(structNode->getMemberValueType(i))) {
+			return true;
+		}
+	}
 	return false;
 }
 
-bool Context::getSymbol(const std::string& name, ValueType& resultType, Generator::Value& resultValue) const {
+bool Context::getSymbol(const std::string& name, ValueType& resultType, Generator::Value& resultValue, Generator::Variable& resultVariable) const {
 	auto tableEnd = symbolTables_.rend();
 	for (auto table = symbolTables_.rbegin(); table != tableEnd; ++table) {
 		auto symbolEnd = table->rend();
@@ -1998,6 +3597,7 @@ bool Context::getSymbol(const std::string& name, ValueType& resultType, Generato
 			if (name == symbol->name) {
 				resultType = symbol->type;
 				resultValue = symbol->value;
+				resultVariable = symbol->variable;
 				return false;
 			}
 		}
@@ -4,10 +4,15 @@
 #include <string>
 #include <ostream>
 #include <memory>
+#include <map>
+#include <set>
 #include "Token.h"
 #include "DebugPrinter.h"
 #include "Generator.h"
 #include "CompileError.h"
+#include "ConstantEvaluator.h"
+#include "Interpreter.h"
+#include "EscapeAnalysis.h"
 
 class TypeNode;
 class VariableDefinitionNode;
@@ -25,6 +30,7 @@ class BlockNode;
 class LetNode;
 class IfNode;
 class WhileNode;
+class RegionNode;
 class ReturnNode;
 class BreakNode;
 class AssignNode;
@@ -67,6 +73,14 @@ public:
 	virtual ~StatementNode() = default;
 	virtual void debugPrint(DebugPrinter&) = 0;
 	virtual bool generate(Generator&, Context&) = 0;
+
+	// statements allowed in const functions (see Interpreter)
+	virtual bool checkConstFunction(Context& ctx) const;
+	virtual bool execute(Interpreter&) const {
+		return true;
+	}
+
+	virtual void analyzeEscape(EscapeAnalysis&) const {}
 };
 
 class ExpressionNode : virtual public Node {
@@ -153,6 +167,31 @@ public:
 		return constantString_;
 	}
 
+	// true when the expression can be evaluated even if the program would not have,
+	// i.e. it has no side effects, can not trap, and fits in the remaining budget of nodes
+	virtual bool isCheapToSpeculate(size_t&) const {
+		return false;
+	}
+
+	// true when the generated reference, or the references held by the generated struct or array,
+	// are owned by the expression (e.g. returned by a call),
+	// and false when they are borrowed from a variable and have to be retained to be kept
+	virtual bool isOwnedReference() const {
+		return false;
+	}
+
+	// the value of a constant bool, integer or float expression after it is generated
+	bool getConstantValue(ConstantValue& result) const;
+
+	// expressions allowed in const functions (see Interpreter)
+	virtual bool checkConstFunction(Context& ctx) const;
+	virtual bool evaluate(Interpreter&, Interpreter::Value&) const {
+		return true;
+	}
+
+	// adds the variables whose objects the expression may evaluate to
+	virtual void analyzeEscape(EscapeAnalysis&, std::vector<size_t>&) const {}
+
 protected:
 	Generator::Value generatedValue_;
 	Generator::Value generatedValueBoolArray_;
@@ -172,6 +211,8 @@ protected:
 	int64_t constantInteger_;
 	double constantDouble_;
 	std::string constantString_;
+
+	bool setConstantValue(Generator& g, const ConstantValue& value);
 };
 
 class TypeNode : public Node {
@@ -188,6 +229,14 @@ public:
 		type_.pointerCount = pointerCount;
 	}
 
+	void setStructName(const std::string& name) {
+		type_.structName = name;
+	}
+
+	void setIsSlice(bool isSlice) {
+		type_.isSlice = isSlice;
+	}
+
 	const ValueType& getValueType() const {
 		return type_;
 	}
@@ -212,6 +261,8 @@ public:
 		type_ = type;
 	}
 
+	bool isScalar() const;
+
 private:
 	ValueType type_;
 	Generator::Type generatedType_;
@@ -258,6 +309,15 @@ public:
 		value_ = value;
 	}
 
+	const Token& getToken() const {
+		return operatorType_;
+	}
+
+	bool isCheapToSpeculate(size_t& budget) const;
+	bool checkConstFunction(Context& ctx) const;
+	bool evaluate(Interpreter& interpreter, Interpreter::Value& result) const;
+	void analyzeEscape(EscapeAnalysis& analysis, std::vector<size_t>& sources) const;
+
 private:
 	Token operatorType_;
 	std::shared_ptr<ExpressionNode> value_;
@@ -280,20 +340,32 @@ public:
 		rhs_ = rhs;
 	}
 
+	const Token& getToken() const {
+		return operatorType_;
+	}
+
+	bool isCheapToSpeculate(size_t& budget) const;
+	bool checkConstFunction(Context& ctx) const;
+	bool evaluate(Interpreter& interpreter, Interpreter::Value& result) const;
+	void analyzeEscape(EscapeAnalysis& analysis, std::vector<size_t>& sources) const;
+
 private:
 	Token operatorType_;
 	std::shared_ptr<ExpressionNode> lhs_;
 	std::shared_ptr<ExpressionNode> rhs_;
 
+	bool generateLogicalOperation(Generator& g, Context& ctx);
+	bool evaluateConstant(Generator& g, Context& ctx);
 	bool castIfCompatible(Generator& g, Context& ctx, Generator::Value&, Generator::Value&, ValueType&);
 	bool checkOperand(Context& ctx, const Token& operatorToken, const ValueType& operandType, const std::shared_ptr<ExpressionNode>& value);
 };
 
 class VariableValueNode : public ExpressionNode {
 public:
-	VariableValueNode() : generatedVariablePtr_(nullptr), isRhsValue_(false) {}
+	VariableValueNode() : isSliceRange_(false), generatedVariablePtr_(nullptr), generatedVariable_(nullptr), isRhsValue_(false), isAssignable_(true) {}
 	VariableValueNode(const VariableValueNode& other)
-		: Node(other.name_), name_(other.name_), arrayIndex_(other.arrayIndex_), member_(other.member_), generatedVariablePtr_(other.generatedVariablePtr_), isRhsValue_(other.isRhsValue_) {}
+		: Node(other.name_), name_(other.name_), arrayIndex_(other.arrayIndex_), isSliceRange_(other.isSliceRange_), sliceEnd_(other.sliceEnd_), member_(other.member_),
+		generatedVariablePtr_(other.generatedVariablePtr_), generatedVariable_(other.generatedVariable_), isRhsValue_(other.isRhsValue_), isAssignable_(other.isAssignable_) {}
 	void debugPrint(DebugPrinter&);
 	bool generate(Generator&, Context&);
 
@@ -309,6 +381,12 @@ public:
 		arrayIndex_ = arrayIndex;
 	}
 
+	// "[begin:end]", where the array index is the begin; either may be null
+	void setSliceRange(const std::shared_ptr<ExpressionNode>& sliceEnd) {
+		isSliceRange_ = true;
+		sliceEnd_ = sliceEnd;
+	}
+
 	void setMember(const VariableValueNode& member) {
 		member_ = std::make_shared<VariableValueNode>(member);
 	}
@@ -318,16 +396,50 @@ public:
 		return generatedVariablePtr_;
 	}
 
+	// non-null when the variable is in SSA form, instead of the pointer
+	const Generator::Variable& getGeneratedVariable() const {
+		return generatedVariable_;
+	}
+
 	void setIsRhsValue(bool isRhsValue) {
 		isRhsValue_ = isRhsValue;
 	}
 
+	// false for the length of a slice and for a slice range, which are values, not variables
+	bool isAssignable() const {
+		return isAssignable_;
+	}
+
+	bool hasSliceRange() const {
+		return isSliceRange_ || ((member_ != nullptr) && member_->hasSliceRange());
+	}
+
+	// the node of the name or the member the slice range is applied to
+	const VariableValueNode* getSliceRangeNode() const {
+		return isSliceRange_ ? this : member_->getSliceRangeNode();
+	}
+
+	bool isCheapToSpeculate(size_t& budget) const;
+	bool checkConstFunction(Context& ctx) const;
+	bool evaluate(Interpreter& interpreter, Interpreter::Value& result) const;
+	void analyzeEscape(EscapeAnalysis& analysis, std::vector<size_t>& sources) const;
+
+	// the indices and the slice ends of the name and its members, which may call functions
+	void analyzeIndexEscape(EscapeAnalysis& analysis) const;
+
 private:
+	bool generateElementPointer(Generator& g, Context& ctx, Generator::Value& ptr);
+	bool generateSliceRange(Generator& g, Context& ctx, Generator::Value& ptr);
+
 	Token name_;
 	std::shared_ptr<ExpressionNode> arrayIndex_;
+	bool isSliceRange_;
+	std::shared_ptr<ExpressionNode> sliceEnd_;
 	std::shared_ptr<VariableValueNode> member_;
 	Generator::Value generatedVariablePtr_;
+	Generator::Variable generatedVariable_;
 	bool isRhsValue_;
+	bool isAssignable_;
 };
 
 class ValueListNode : public Node {
@@ -360,13 +472,31 @@ private:
 
 class CallNode : public StatementNode, public ExpressionNode {
 public:
-	CallNode(const VariableValueNode& f, const ValueListNode& values) : Node(f.getToken()), f_(f), values_(values) {}
+	CallNode(const VariableValueNode& f, const ValueListNode& values) : Node(f.getToken()), f_(f), values_(values), isStatement_(false) {}
 	void debugPrint(DebugPrinter&);
 	bool generate(Generator&, Context&);
 
+	bool isOwnedReference() const {
+		return true;
+	}
+
+	// the returned value is discarded, so a returned reference is released
+	void setIsStatement(bool isStatement) {
+		isStatement_ = isStatement;
+	}
+
+	bool checkConstFunction(Context& ctx) const;
+	bool evaluate(Interpreter& interpreter, Interpreter::Value& result) const;
+	bool execute(Interpreter& interpreter) const;
+	void analyzeEscape(EscapeAnalysis& analysis) const;
+	void analyzeEscape(EscapeAnalysis& analysis, std::vector<size_t>& sources) const;
+
 private:
 	VariableValueNode f_;
 	ValueListNode values_;
+	bool isStatement_;
+
+	bool evaluateConstFunction(Generator& g, Context& ctx, const FunctionNode& function, bool& isEvaluated);
 };
 
 class ConstantNode : public ExpressionNode {
@@ -374,6 +504,9 @@ public:
 	ConstantNode(const Token& constant) : Node(constant), constant_(constant){}
 	void debugPrint(DebugPrinter&);
 	bool generate(Generator&, Context&);
+	bool isCheapToSpeculate(size_t& budget) const;
+	bool checkConstFunction(Context& ctx) const;
+	bool evaluate(Interpreter& interpreter, Interpreter::Value& result) const;
 
 private:
 	Token constant_;
@@ -416,6 +549,11 @@ public:
 		destType_ = destType;
 	}
 
+	bool isCheapToSpeculate(size_t& budget) const;
+	bool checkConstFunction(Context& ctx) const;
+	bool evaluate(Interpreter& interpreter, Interpreter::Value& result) const;
+	void analyzeEscape(EscapeAnalysis& analysis, std::vector<size_t>& sources) const;
+
 private:
 	std::shared_ptr<ExpressionNode> value_;
 	TypeNode destType_;
@@ -426,6 +564,9 @@ public:
 	void debugPrint(DebugPrinter& dp);
 	bool generateBlock(Generator& g, const Generator::Function& function, const Generator::BasicBlock& insertBefore);
 	bool generateStatements(Generator& g, Context& ctx, const Generator::BasicBlock& successorBlock = nullptr);
+	bool checkConstFunction(Context& ctx) const;
+	bool execute(Interpreter& interpreter) const;
+	void analyzeEscape(EscapeAnalysis& analysis) const;
 
 	void addStatement(const std::shared_ptr<StatementNode>& statement) {
 		statements_.push_back(statement);
@@ -453,6 +594,9 @@ class LetNode : public StatementNode {
 public:
 	void debugPrint(DebugPrinter& dp);
 	bool generate(Generator& g, Context& ctx);
+	bool checkConstFunction(Context& ctx) const;
+	bool execute(Interpreter& interpreter) const;
+	void analyzeEscape(EscapeAnalysis& analysis) const;
 
 	void setName(const Token& name) {
 		name_ = name;
@@ -481,12 +625,18 @@ private:
 	bool isHeap_;
 	std::shared_ptr<ExpressionNode> initialValue_;
 	Generator::Value generatedPtr_;
+	Generator::Variable generatedVariable_;
+
+	bool initialize(Generator& g, Generator::Value value);
 };
 
 class IfNode : public StatementNode {
 public:
 	void debugPrint(DebugPrinter& dp);
 	bool generate(Generator& g, Context& ctx);
+	bool checkConstFunction(Context& ctx) const;
+	bool execute(Interpreter& interpreter) const;
+	void analyzeEscape(EscapeAnalysis& analysis) const;
 
 	void setCondition(const std::shared_ptr<ExpressionNode>& condition) {
 		condition_ = condition;
@@ -510,6 +660,9 @@ class WhileNode : public StatementNode {
 public:
 	void debugPrint(DebugPrinter& dp);
 	bool generate(Generator& g, Context& ctx);
+	bool checkConstFunction(Context& ctx) const;
+	bool execute(Interpreter& interpreter) const;
+	void analyzeEscape(EscapeAnalysis& analysis) const;
 
 	void setCondition(const std::shared_ptr<ExpressionNode>& condition) {
 		condition_ = condition;
@@ -524,11 +677,29 @@ private:
 	BlockNode block_;
 };
 
+// every new in the block, and in the functions it calls, allocates from an arena freed when the block is left
+class RegionNode : public StatementNode {
+public:
+	void debugPrint(DebugPrinter& dp);
+	bool generate(Generator& g, Context& ctx);
+	void analyzeEscape(EscapeAnalysis& analysis) const;
+
+	void setBlock(const BlockNode& block) {
+		block_ = block;
+	}
+
+private:
+	BlockNode block_;
+};
+
 class ReturnNode : public StatementNode {
 public:
 	ReturnNode(const Token& returnToken) : Node(returnToken), returnToken_(returnToken) {}
 	void debugPrint(DebugPrinter& dp);
 	bool generate(Generator& g, Context& ctx);
+	bool checkConstFunction(Context& ctx) const;
+	bool execute(Interpreter& interpreter) const;
+	void analyzeEscape(EscapeAnalysis& analysis) const;
 
 
 	void setValue(const std::shared_ptr<ExpressionNode>& value) {
@@ -538,12 +709,16 @@ public:
 private:
 	Token returnToken_;
 	std::shared_ptr<ExpressionNode> value_;
+
+	bool createReturn(Generator& g, Context& ctx, Generator::Value value);
 };
 
 class BreakNode : public StatementNode {
 public:
 	void debugPrint(DebugPrinter& dp);
 	bool generate(Generator& g, Context& ctx);
+	bool checkConstFunction(Context& ctx) const;
+	bool execute(Interpreter& interpreter) const;
 };
 
 class AssignNode : public StatementNode {
@@ -551,6 +726,9 @@ public:
 	AssignNode(const VariableValueNode& dest, const std::shared_ptr<ExpressionNode>& value) : dest_(dest), value_(value) {}
 	void debugPrint(DebugPrinter& dp);
 	bool generate(Generator& g, Context& ctx);
+	bool checkConstFunction(Context& ctx) const;
+	bool execute(Interpreter& interpreter) const;
+	void analyzeEscape(EscapeAnalysis& analysis) const;
 
 private:
 	VariableValueNode dest_;
@@ -576,6 +754,16 @@ public:
 		return functions_;
 	}
 
+	const std::vector<FunctionNode>& getFunctions() const {
+		return functions_;
+	}
+
+	const std::vector<StructNode>& getStructs() const {
+		return structs_;
+	}
+
+	const StructNode* getStructNode(const std::string& name) const;
+
 private:
 	std::vector<StructNode> structs_;
 	std::vector<FunctionNode> functions_;
@@ -583,24 +771,82 @@ private:
 
 class StructNode : public Node {
 public:
-	StructNode() : generatedType_(nullptr) {}
+	StructNode() : generatedType_(nullptr), isReprC_(false), isSoa_(false) {}
 	void debugPrint(DebugPrinter& dp);
 	bool generateType(Generator& g);
 	bool generateMember(Generator& g, Context& ctx);
 
+	// the position of the member in declaration order, which is also its column in a struct of arrays
+	bool findMember(const std::string& name, size_t& result) const;
+
+	// the index of the member in the generated type
+	size_t getMemberIndex(size_t position) const {
+		return memberIndices_[position];
+	}
+
+	const ValueType& getMemberValueType(size_t position) const {
+		return members_[position].getValueType();
+	}
+
+	size_t getMemberCount() const {
+		return members_.size();
+	}
+
+	const Generator::StructType& getGeneratedType() const {
+		return generatedType_;
+	}
+
+	// in declaration order
+	const std::vector<Generator::Type>& getMemberTypes() const {
+		return memberTypes_;
+	}
+
+	const Token& getName() const {
+		return name_;
+	}
+
 	void setName(const Token& name) {
 		name_ = name;
 		token_ = name;
 	}
 
+	// keep the declaration order for structs shared with C
+	void setIsReprC(bool isReprC) {
+		isReprC_ = isReprC;
+	}
+
+	// lay out arrays of the struct as one array per member
+	void setIsSoa(bool isSoa) {
+		isSoa_ = isSoa;
+	}
+
+	bool isSoa() const {
+		return isSoa_;
+	}
+
 	void addMember(const VariableDefinitionNode& member) {
 		members_.push_back(member);
 	}
 
+	void setSourceTokens(const std::string& tokens) {
+		sourceTokens_ = tokens;
+	}
+
+	const std::string& getSourceTokens() const {
+		return sourceTokens_;
+	}
+
 private:
 	Token name_;
 	std::vector<VariableDefinitionNode> members_;
 	Generator::StructType generatedType_;
+	std::string sourceTokens_;
+	bool isReprC_;
+	bool isSoa_;
+
+	// index in generatedType_ of each member, in declaration order
+	std::vector<size_t> memberIndices_;
+	std::vector<Generator::Type> memberTypes_;
 };
 
 class FunctionNode : public Node {
@@ -610,6 +856,7 @@ public:
 		C,
 	};
 
+	FunctionNode() : hasVariableArgument_(false), generatedFunction_(nullptr), type_(Type::MAHINA), isConst_(false), bodySize_(0) {}
 	void debugPrint(DebugPrinter& dp);
 	bool generateDeclare(Generator& g, Context& ctx);
 	bool generateDefine(Generator& g, Context& ctx);
@@ -651,6 +898,10 @@ public:
 		block_ = std::make_shared<BlockNode>(block);
 	}
 
+	const std::shared_ptr<BlockNode>& getBlock() const {
+		return block_;
+	}
+
 	const Generator::Function& getGeneratedFunction() const {
 		return generatedFunction_;
 	}
@@ -663,6 +914,45 @@ public:
 		return type_;
 	}
 
+	void setSourceTokens(const std::string& tokens) {
+		sourceTokens_ = tokens;
+	}
+
+	const std::string& getSourceTokens() const {
+		return sourceTokens_;
+	}
+
+	void setCallees(const std::set<std::string>& callees) {
+		callees_ = callees;
+	}
+
+	const std::set<std::string>& getCallees() const {
+		return callees_;
+	}
+
+	void setIsConst(bool isConst) {
+		isConst_ = isConst;
+	}
+
+	// calls with constant arguments are evaluated at compile time
+	bool isConst() const {
+		return isConst_;
+	}
+
+	void addAttribute(const Token& attribute) {
+		attributes_.push_back(attribute);
+	}
+
+	bool hasAttribute(const std::string& name) const;
+
+	// whether each argument may outlive the call, e.g. by being returned (see EscapeAnalysis)
+	void getCapturedArguments(Context& ctx, std::vector<bool>& result) const;
+
+	// the number of tokens of the body, an estimate of its size
+	void setBodySize(size_t size) {
+		bodySize_ = size;
+	}
+
 private:
 	Token name_;
 	std::vector<VariableDefinitionNode> args_;
@@ -671,20 +961,43 @@ private:
 	std::shared_ptr<BlockNode> block_;
 	Generator::Function generatedFunction_;
 	Type type_;
+	std::string sourceTokens_;
+	std::set<std::string> callees_;
+	bool isConst_;
+	std::vector<Token> attributes_;
+	size_t bodySize_;
 
 	bool addArgumentToSymbolTable(Generator& g, Context& ctx);
+	bool checkConstFunction(Context& ctx) const;
+	bool setStackObjects(Context& ctx) const;
+	bool getInlining(Context& ctx, Generator::Inlining& result) const;
+	Generator::MemoryEffect getMemoryEffect() const;
 };
 
 class Context {
 public:
-	Context() : objectType_(nullptr), lastBlock_(nullptr), breaked_(false), returned_(false) {}
+	Context() : objectType_(nullptr), lastBlock_(nullptr), breaked_(false), returned_(false), isBoundsChecked_(true) {}
 	void addSymbolTable();
 	bool removeSymbolTable();
 	bool addSymbol(const std::string& name, const ValueType& type, Generator::Value value);
-	bool getSymbol(const std::string& name, ValueType& resultType, Generator::Value& resultValue) const;
+	bool addSymbol(const std::string& name, const ValueType& type, Generator::Variable variable);
+	bool getSymbol(const std::string& name, ValueType& resultType, Generator::Value& resultValue, Generator::Variable& resultVariable) const;
 
 	void addCompileUnit(const CompileUnitNode& cu);
 
+	const std::vector<CompileUnitNode>& getCompileUnits() const {
+		return compileUnits_;
+	}
+
+	// functions whose definitions are taken from the incremental database instead of being generated
+	void addReusedFunction(const std::string& name) {
+		reusedFunctions_.insert(name);
+	}
+
+	bool isReusedFunction(const std::string& name) const {
+		return reusedFunctions_.find(name) != reusedFunctions_.end();
+	}
+
 	void debugPrint(DebugPrinter& dp);
 	bool generate(Generator& g);
 
@@ -706,8 +1019,19 @@ public:
 		return nullptr;
 	}
 
+	const StructNode* getStructNode(const std::string& name) const {
+		for (auto& cu : compileUnits_) {
+			auto* sp = cu.getStructNode(name);
+			if (sp != nullptr) {
+				return sp;
+			}
+		}
+		return nullptr;
+	}
+
 	void addSuccessorBlockForBreak(const Generator::BasicBlock& successorBlock) {
 		successorBlocks_.push(successorBlock);
+		symbolTableDepthsForBreak_.push(symbolTables_.size());
 	}
 
 	Generator::BasicBlock getSuccessorBlockForBreak() const {
@@ -719,8 +1043,25 @@ public:
 
 	void removeSuccessorBlockForBreak() {
 		successorBlocks_.pop();
+		symbolTableDepthsForBreak_.pop();
 	}
 
+	// the symbol tables left by a break are the ones from this depth
+	size_t getSymbolTableDepthForBreak() const {
+		return symbolTableDepthsForBreak_.top();
+	}
+
+	size_t getSymbolTableDepth() const {
+		return symbolTables_.size();
+	}
+
+	// releases the references held by the local variables of the symbol tables from the depth,
+	// and exits the regions of those tables
+	bool createReleases(Generator& g, size_t depth) const;
+
+	// whether a value of the type holds references, itself or in the members of its structs
+	bool holdsReferences(const ValueType& type) const;
+
 	void setLastBlock(const Generator::BasicBlock& block) {
 		lastBlock_ = block;
 	}
@@ -745,19 +1086,111 @@ public:
 		return returned_;
 	}
 
+	// see FunctionNode::getCapturedArguments()
+	bool getCapturedArguments(const std::string& name, std::vector<bool>& result) const {
+		auto capturedArguments = capturedArguments_.find(name);
+		if (capturedArguments == capturedArguments_.end()) {
+			return true;
+		}
+		result = capturedArguments->second;
+		return false;
+	}
+
+	void setCapturedArguments(const std::string& name, const std::vector<bool>& capturedArguments) {
+		capturedArguments_[name] = capturedArguments;
+	}
+
+	// found with the captured arguments, see EscapeAnalysis::isReturningNewObject()
+	bool isReturningNewObject(const std::string& name) const {
+		return newObjectFunctions_.find(name) != newObjectFunctions_.end();
+	}
+
+	void setReturningNewObject(const std::string& name, bool isReturningNewObject) {
+		if (isReturningNewObject) {
+			newObjectFunctions_.insert(name);
+		}
+		else {
+			newObjectFunctions_.erase(name);
+		}
+	}
+
+	// the region left with the symbol table of its block, see createReleases()
+	void addRegion(Generator::Value region) {
+		regions_.push_back(std::make_pair(symbolTables_.size(), region));
+	}
+
+	void removeRegion() {
+		regions_.pop_back();
+	}
+
+	// the innermost region of the current function, which its new allocates from; true if there is none
+	bool getCurrentRegion(Generator::Value& result) const {
+		if (regions_.empty()) {
+			return true;
+		}
+		result = regions_.back().second;
+		return false;
+	}
+
+	// the objects of the current function allocated on the stack instead of the heap
+	void setStackObjects(const std::set<const LetNode*>& stackObjects) {
+		stackObjects_ = stackObjects;
+	}
+
+	bool isStackObject(const LetNode* let) const {
+		return stackObjects_.find(let) != stackObjects_.end();
+	}
+
+	// the variables of the current function that are never written after their definition
+	void setReadOnlyObjects(const std::set<const LetNode*>& readOnlyObjects) {
+		readOnlyObjects_ = readOnlyObjects;
+	}
+
+	bool isReadOnlyObject(const LetNode* let) const {
+		return readOnlyObjects_.find(let) != readOnlyObjects_.end();
+	}
+
+	// the slice ranges of the current function whose slices flow out of it
+	void setEscapingViews(const std::set<const VariableValueNode*>& escapingViews) {
+		escapingViews_ = escapingViews;
+	}
+
+	bool isEscapingView(const VariableValueNode* node) const {
+		return escapingViews_.find(node) != escapingViews_.end();
+	}
+
+	// false in @unchecked functions
+	void setBoundsChecked(bool isBoundsChecked) {
+		isBoundsChecked_ = isBoundsChecked;
+	}
+
+	bool isBoundsChecked() const {
+		return isBoundsChecked_;
+	}
+
 private:
 	std::vector<CompileUnitNode> compileUnits_;
 	std::vector<std::shared_ptr<CompileError>> errors_;
 	Generator::Type objectType_;
 	std::stack<Generator::BasicBlock> successorBlocks_;
+	std::stack<size_t> symbolTableDepthsForBreak_;
+	std::vector<std::pair<size_t, Generator::Value>> regions_;
 	Generator::BasicBlock lastBlock_;
 	bool breaked_;
 	bool returned_;
+	std::set<std::string> reusedFunctions_;
+	std::map<std::string, std::vector<bool>> capturedArguments_;
+	std::set<std::string> newObjectFunctions_;
+	std::set<const LetNode*> stackObjects_;
+	std::set<const LetNode*> readOnlyObjects_;
+	std::set<const VariableValueNode*> escapingViews_;
+	bool isBoundsChecked_;
 
 	struct Symbol {
 		std::string name;
 		ValueType type;
 		Generator::Value value;
+		Generator::Variable variable;
 	};
 	std::vector<std::vector<Symbol>> symbolTables_;
 };
@@ -3,6 +3,11 @@
 #include <iostream>
 #include "Tokenizer.h"
 
+namespace {
+	const std::set<std::string> kFunctionAttributes = { "inline", "noinline", "flatten", "pure", "readonly", "unchecked" };
+	const std::set<std::string> kStructAttributes = { "repr", "soa" };
+}
+
 bool Parser::fail() const {
 	return src_.fail();
 }
@@ -20,7 +25,21 @@ bool Parser::parse() {
 
 	// parse
 	CompileUnitNode cu;
-	while (currentToken_.getType() == Token::Type::STRUCT) {
+	for (;;) {
+		if (currentToken_.getType() == Token::Type::AT_SIGN) {
+			// an attribute of either the struct or the first function
+			Token name;
+			if (peek(name)) {
+				return true;
+			}
+			if (kStructAttributes.find(name.getString()) == kStructAttributes.end()) {
+				break;
+			}
+		}
+		else if (currentToken_.getType() != Token::Type::STRUCT) {
+			break;
+		}
+
 		StructNode s;
 		if (parseStruct(s)) {
 			return true;
@@ -59,7 +78,7 @@ bool Parser::parse() {
 		}
 	}
 
-	while (currentToken_.getType() == Token::Type::FUNCTION) {
+	while ((currentToken_.getType() == Token::Type::FUNCTION) || (currentToken_.getType() == Token::Type::CONST) || (currentToken_.getType() == Token::Type::AT_SIGN)) {
 		FunctionNode f;
 		if (parseFunction(f)) {
 			return true;
@@ -73,6 +92,19 @@ bool Parser::parse() {
 }
 
 bool Parser::next() {
+	if (isRecordingTokens_) {
+		const std::string& str = currentToken_.getString();
+		recordedTokens_ += std::to_string(static_cast<int>(currentToken_.getType())) + ":" + std::to_string(str.size()) + ":" + str;
+	}
+
+	consumedTokenCount_++;
+
+	if (hasPeekedToken_) {
+		currentToken_ = peekedToken_;
+		hasPeekedToken_ = false;
+		return false;
+	}
+
 	std::shared_ptr<CompileError> error;
 	if (tokenizer_.getToken(currentToken_, error)) {
 		errors_.push_back(error);
@@ -81,6 +113,30 @@ bool Parser::next() {
 	return false;
 }
 
+// the token after the current token, without consuming it
+bool Parser::peek(Token& result) {
+	if (!hasPeekedToken_) {
+		std::shared_ptr<CompileError> error;
+		if (tokenizer_.getToken(peekedToken_, error)) {
+			errors_.push_back(error);
+			return true;
+		}
+		hasPeekedToken_ = true;
+	}
+	result = peekedToken_;
+	return false;
+}
+
+void Parser::startTokenRecord() {
+	isRecordingTokens_ = true;
+	recordedTokens_.clear();
+	recordedCallees_.clear();
+}
+
+void Parser::stopTokenRecord() {
+	isRecordingTokens_ = false;
+}
+
 bool Parser::expect(Token::Type expected) {
 	if (currentToken_.getType() != expected) {
 		auto error = std::make_shared <UnexpectedTokenError>(currentToken_);
@@ -107,7 +163,78 @@ bool Parser::expectTypeOrSymbol() {
 	return false;
 }
 
+// "@name"
+bool Parser::parseAttribute(const std::set<std::string>& knownNames, Token& result) {
+	if (expect(Token::Type::AT_SIGN)) {
+		return true;
+	}
+
+	result = currentToken_;
+	if (expect(Token::Type::SYMBOL)) {
+		return true;
+	}
+	if (knownNames.find(result.getString()) == knownNames.end()) {
+		errors_.push_back(std::make_shared<UnknownAttributeError>(result));
+		return true;
+	}
+	return false;
+}
+
+// "@name" repeated
+bool Parser::parseAttributes(const std::set<std::string>& knownNames, std::vector<Token>& result) {
+	while (currentToken_.getType() == Token::Type::AT_SIGN) {
+		Token name;
+		if (parseAttribute(knownNames, name)) {
+			return true;
+		}
+		result.push_back(name);
+	}
+	return false;
+}
+
 bool Parser::parseStruct(StructNode& result) {
+	startTokenRecord();
+	bool isReprC = false;
+	bool isSoa = false;
+	while (currentToken_.getType() == Token::Type::AT_SIGN) {
+		Token attribute;
+		if (parseAttribute(kStructAttributes, attribute)) {
+			return true;
+		}
+		if (attribute.getString() == "soa") {
+			if (isReprC) {
+				// arrays of a struct shared with C keep the C layout
+				errors_.push_back(std::make_shared<ConflictingAttributeError>(attribute));
+				return true;
+			}
+			isSoa = true;
+			result.setIsSoa(true);
+			continue;
+		}
+
+		// "@repr(C)"
+		if (isSoa) {
+			errors_.push_back(std::make_shared<ConflictingAttributeError>(attribute));
+			return true;
+		}
+		if (expect(Token::Type::PARENTHESIS_LEFT)) {
+			return true;
+		}
+		Token representation = currentToken_;
+		if (expect(Token::Type::SYMBOL)) {
+			return true;
+		}
+		if (representation.getString() != "C") {
+			errors_.push_back(std::make_shared<UnknownAttributeError>(representation));
+			return true;
+		}
+		if (expect(Token::Type::PARENTHESIS_RIGHT)) {
+			return true;
+		}
+		isReprC = true;
+		result.setIsReprC(true);
+	}
+
 	if (expect(Token::Type::STRUCT)) {
 		return true;
 	}
@@ -140,10 +267,14 @@ bool Parser::parseStruct(StructNode& result) {
 		return true;
 	}
 
+	stopTokenRecord();
+	result.setSourceTokens(recordedTokens_);
+
 	return false;
 }
 
 bool Parser::parseDeclare(FunctionNode& result) {
+	startTokenRecord();
 	if (expect(Token::Type::FUNCTION)) {
 		return true;
 	}
@@ -212,12 +343,30 @@ bool Parser::parseDeclare(FunctionNode& result) {
 		return true;
 	}
 
+	stopTokenRecord();
+	result.setSourceTokens(recordedTokens_);
+
 	result.setFunctionType(FunctionNode::Type::C);
 
 	return false;
 }
 
 bool Parser::parseFunction(FunctionNode& result) {
+	startTokenRecord();
+	std::vector<Token> attributes;
+	if (parseAttributes(kFunctionAttributes, attributes)) {
+		return true;
+	}
+	for (auto& attribute : attributes) {
+		result.addAttribute(attribute);
+	}
+
+	if (currentToken_.getType() == Token::Type::CONST) {
+		if (next()) {
+			return true;
+		}
+		result.setIsConst(true);
+	}
 	if (expect(Token::Type::FUNCTION)) {
 		return true;
 	}
@@ -279,10 +428,16 @@ bool Parser::parseFunction(FunctionNode& result) {
 	result.setReturnType(returnType);
 
 	BlockNode block;
+	size_t blockStart = consumedTokenCount_;
 	if (parseBlock(block)) {
 		return  true;
 	}
 	result.setBlock(block);
+	result.setBodySize(consumedTokenCount_ - blockStart);
+
+	stopTokenRecord();
+	result.setSourceTokens(recordedTokens_);
+	result.setCallees(recordedCallees_);
 
 	result.setFunctionType(FunctionNode::Type::MAHINA);
 
@@ -332,6 +487,17 @@ bool Parser::parseBlock(BlockNode& result) {
 			result.addStatement(statement);
 		}
 		break;
+		case Token::Type::REGION:
+		{
+			Token regionToken = currentToken_;
+			std::shared_ptr<StatementNode> statement;
+			if (parseRegion(statement)) {
+				return true;
+			}
+			statement->setToken(regionToken);
+			result.addStatement(statement);
+		}
+		break;
 		case Token::Type::SYMBOL:
 		{
 			Token symbolToken = currentToken_;
@@ -540,6 +706,23 @@ bool Parser::parseWhile(std::shared_ptr<StatementNode>& result) {
 	return false;
 }
 
+bool Parser::parseRegion(std::shared_ptr<StatementNode>& result) {
+	auto temp = std::make_shared<RegionNode>();
+
+	if (expect(Token::Type::REGION)) {
+		return true;
+	}
+
+	BlockNode block;
+	if (parseBlock(block)) {
+		return true;
+	}
+	temp->setBlock(block);
+
+	result = temp;
+	return false;
+}
+
 bool Parser::parseReturn(std::shared_ptr<StatementNode>& result) {
 	auto temp = std::make_shared<ReturnNode>(currentToken_);
 
@@ -571,6 +754,24 @@ bool Parser::parseBreak(std::shared_ptr<StatementNode>& result) {
 }
 
 bool Parser::parseType(TypeNode& result) {
+	// "[]type"
+	if (currentToken_.getType() == Token::Type::SQUARE_BRACKET_LEFT) {
+		Token nextToken;
+		if (peek(nextToken)) {
+			return true;
+		}
+		if (nextToken.getType() == Token::Type::SQUARE_BRACKET_RIGHT) {
+			if (next() || next()) {
+				return true;
+			}
+			if (parsePrimitiveType(result)) {
+				return true;
+			}
+			result.setIsSlice(true);
+			return false;
+		}
+	}
+
 	size_t arrayDepth = 0;
 	while (currentToken_.getType() == Token::Type::SQUARE_BRACKET_LEFT) {
 		if (next()) {
@@ -610,6 +811,7 @@ bool Parser::parsePrimitiveType(TypeNode& result) {
 		}
 		result.setToken(type);
 		result.setType(type.getType());
+		result.setIsReference(true);
 	}
 	else {
 		size_t pointerCount = 0;
@@ -624,6 +826,9 @@ bool Parser::parsePrimitiveType(TypeNode& result) {
 		result.setType(type.getType());
 		result.setPointerCount(pointerCount);
 	}
+	if (type.getType() == Token::Type::SYMBOL) {
+		result.setStructName(type.getString());
+	}
 
 	return false;
 }
@@ -645,7 +850,10 @@ bool Parser::parseAssignOrCall(std::shared_ptr<StatementNode>& result) {
 		if (parseValueList(values)) {
 			return true;
 		}
-		result = std::make_shared<CallNode>(variable, values);
+		auto call = std::make_shared<CallNode>(variable, values);
+		call->setIsStatement(true);
+		result = call;
+		recordedCallees_.insert(variable.getName().getString());
 
 		if (expect(Token::Type::PARENTHESIS_RIGHT)) {
 			return true;
@@ -686,11 +894,26 @@ bool Parser::parseVariableValue(VariableValueNode& result) {
 			return true;
 		}
 
-		std::shared_ptr<ExpressionNode> arrayIndex;
-		if (parseExpression(arrayIndex)) {
-			return true;
+		// "[index]", or "[begin:end]" where either bound may be omitted
+		if (currentToken_.getType() != Token::Type::COLON) {
+			std::shared_ptr<ExpressionNode> arrayIndex;
+			if (parseExpression(arrayIndex)) {
+				return true;
+			}
+			result.setArrayIndex(arrayIndex);
+		}
+		if (currentToken_.getType() == Token::Type::COLON) {
+			if (next()) {
+				return true;
+			}
+			std::shared_ptr<ExpressionNode> sliceEnd;
+			if (currentToken_.getType() != Token::Type::SQUARE_BRACKET_RIGHT) {
+				if (parseExpression(sliceEnd)) {
+					return true;
+				}
+			}
+			result.setSliceRange(sliceEnd);
 		}
-		result.setArrayIndex(arrayIndex);
 
 		if (expect(Token::Type::SQUARE_BRACKET_RIGHT)) {
 			return true;
@@ -807,6 +1030,7 @@ bool Parser::parseValue(std::shared_ptr<ExpressionNode>& result) {
 				return true;
 			}
 			auto call = std::make_shared<CallNode>(value, values);
+			recordedCallees_.insert(value.getName().getString());
 			result = call;
 
 			if (expect(Token::Type::PARENTHESIS_RIGHT)) {
@@ -879,6 +1103,7 @@ bool Parser::parseValue(std::shared_ptr<ExpressionNode>& result) {
 
 bool Parser::parseCast(std::shared_ptr<ExpressionNode>& result) {
 	auto cast = std::make_shared<CastNode>();
+	cast->setToken(currentToken_);
 
 	TypeNode typeNode;
 	if (parseType(typeNode)) {
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <fstream>
+#include <set>
 #include <vector>
 #include "Tokenizer.h"
 #include "Node.h"
@@ -9,7 +10,7 @@
 class Parser
 {
 public:
-	Parser(const std::string& sourcePath) : src_(sourcePath, std::ios::binary), tokenizer_(src_, sourcePath) {}
+	Parser(const std::string& sourcePath) : src_(sourcePath, std::ios::binary), tokenizer_(src_, sourcePath), hasPeekedToken_(false), consumedTokenCount_(0), isRecordingTokens_(false) {}
 	virtual ~Parser() = default;
 
 	bool fail() const;
@@ -29,10 +30,23 @@ private:
 	Context context_;
 	std::vector<std::shared_ptr<CompileError>> errors_;
 	Token currentToken_;
+	Token peekedToken_;
+	bool hasPeekedToken_;
+	size_t consumedTokenCount_;
+
+	// consumed tokens and called functions of the struct or function being parsed (see IncrementalDatabase)
+	bool isRecordingTokens_;
+	std::string recordedTokens_;
+	std::set<std::string> recordedCallees_;
 
 	bool next();
+	bool peek(Token& result);
+	void startTokenRecord();
+	void stopTokenRecord();
 	bool expect(Token::Type);
 	bool expectTypeOrSymbol();
+	bool parseAttribute(const std::set<std::string>& knownNames, Token& result);
+	bool parseAttributes(const std::set<std::string>& knownNames, std::vector<Token>& result);
 
 	bool parseStruct(StructNode&);
 	bool parseDeclare(FunctionNode&);
@@ -42,6 +56,7 @@ private:
 	bool parseLet(std::shared_ptr<StatementNode>&);
 	bool parseIf(std::shared_ptr<StatementNode>&);
 	bool parseWhile(std::shared_ptr<StatementNode>&);
+	bool parseRegion(std::shared_ptr<StatementNode>&);
 	bool parseReturn(std::shared_ptr<StatementNode>&);
 	bool parseBreak(std::shared_ptr<StatementNode>&);
 
@@ -0,0 +1,69 @@
+#include "PerfMapListener.h"
+#include <sstream>
+#include <vector>
+#include "llvm/Object/SymbolSize.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/Process.h"
+
+extern std::vector<std::string> debugLogs;
+
+namespace {
+	void debugLog(size_t line) {
+		std::stringstream ss;
+		ss << __FILE__ << ":" << line;
+		debugLogs.push_back(ss.str());
+	}
+}
+
+bool PerfMapListener::init() {
+	std::string path = "/tmp/perf-" + std::to_string(llvm::sys::Process::getProcessId()) + ".map";
+
+	std::error_code errorCode;
+	stream_ = std::make_unique<llvm::raw_fd_ostream>(path, errorCode, llvm::sys::fs::OF_Append);
+	if (errorCode) {
+		debugLog(__LINE__);
+		return true;
+	}
+	stream_->SetUnbuffered();
+
+	return false;
+}
+
+void PerfMapListener::notifyObjectLoaded(ObjectKey, const llvm::object::ObjectFile& object, const llvm::RuntimeDyld::LoadedObjectInfo& info) {
+	// the debug object has the symbols relocated to where the code was loaded
+	auto debugObject = info.getObjectForDebug(object);
+	if (!debugObject.getBinary()) {
+		debugLog(__LINE__);
+		return;
+	}
+
+	for (auto& symbolSize : llvm::object::computeSymbolSizes(*debugObject.getBinary())) {
+		auto& symbol = symbolSize.first;
+		auto type = symbol.getType();
+		if (!type) {
+			llvm::consumeError(type.takeError());
+			continue;
+		}
+		if (*type != llvm::object::SymbolRef::ST_Function) {
+			continue;
+		}
+
+		auto name = symbol.getName();
+		if (!name) {
+			llvm::consumeError(name.takeError());
+			continue;
+		}
+		auto address = symbol.getAddress();
+		if (!address) {
+			llvm::consumeError(address.takeError());
+			continue;
+		}
+
+		std::string line;
+		llvm::raw_string_ostream ss(line);
+		ss << llvm::format_hex_no_prefix(*address, 1) << " " << llvm::format_hex_no_prefix(symbolSize.second, 1) << " " << *name << nameSuffix_ << "\n";
+		ss.flush();
+		stream_->write(line.data(), line.size());
+	}
+}
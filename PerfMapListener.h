@@ -0,0 +1,24 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include "llvm/ExecutionEngine/JITEventListener.h"
+#include "llvm/Support/raw_ostream.h"
+
+// Appends "<address> <size> <name>" lines to /tmp/perf-<pid>.map for every function the JIT loads,
+// which is where perf looks up symbols of anonymous executable memory.
+// Several listeners of one process may share the file, since each line is written by a single append.
+class PerfMapListener : public llvm::JITEventListener
+{
+public:
+	PerfMapListener(const std::string& nameSuffix) : nameSuffix_(nameSuffix) {}
+	~PerfMapListener() = default;
+
+	bool init();
+
+	void notifyObjectLoaded(ObjectKey key, const llvm::object::ObjectFile& object, const llvm::RuntimeDyld::LoadedObjectInfo& info) override;
+
+private:
+	std::string nameSuffix_;
+	std::unique_ptr<llvm::raw_fd_ostream> stream_;
+};
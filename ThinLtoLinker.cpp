@@ -0,0 +1,101 @@
+#include "ThinLtoLinker.h"
+#include <mutex>
+#include <sstream>
+#include "llvm/Support/Caching.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/Threading.h"
+
+extern std::vector<std::string> debugLogs;
+
+namespace {
+	void debugLog(size_t line) {
+		std::stringstream ss;
+		ss << __FILE__ << ":" << line;
+		debugLogs.push_back(ss.str());
+	}
+}
+
+bool ThinLtoLinker::init(unsigned int threads) {
+	llvm::InitializeNativeTarget();
+	llvm::InitializeNativeTargetAsmPrinter();
+	llvm::InitializeNativeTargetAsmParser();
+
+	llvm::lto::Config config;
+	config.CPU = targetCpu_;
+	if (!targetFeatures_.empty()) {
+		config.MAttrs.push_back(targetFeatures_);
+	}
+	config.OptLevel = optimizationLevel_;
+	config.CGOptLevel = (optimizationLevel_ == 0) ? llvm::CodeGenOpt::None : llvm::CodeGenOpt::Aggressive;
+
+	// threads == 0 means one backend per hardware thread
+	auto backend = llvm::lto::createInProcessThinBackend(llvm::heavyweight_hardware_concurrency(threads));
+	lto_ = std::make_unique<llvm::lto::LTO>(std::move(config), backend);
+
+	return false;
+}
+
+bool ThinLtoLinker::addInput(const std::string& bitcodePath) {
+	auto buffer = llvm::MemoryBuffer::getFile(bitcodePath);
+	if (!buffer) {
+		debugLog(__LINE__);
+		return true;
+	}
+
+	auto input = llvm::lto::InputFile::create((*buffer)->getMemBufferRef());
+	if (!input) {
+		llvm::consumeError(input.takeError());
+		debugLog(__LINE__);
+		return true;
+	}
+
+	std::vector<llvm::lto::SymbolResolution> resolutions;
+	for (auto& symbol : (*input)->symbols()) {
+		llvm::lto::SymbolResolution resolution;
+		if (!symbol.isUndefined()) {
+			// the first definition prevails, as with a regular linker
+			resolution.Prevailing = definedSymbols_.insert(symbol.getName().str()).second;
+			resolution.FinalDefinitionInLinkageUnit = resolution.Prevailing;
+		}
+		// mahina functions may be called from C objects linked afterwards
+		resolution.VisibleToRegularObj = true;
+		resolutions.push_back(resolution);
+	}
+
+	auto error = lto_->add(std::move(*input), resolutions);
+	if (error) {
+		llvm::consumeError(std::move(error));
+		debugLog(__LINE__);
+		return true;
+	}
+
+	buffers_.push_back(std::move(*buffer));
+
+	return false;
+}
+
+bool ThinLtoLinker::link(const std::string& outputPrefix, std::vector<std::string>& outputPaths) {
+	std::mutex mutex;
+	auto addStream = [&](unsigned int task) -> llvm::Expected<std::unique_ptr<llvm::CachedFileStream>> {
+		std::string path = outputPrefix + "." + std::to_string(task) + ".o";
+
+		std::error_code errorCode;
+		auto stream = std::make_unique<llvm::raw_fd_ostream>(path, errorCode);
+		if (errorCode) {
+			return llvm::errorCodeToError(errorCode);
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		outputPaths.push_back(path);
+		return std::make_unique<llvm::CachedFileStream>(std::move(stream), path);
+	};
+
+	auto error = lto_->run(addStream);
+	if (error) {
+		llvm::consumeError(std::move(error));
+		debugLog(__LINE__);
+		return true;
+	}
+
+	return false;
+}
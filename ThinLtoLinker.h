@@ -0,0 +1,42 @@
+#pragma once
+
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+#include "llvm/LTO/LTO.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+// Links bitcode files written with Generator::writeBitcodeFile(path, true).
+// Functions are imported and inlined across files by the ThinLTO backends running in parallel,
+// and each backend writes one native object file "<outputPrefix>.<task>.o".
+class ThinLtoLinker
+{
+public:
+	ThinLtoLinker() : optimizationLevel_(2) {}
+	~ThinLtoLinker() = default;
+
+	void setTargetCpu(const std::string& cpu) {
+		targetCpu_ = cpu;
+	}
+
+	void setTargetFeatures(const std::string& features) {
+		targetFeatures_ = features;
+	}
+
+	void setOptimizationLevel(unsigned int optimizationLevel) {
+		optimizationLevel_ = optimizationLevel;
+	}
+
+	bool init(unsigned int threads);
+	bool addInput(const std::string& bitcodePath);
+	bool link(const std::string& outputPrefix, std::vector<std::string>& outputPaths);
+
+private:
+	std::string targetCpu_;
+	std::string targetFeatures_;
+	unsigned int optimizationLevel_;
+	std::unique_ptr<llvm::lto::LTO> lto_;
+	std::vector<std::unique_ptr<llvm::MemoryBuffer>> buffers_;
+	std::set<std::string> definedSymbols_;
+};
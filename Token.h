@@ -67,6 +67,8 @@ public:
 		ELSE,
 		WHILE,
 		BREAK,
+		CONST,
+		REGION,
 
 		// other
 		CURLY_BRACKET_LEFT,
@@ -75,6 +77,8 @@ public:
 		SEMICOLON,
 		TRIPLE_DOT,
 		AMPERSAND,
+		AT_SIGN,
+		COLON,
 		SYMBOL,
 
 		END_OF_FILE,
@@ -31,12 +31,14 @@ static const Keyword kIf = { "if", Token::Type::IF };
 static const Keyword kElse = { "else", Token::Type::ELSE };
 static const Keyword kWhile = { "while", Token::Type::WHILE };
 static const Keyword kBreak = { "break", Token::Type::BREAK };
+static const Keyword kConst = { "const", Token::Type::CONST };
+static const Keyword kRegion = { "region", Token::Type::REGION };
 static const Keyword kLiteralTrue = { "true", Token::Type::CONSTANT_BOOL };
 static const Keyword kLiteralFalse = { "false", Token::Type::CONSTANT_BOOL };
 
 static const std::vector<Keyword> kKeywords = {
 	kTypeVoid, kTypeBool, kTypeI8, kTypeI16, kTypeI32, kTypeI64, kTypeU8, kTypeU16, kTypeU32, kTypeU64, kTypeF32, kTypeF64,
-	kStruct, kExtern, kFunction, kReturn, kLet, kNew, kIf, kElse, kWhile, kBreak, kLiteralTrue, kLiteralFalse,
+	kStruct, kExtern, kFunction, kReturn, kLet, kNew, kIf, kElse, kWhile, kBreak, kConst, kRegion, kLiteralTrue, kLiteralFalse,
 };
 
 bool Tokenizer::initialize(std::shared_ptr<CompileError>& error) {
@@ -106,6 +108,16 @@ bool Tokenizer::getToken(Token& result, std::shared_ptr<CompileError>& error) {
 		column_++;
 		result = makeToken(Token::Type::COMMA, ",");
 		break;
+	case '@':
+		c_ = src_.get();
+		column_++;
+		result = makeToken(Token::Type::AT_SIGN, "@");
+		break;
+	case ':':
+		c_ = src_.get();
+		column_++;
+		result = makeToken(Token::Type::COLON, ":");
+		break;
 	case ';':
 		c_ = src_.get();
 		column_++;
@@ -1,8 +1,8 @@
 #include "ValueType.h"
 
-ValueType::ValueType() : basicType(Token::Type::UNDEFINED), pointerCount(0), isReference(false), isArgument(false) {}
-ValueType::ValueType(Token::Type type) : basicType(type), pointerCount(0), isReference(false), isArgument(false) {}
-ValueType::ValueType(Token::Type type, size_t pointerCount, bool isReference) : basicType(type), pointerCount(pointerCount), isReference(isReference), isArgument(false) {}
+ValueType::ValueType() : basicType(Token::Type::UNDEFINED), pointerCount(0), isReference(false), isArgument(false), isSlice(false) {}
+ValueType::ValueType(Token::Type type) : basicType(type), pointerCount(0), isReference(false), isArgument(false), isSlice(false) {}
+ValueType::ValueType(Token::Type type, size_t pointerCount, bool isReference) : basicType(type), pointerCount(pointerCount), isReference(isReference), isArgument(false), isSlice(false) {}
 
 bool ValueType::operator==(const ValueType& other) const {
 	if (basicType != other.basicType) {
@@ -17,6 +17,12 @@ bool ValueType::operator==(const ValueType& other) const {
 	if (arraySizes != other.arraySizes) {
 		return false;
 	}
+	if (structName != other.structName) {
+		return false;
+	}
+	if (isSlice != other.isSlice) {
+		return false;
+	}
 	// ignore isArgument
 	return  true;
 }
@@ -26,7 +32,7 @@ bool ValueType::operator!=(const ValueType& other) const {
 }
 
 bool ValueType::isArithmetic() const {
-	if (pointerCount != 0) {
+	if ((pointerCount != 0) || isSlice) {
 		return false;
 	}
 	return Token::isIntegerType(basicType) ||
@@ -44,14 +50,18 @@ bool ValueType::isAbleToEqual() const {
 }
 
 bool ValueType::isBool() const {
-	if (pointerCount != 0) {
+	if ((pointerCount != 0) || isSlice) {
 		return false;
 	}
 	return Token::isBool(basicType);
 }
 
 bool ValueType::isString() const {
-	return (basicType == Token::Type::TYPE_I8) && (pointerCount == 1);
+	return (basicType == Token::Type::TYPE_I8) && (pointerCount == 1) && !isSlice;
+}
+
+bool ValueType::isStruct() const {
+	return (basicType == Token::Type::SYMBOL) && (pointerCount == 0) && arraySizes.empty() && !isSlice;
 }
 
 bool ValueType::isCompatible(const ValueType& other) const {
@@ -59,7 +69,7 @@ bool ValueType::isCompatible(const ValueType& other) const {
 		return true;
 	}
 
-	if (pointerCount != 0) {
+	if ((pointerCount != 0) || isSlice || other.isSlice) {
 		return false;
 	}
 	if (arraySizes != other.arraySizes) {
@@ -1,4 +1,5 @@
 #pragma once
+#include <string>
 #include <vector>
 #include "Token.h"
 
@@ -9,6 +10,12 @@ struct ValueType {
 	bool isArgument;
 	std::vector<size_t> arraySizes;
 
+	// a (pointer, length) view over elements of the rest of the type
+	bool isSlice;
+
+	// the name of the struct when basicType is SYMBOL
+	std::string structName;
+
 	ValueType();
 	explicit ValueType(Token::Type type);
 	ValueType(Token::Type type, size_t pointerCount, bool isReference);
@@ -19,5 +26,6 @@ struct ValueType {
 	bool isAbleToEqual() const;
 	bool isBool() const;
 	bool isString() const;
+	bool isStruct() const;
 	bool isCompatible(const ValueType& other) const;
 };
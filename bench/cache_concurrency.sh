@@ -0,0 +1,29 @@
+#!/bin/sh
+# concurrent compiles sharing one --cache-dir must not lose a count of the cache statistics; see CompileCache::count()
+# sh cache_concurrency.sh [mahina] [compiles]
+
+MAHINA=${1:-mahina}
+COMPILES=${2:-300}
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+
+# the compiler writes a.txt to the working directory
+SOURCE="$(cd "$(dirname "$0")" && pwd)/logical.txt"
+cd "$DIR" || exit 1
+
+# the first compile is the only miss
+"$MAHINA" "$SOURCE" -O2 --emit=obj -o "$DIR/0.o" --cache-dir="$DIR/cache" || exit 1
+i=1
+while [ "$i" -le "$COMPILES" ]; do
+	"$MAHINA" "$SOURCE" -O2 --emit=obj -o "$DIR/$i.o" --cache-dir="$DIR/cache" &
+	i=$((i + 1))
+done
+wait
+
+"$MAHINA" --cache-dir="$DIR/cache" --cache-stats | awk -v compiles="$COMPILES" '
+	$1 == "hits" { hits = $2 }
+	$1 == "misses" { misses = $2 }
+	END {
+		print "hits " hits ", misses " misses ", expected " compiles + 1
+		exit (hits + misses == compiles + 1) ? 0 : 1
+	}'
@@ -1,24 +1,233 @@
 #include <string>
+#include <map>
 #include <fstream>
 #include <iostream>
 #include "Token.h"
 #include "Tokenizer.h"
 #include "CompileError.h"
 #include "Parser.h"
+#include "JitEngine.h"
+#include "ThinLtoLinker.h"
+#include "CompileCache.h"
+#include "IncrementalDatabase.h"
+#include "util.h"
+#include "llvm/Config/llvm-config.h"
 
 std::vector<std::string> debugLogs;
 
 namespace {
+	const uint64_t kDefaultJitThreshold = 1000;
+	const uint32_t kMaxOptimizationLevel = 3;
+	const uint64_t kDefaultCacheSize = 1024 * 1024 * 1024;
+	const char* const kDefaultProfileGeneratePath = "default.profraw";
+	const char* const kCompilerVersion = "mahina (LLVM " LLVM_VERSION_STRING ")";
+
+	bool startsWith(const std::string& str, const std::string& prefix, std::string* rest);
+
+	enum class Emit {
+		LL,
+		BC,
+		OBJ,
+	};
+
 	struct Flag {
 		std::string sourceFilepath;
+		std::string sourceDirectory;
 		std::string sourceFilename;
+		std::vector<std::string> inputFilepaths;
+		std::string outputPath;
+		Emit emit;
+		uint32_t optimizationLevel;
+		bool isThinLto;
+		bool isThinLtoLink;
+		uint32_t thinLtoJobs;
+		bool isJit;
+		uint64_t jitThreshold;
+		bool isJitPerf;
+		bool isNativeArch;
+		std::string targetCpu;
+		std::string targetFeatures;
+		std::string cacheDirectory;
+		uint64_t cacheSize;
+		bool isCacheStatistics;
+		std::string incrementalDirectory;
+		std::string profileGeneratePath;
+		std::string profileUsePath;
+		llvm::DICompileUnit::DebugEmissionKind debugEmissionKind;
+		Generator::Allocator allocator;
+		bool isHeapStatistics;
+		bool isCompactObjects;
+
+		Flag() : emit(Emit::LL), optimizationLevel(0), isThinLto(false), isThinLtoLink(false), thinLtoJobs(0), isJit(false), jitThreshold(kDefaultJitThreshold), isJitPerf(false), isNativeArch(false), cacheSize(kDefaultCacheSize), isCacheStatistics(false), debugEmissionKind(llvm::DICompileUnit::NoDebug), allocator(Generator::Allocator::POOL), isHeapStatistics(false), isCompactObjects(false) {}
 
 		bool parse(int argc, char** argv) {
-			if (argc != 2) {
+			for (int i = 1; i < argc; ++i) {
+				std::string arg = argv[i];
+				std::string value;
+				if (arg == "-o") {
+					if (++i == argc) {
+						return true;
+					}
+					outputPath = argv[i];
+				}
+				else if (startsWith(arg, "-O", &value)) {
+					if (toU32(value, optimizationLevel) || (kMaxOptimizationLevel < optimizationLevel)) {
+						return true;
+					}
+				}
+				else if (startsWith(arg, "--emit=", &value)) {
+					if (value == "ll") {
+						emit = Emit::LL;
+					}
+					else if (value == "bc") {
+						emit = Emit::BC;
+					}
+					else if (value == "obj") {
+						emit = Emit::OBJ;
+					}
+					else {
+						return true;
+					}
+				}
+				else if (arg == "-flto=thin") {
+					isThinLto = true;
+				}
+				else if (arg == "--thinlto-link") {
+					isThinLtoLink = true;
+				}
+				else if (startsWith(arg, "--thinlto-jobs=", &value)) {
+					if (toU32(value, thinLtoJobs)) {
+						return true;
+					}
+				}
+				else if (startsWith(arg, "--cache-dir=", &value)) {
+					cacheDirectory = value;
+				}
+				else if (startsWith(arg, "--cache-size=", &value)) {
+					if (toU64(value, cacheSize)) {
+						return true;
+					}
+				}
+				else if (arg == "--cache-stats") {
+					isCacheStatistics = true;
+				}
+				else if (startsWith(arg, "--incremental-dir=", &value)) {
+					incrementalDirectory = value;
+				}
+				else if (arg == "--jit") {
+					isJit = true;
+				}
+				else if (startsWith(arg, "--jit-threshold=", &value)) {
+					if (toU64(value, jitThreshold)) {
+						return true;
+					}
+				}
+				else if (arg == "--jit-perf") {
+					isJitPerf = true;
+				}
+				else if (arg == "-fprofile-generate") {
+					profileGeneratePath = kDefaultProfileGeneratePath;
+				}
+				else if (startsWith(arg, "-fprofile-generate=", &value)) {
+					profileGeneratePath = value;
+				}
+				else if (startsWith(arg, "-fprofile-use=", &value)) {
+					profileUsePath = value;
+				}
+				else if (arg == "-g") {
+					debugEmissionKind = llvm::DICompileUnit::FullDebug;
+				}
+				else if (arg == "-gline-tables-only") {
+					debugEmissionKind = llvm::DICompileUnit::LineTablesOnly;
+				}
+				else if (arg == "-g0") {
+					debugEmissionKind = llvm::DICompileUnit::NoDebug;
+				}
+				else if (arg == "-march=native") {
+					isNativeArch = true;
+				}
+				else if (startsWith(arg, "-mcpu=", &value)) {
+					targetCpu = value;
+				}
+				else if (startsWith(arg, "-mattr=", &value)) {
+					targetFeatures = value;
+				}
+				else if (startsWith(arg, "--allocator=", &value)) {
+					if (value == "pool") {
+						allocator = Generator::Allocator::POOL;
+					}
+					else if (value == "malloc") {
+						allocator = Generator::Allocator::MALLOC;
+					}
+					else {
+						return true;
+					}
+				}
+				else if (arg == "--heap-stats") {
+					isHeapStatistics = true;
+				}
+				else if (arg == "--compact-objects") {
+					isCompactObjects = true;
+				}
+				else if (startsWith(arg, "-", nullptr)) {
+					return true;
+				}
+				else {
+					inputFilepaths.push_back(arg);
+				}
+			}
+
+			if (isThinLtoLink) {
+				return inputFilepaths.empty();
+			}
+			if (isCacheStatistics) {
+				return cacheDirectory.empty();
+			}
+
+			if (inputFilepaths.size() != 1) {
 				return true;
 			}
+			sourceFilepath = inputFilepaths.front();
 
-			sourceFilepath = argv[1];
+			// ThinLTO needs the summary index that only bitcode carries
+			if (isThinLto && (emit != Emit::BC)) {
+				return true;
+			}
+
+			// the jitdump file carries source lines only when there is debug info to take them from
+			if (isJitPerf && (debugEmissionKind == llvm::DICompileUnit::NoDebug)) {
+				debugEmissionKind = llvm::DICompileUnit::LineTablesOnly;
+			}
+
+			// the profile runtime is linked into the program, not into the compiler
+			if (!profileGeneratePath.empty() && (isJit || !profileUsePath.empty())) {
+				return true;
+			}
+
+			// the profile only guides the optimizer, which does not run at -O0 and is not given the profile by the JIT
+			if (!profileUsePath.empty() && ((optimizationLevel == 0) || isJit)) {
+				std::cerr << "-fprofile-use\tRequiresOptimization\n";
+				return true;
+			}
+
+			// the statistics are written by a global destructor, which the JIT does not run
+			if (isHeapStatistics && isJit) {
+				return true;
+			}
+
+			if (outputPath.empty()) {
+				switch (emit) {
+				case Emit::LL:
+					outputPath = "a.ll";
+					break;
+				case Emit::BC:
+					outputPath = "a.bc";
+					break;
+				case Emit::OBJ:
+					outputPath = "a.obj";
+					break;
+				}
+			}
 
 			return false;
 		}
@@ -26,6 +235,14 @@ namespace {
 
 	bool splitPath(const std::string& filepath, std::string* dir, std::string* filename);
 	bool skipUtf8Bom(std::istream& src);
+	void printCompileErrors(Context& context);
+	void setGeneratorOptions(const Flag& flag, Generator& generator);
+	int linkThinLto(const Flag& flag);
+	bool getCompileParameters(const Flag& flag, std::vector<std::string>& result);
+	bool computeCacheKey(const Flag& flag, const CompileCache& cache, std::string& result);
+	int printCacheStatistics(const CompileCache& cache);
+	bool findReusableFunctions(const Flag& flag, const IncrementalDatabase& database, Context& context, std::map<std::string, std::string>& fingerprints);
+	bool updateIncrementalDatabase(IncrementalDatabase& database, const Context& context, const std::map<std::string, std::string>& fingerprints, Generator& generator);
 }
 
 int main(int argc, char** argv) {
@@ -34,7 +251,37 @@ int main(int argc, char** argv) {
 		return 1;
 	}
 
-	if (splitPath(flag.sourceFilepath, nullptr, &flag.sourceFilename)) {
+	if (flag.isThinLtoLink) {
+		return linkThinLto(flag);
+	}
+
+	// the JIT has no output to cache
+	std::unique_ptr<CompileCache> cache;
+	std::string cacheKey;
+	if (!flag.cacheDirectory.empty() && !flag.isJit) {
+		cache = std::make_unique<CompileCache>(flag.cacheDirectory, flag.cacheSize);
+		if (cache->init()) {
+			return 1;
+		}
+
+		if (flag.isCacheStatistics) {
+			return printCacheStatistics(*cache);
+		}
+
+		if (computeCacheKey(flag, *cache, cacheKey)) {
+			return 1;
+		}
+
+		bool isHit;
+		if (cache->lookup(cacheKey, flag.outputPath, isHit)) {
+			return 1;
+		}
+		if (isHit) {
+			return 0;
+		}
+	}
+
+	if (splitPath(flag.sourceFilepath, &flag.sourceDirectory, &flag.sourceFilename)) {
 		return 1;
 	}
 
@@ -64,36 +311,315 @@ int main(int argc, char** argv) {
 	DebugPrinter dp = { ofs, 0 };
 	parser.getRootNode().debugPrint(dp);
 
+	// function name -> fingerprint
+	std::unique_ptr<IncrementalDatabase> database;
+	std::map<std::string, std::string> fingerprints;
+	if (!flag.incrementalDirectory.empty() && !flag.isJit) {
+		database = std::make_unique<IncrementalDatabase>(flag.incrementalDirectory);
+		if (database->init() ||
+			findReusableFunctions(flag, *database, parser.getRootNode(), fingerprints)) {
+			return 1;
+		}
+	}
+
 	Generator generator(flag.sourceFilename);
+	generator.setTieredCompilation(flag.isJit);
+	generator.setProfileGeneratePath(flag.profileGeneratePath);
+	generator.setProfileUsePath(flag.profileUsePath);
+	setGeneratorOptions(flag, generator);
 	if (generator.init() ||
 		parser.getRootNode().generate(generator)) {
-		auto& errors = parser.getRootNode().getCompileErrors();
-		//if (!errors.empty()) {
-			for (auto& error : errors) {
-				error->printErrorMessage(std::cerr);
-				std::cerr << "\n";
-			}
-		//}
-		//else {
-			for (auto& log : debugLogs) {
-				std::cerr << log << "\n";
-			}
-		//}
+		printCompileErrors(parser.getRootNode());
+		return 1;
+	}
+
+	if (flag.isJit) {
+		Generator tier1Generator(flag.sourceFilename);
+		setGeneratorOptions(flag, tier1Generator);
+		if (tier1Generator.init() ||
+			parser.getRootNode().generate(tier1Generator)) {
+			printCompileErrors(parser.getRootNode());
+			return 1;
+		}
+
+		JitEngine jit(std::cerr, flag.jitThreshold);
+		jit.setPerfSupport(flag.isJitPerf);
+		jit.setTarget(tier1Generator.getTargetCpu(), tier1Generator.getTargetFeatures());
+		int exitCode = 0;
+		if (jit.init() ||
+			jit.addTier0Module(generator) ||
+			jit.setTier1Module(tier1Generator) ||
+			jit.run("main", exitCode)) {
+			printCompileErrors(parser.getRootNode());
+			return 1;
+		}
+
+		return exitCode;
+	}
+
+	if (generator.optimize(flag.optimizationLevel, flag.isThinLto)) {
+		printCompileErrors(parser.getRootNode());
 		return 1;
 	}
 
-	if (generator.writeString("a.ll")) {
+	if (database && updateIncrementalDatabase(*database, parser.getRootNode(), fingerprints, generator)) {
+		printCompileErrors(parser.getRootNode());
 		return 1;
 	}
 
-	//if (generator.writeObjectFile("a.obj")) {
-	//	return 1;
-	//}
+	switch (flag.emit) {
+	case Emit::LL:
+		if (generator.writeString(flag.outputPath)) {
+			return 1;
+		}
+		break;
+	case Emit::BC:
+		if (generator.writeBitcodeFile(flag.outputPath, flag.isThinLto)) {
+			return 1;
+		}
+		break;
+	case Emit::OBJ:
+		if (generator.writeObjectFile(flag.outputPath)) {
+			return 1;
+		}
+		break;
+	}
+
+	if (cache) {
+		// a failure here only costs the next compile a miss
+		cache->store(cacheKey, flag.outputPath);
+	}
 
 	return 0;
 }
 
 namespace {
+	bool startsWith(const std::string& str, const std::string& prefix, std::string* rest) {
+		if (str.compare(0, prefix.size(), prefix) != 0) {
+			return false;
+		}
+
+		if (rest) {
+			*rest = str.substr(prefix.size());
+		}
+
+		return true;
+	}
+
+	void resolveTarget(const Flag& flag, std::string& cpu, std::string& features) {
+		cpu = flag.targetCpu;
+		features.clear();
+		if (flag.isNativeArch) {
+			if (cpu.empty()) {
+				cpu = Generator::getHostCpuName();
+			}
+			features = Generator::getHostCpuFeatures();
+		}
+
+		// -mattr is applied after the host features so that it can disable them
+		if (!flag.targetFeatures.empty()) {
+			if (!features.empty()) {
+				features += ",";
+			}
+			features += flag.targetFeatures;
+		}
+	}
+
+	void setGeneratorOptions(const Flag& flag, Generator& generator) {
+		std::string cpu;
+		std::string features;
+		resolveTarget(flag, cpu, features);
+
+		if (!cpu.empty()) {
+			generator.setTargetCpu(cpu);
+		}
+		generator.setTargetFeatures(features);
+
+		generator.setDebugEmissionKind(flag.debugEmissionKind);
+		generator.setSourceDirectory(flag.sourceDirectory);
+		generator.setAllocator(flag.allocator);
+		generator.setHeapStatistics(flag.isHeapStatistics);
+		generator.setCompactObjects(flag.isCompactObjects);
+	}
+
+	int linkThinLto(const Flag& flag) {
+		std::string cpu;
+		std::string features;
+		resolveTarget(flag, cpu, features);
+
+		ThinLtoLinker linker;
+		linker.setTargetCpu(cpu);
+		linker.setTargetFeatures(features);
+		linker.setOptimizationLevel(flag.optimizationLevel);
+		if (linker.init(flag.thinLtoJobs)) {
+			return 1;
+		}
+
+		for (auto& input : flag.inputFilepaths) {
+			if (linker.addInput(input)) {
+				std::cerr << input << "\tInvalidBitcode\n";
+				return 1;
+			}
+		}
+
+		std::vector<std::string> outputPaths;
+		if (linker.link(flag.outputPath.empty() ? "a" : flag.outputPath, outputPaths)) {
+			for (auto& log : debugLogs) {
+				std::cerr << log << "\n";
+			}
+			return 1;
+		}
+
+		for (auto& path : outputPaths) {
+			std::cout << path << "\n";
+		}
+
+		return 0;
+	}
+
+	// everything except the source that changes the generated code
+	bool getCompileParameters(const Flag& flag, std::vector<std::string>& result) {
+		std::string cpu;
+		std::string features;
+		resolveTarget(flag, cpu, features);
+
+		// debug info records where the source is
+		llvm::SmallString<256> sourcePath;
+		if (flag.debugEmissionKind != llvm::DICompileUnit::NoDebug) {
+			sourcePath = flag.sourceFilepath;
+			if (llvm::sys::fs::make_absolute(sourcePath)) {
+				return true;
+			}
+		}
+
+		// the profile is named by path but takes part by content, as it is rewritten between training runs
+		std::string profile;
+		if (!flag.profileUsePath.empty()) {
+			std::ifstream ifs(flag.profileUsePath, std::ios::binary);
+			if (!ifs) {
+				return true;
+			}
+			profile.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+		}
+
+		// a rebuild of any part of the compiler changes the executable, unlike __DATE__ of one translation unit
+		std::string compilerIdentity;
+		if (CompileCache::getCompilerIdentity(compilerIdentity)) {
+			return true;
+		}
+
+		result = {
+			kCompilerVersion,
+			compilerIdentity,
+			Generator::getDefaultTargetTriple(),
+			cpu,
+			features,
+			std::to_string(flag.optimizationLevel),
+			flag.isThinLto ? "thinlto" : "",
+			flag.profileGeneratePath,
+			profile,
+			std::to_string(static_cast<int>(flag.debugEmissionKind)),
+			sourcePath.str().str(),
+			std::to_string(static_cast<int>(flag.allocator)),
+			flag.isHeapStatistics ? "heapstats" : "",
+			flag.isCompactObjects ? "compactobjects" : "",
+		};
+
+		return false;
+	}
+
+	bool computeCacheKey(const Flag& flag, const CompileCache& cache, std::string& result) {
+		std::vector<std::string> parameters;
+		if (getCompileParameters(flag, parameters)) {
+			return true;
+		}
+		parameters.push_back(std::to_string(static_cast<int>(flag.emit)));
+
+		return cache.computeKey(flag.sourceFilepath, parameters, result);
+	}
+
+	int printCacheStatistics(const CompileCache& cache) {
+		CompileCache::Statistics statistics;
+		if (cache.getStatistics(statistics)) {
+			return 1;
+		}
+
+		std::cout << "hits\t" << statistics.hits << "\n";
+		std::cout << "misses\t" << statistics.misses << "\n";
+		std::cout << "entries\t" << statistics.entries << "\n";
+		std::cout << "size\t" << statistics.size << "\n";
+
+		return 0;
+	}
+
+	bool findReusableFunctions(const Flag& flag, const IncrementalDatabase& database, Context& context, std::map<std::string, std::string>& fingerprints) {
+		std::vector<std::string> parameters;
+		if (getCompileParameters(flag, parameters)) {
+			return true;
+		}
+
+		for (auto& cu : context.getCompileUnits()) {
+			for (auto& f : cu.getFunctions()) {
+				if (f.getFunctionType() != FunctionNode::Type::MAHINA) {
+					continue;
+				}
+
+				const std::string& name = f.getName().getString();
+				std::string fingerprint;
+				if (database.computeFingerprint(context, f, parameters, fingerprint)) {
+					return true;
+				}
+				fingerprints[name] = fingerprint;
+
+				// only the declaration is generated, and the definition is linked after optimization
+				if (database.contains(fingerprint)) {
+					context.addReusedFunction(name);
+				}
+			}
+		}
+
+		return false;
+	}
+
+	bool updateIncrementalDatabase(IncrementalDatabase& database, const Context& context, const std::map<std::string, std::string>& fingerprints, Generator& generator) {
+		// new definitions are extracted before the linked ones are mixed into the module
+		for (auto& fingerprint : fingerprints) {
+			if (context.isReusedFunction(fingerprint.first)) {
+				continue;
+			}
+
+			// a failure here only costs the next compile a regeneration of the function
+			llvm::SmallVector<char, 0> bitcode;
+			if (!generator.writeFunctionBitcode(fingerprint.first, bitcode)) {
+				database.store(fingerprint.second, bitcode);
+			}
+		}
+
+		for (auto& fingerprint : fingerprints) {
+			if (!context.isReusedFunction(fingerprint.first)) {
+				continue;
+			}
+
+			// another process may have removed the database, which can not be recovered after generation
+			if (generator.linkBitcodeFile(database.getEntryPath(fingerprint.second))) {
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	void printCompileErrors(Context& context) {
+		auto& errors = context.getCompileErrors();
+		for (auto& error : errors) {
+			error->printErrorMessage(std::cerr);
+			std::cerr << "\n";
+		}
+		for (auto& log : debugLogs) {
+			std::cerr << log << "\n";
+		}
+	}
+
 	bool splitPath(const std::string& filepath, std::string* dir, std::string* filename) {
 		size_t pos = filepath.find_last_of("\\/");
 		if (pos == std::string::npos) {
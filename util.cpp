@@ -1,4 +1,5 @@
 #include "util.h"
+#include <stdexcept>
 
 bool toBoolean(const std::string& str, bool& b) {
 	if (str == "true") {
@@ -26,7 +27,14 @@ bool toInt32(const std::string& str, int32_t& n) {
 
 bool toInt64(const std::string& str, int64_t& n) {
 	size_t index = 0;
-	int64_t num = std::stoll(str, &index, 0);
+	int64_t num = 0;
+	try {
+		num = std::stoll(str, &index, 0);
+	}
+	catch (const std::exception&) {
+		// out of range literals are reported instead of terminating the compiler
+		return true;
+	}
 	if (index - str.size() != 0) {
 		return true;
 	}